@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+// Watches the listen= sockets of autostart=on-demand programs. Sockets are registered
+// edge-triggered, so a connection landing on an empty accept queue is reported once,
+// whether or not the program is already running to accept it.
+class ActivationWatcher {
+public:
+    using Handler = std::function<void(const std::vector<std::string>& instances)>;
+    
+    ActivationWatcher() = default;
+    ~ActivationWatcher();
+    
+    bool start(Handler handler);
+    void stop();
+    
+    // Listening fd -> instances that accept from it
+    void setTargets(const std::map<int, std::vector<std::string>>& targets);
+
+private:
+    void loop();
+    
+    Handler handler;
+    std::mutex targets_mutex;
+    std::map<int, std::vector<std::string>> targets;
+    int epoll_fd = -1;
+    std::atomic<bool> running{false};
+    std::thread loop_thread;
+    
+    static constexpr int MAX_EVENTS = 64;
+    static constexpr int WAIT_MS = 200;
+};
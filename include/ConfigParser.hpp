@@ -8,6 +8,23 @@
 #include <sstream>
 #include "Process.hpp"
 
+struct SupervisorConfig {
+    std::string metrics_listen;
+    std::string control_socket;
+    int control_workers = 4;
+    int control_batch_workers = 16;
+    int event_queue_size = 1024;
+    std::string state_journal;   // Children are re-adopted from it after a supervisor restart
+    std::vector<std::string> upgrade_binaries;   // Besides the startup binary, what upgrade may execute
+    bool detach_on_exit = false; // exit_action=detach: exiting leaves children running for the next supervisor
+    int monitor_shards = 0;      // 0: one per online CPU
+    std::string event_backend = "auto";   // auto, io_uring or epoll
+    int bulk_workers = 64;       // Concurrent instance operations of one start/stop/restart over several targets
+    double spawn_rate = 10;      // Automatic restarts per second; 0 disables the spawn governor
+    int spawn_burst = 20;
+    double spawn_pressure_threshold = 40;   // PSI some avg10 percentage above which spawn_rate is scaled down
+};
+
 struct IniParserData {
     std::map<std::string, std::map<std::string, std::string>> sections;
 };
@@ -18,13 +35,26 @@ public:
     
     bool parseFile(const std::string& filename);
     std::map<std::string, ProcessConfig> getProcessConfigs() const;
+    // [group:name] sections: the programs each group lists, in the order given
+    const std::map<std::string, std::vector<std::string>>& getGroupConfigs() const { return group_configs; }
+    // One numprocs instance of a program, with %(process_num)d, %(program_name)s, %(numprocs)d and %(here)s
+    // expanded in command, environment values, log paths and directory
+    ProcessConfig instanceConfig(const ProcessConfig& program, int process_num, std::string* error = nullptr) const;
+    SupervisorConfig getSupervisorConfig() const { return supervisor_config; }
     
+    static std::string expandTemplate(const std::string& value, const std::map<std::string, std::string>& variables,
+                                      std::string* error);
     static int iniHandler(void* user, const char* section, const char* name, const char* value);
-    
+
 private:
     std::map<std::string, ProcessConfig> process_configs;
+    std::map<std::string, std::vector<std::string>> group_configs;
+    SupervisorConfig supervisor_config;
+    std::string config_dir;
     
+    void parseSupervisorSection(const std::map<std::string, std::string>& section_data);
     void parseProgramSection(const std::string& section_name, const std::map<std::string, std::string>& section_data);
+    void parseGroupSection(const std::string& section_name, const std::map<std::string, std::string>& section_data);
     std::map<std::string, std::string> parseEnvironment(const std::string& env_str);
     std::vector<int> parseExitCodes(const std::string& codes_str);
     AutoStart parseAutoStart(const std::string& value);
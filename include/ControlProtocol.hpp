@@ -0,0 +1,170 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+// Binary control framing, chosen per connection when its first byte is 0
+// (frames are capped below 16 MiB, so a big-endian length always starts with 0).
+//
+//   request:  u32 length | u32 request_id | u8 opcode | payload
+//   response: u32 length | u32 request_id | u8 opcode | payload
+//
+// COMMAND carries one text command and is answered with u8 keep_open followed by its output.
+// START/STOP/RESTART/STATUS carry u32 count + count * (u16 length, name) and are answered
+// with u32 count + count * (u8 status, u16 length, message) in request order.
+// SUBSCRIBE carries "[glob] [types]" and is acknowledged once; every matching state change
+// then arrives as an EVENT frame tagged with the subscription's request id.
+// Requests on one connection run concurrently and may be answered out of order.
+class ControlProtocol {
+public:
+    enum class Opcode : uint8_t {
+        ERROR = 0,
+        COMMAND = 1,
+        START = 2,
+        STOP = 3,
+        RESTART = 4,
+        STATUS = 5,
+        SUBSCRIBE = 6,
+        EVENT = 7
+    };
+    
+    enum class ItemStatus : uint8_t {
+        OK = 0,
+        NOT_FOUND = 1,
+        FAILED = 2
+    };
+    
+    struct ItemResult {
+        ItemStatus status = ItemStatus::FAILED;
+        std::string message;
+    };
+    
+    struct Frame {
+        uint32_t request_id = 0;
+        Opcode opcode = Opcode::ERROR;
+        std::string payload;
+    };
+    
+    static constexpr size_t HEADER_SIZE = 4;
+    static constexpr size_t MAX_FRAME = 16 * 1024 * 1024 - 1;
+    static constexpr size_t MAX_BATCH = 65536;
+    static constexpr size_t MAX_ITEM = 65535;
+    
+    static bool isBatch(Opcode opcode) {
+        return opcode == Opcode::START || opcode == Opcode::STOP ||
+               opcode == Opcode::RESTART || opcode == Opcode::STATUS;
+    }
+    
+    static void putU16(std::string& out, uint16_t value) {
+        out += static_cast<char>(value >> 8);
+        out += static_cast<char>(value & 0xff);
+    }
+    
+    static void putU32(std::string& out, uint32_t value) {
+        out += static_cast<char>(value >> 24);
+        out += static_cast<char>((value >> 16) & 0xff);
+        out += static_cast<char>((value >> 8) & 0xff);
+        out += static_cast<char>(value & 0xff);
+    }
+    
+    static bool getU16(const std::string& in, size_t& offset, uint16_t& value) {
+        if (in.size() < offset + 2) return false;
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(in.data() + offset);
+        value = static_cast<uint16_t>((p[0] << 8) | p[1]);
+        offset += 2;
+        return true;
+    }
+    
+    static bool getU32(const std::string& in, size_t& offset, uint32_t& value) {
+        if (in.size() < offset + 4) return false;
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(in.data() + offset);
+        value = (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+                (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+        offset += 4;
+        return true;
+    }
+    
+    static std::string encodeFrame(uint32_t request_id, Opcode opcode, const std::string& payload) {
+        std::string out;
+        out.reserve(HEADER_SIZE + 5 + payload.size());
+        putU32(out, static_cast<uint32_t>(5 + payload.size()));
+        putU32(out, request_id);
+        out += static_cast<char>(opcode);
+        out += payload;
+        return out;
+    }
+    
+    // Returns 1 when a frame was taken, 0 when more bytes are needed, -1 on a malformed header
+    static int takeFrame(std::string& buffer, Frame& frame) {
+        size_t offset = 0;
+        uint32_t length;
+        if (!getU32(buffer, offset, length)) return 0;
+        if (length < 5 || length > MAX_FRAME) return -1;
+        if (buffer.size() < HEADER_SIZE + length) return 0;
+        
+        getU32(buffer, offset, frame.request_id);
+        frame.opcode = static_cast<Opcode>(buffer[offset++]);
+        frame.payload.assign(buffer, offset, length - 5);
+        buffer.erase(0, HEADER_SIZE + length);
+        return 1;
+    }
+    
+    static std::string encodeNames(const std::vector<std::string>& names) {
+        std::string out;
+        putU32(out, static_cast<uint32_t>(names.size()));
+        for (const auto& name : names) {
+            size_t length = std::min(name.size(), MAX_ITEM);
+            putU16(out, static_cast<uint16_t>(length));
+            out.append(name, 0, length);
+        }
+        return out;
+    }
+    
+    static bool decodeNames(const std::string& payload, std::vector<std::string>& names) {
+        size_t offset = 0;
+        uint32_t count;
+        if (!getU32(payload, offset, count) || count > MAX_BATCH) return false;
+        
+        names.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            uint16_t length;
+            if (!getU16(payload, offset, length) || payload.size() < offset + length) return false;
+            names.emplace_back(payload, offset, length);
+            offset += length;
+        }
+        return offset == payload.size();
+    }
+    
+    static std::string encodeResults(const std::vector<ItemResult>& results) {
+        std::string out;
+        putU32(out, static_cast<uint32_t>(results.size()));
+        for (const auto& result : results) {
+            size_t length = std::min(result.message.size(), MAX_ITEM);
+            out += static_cast<char>(result.status);
+            putU16(out, static_cast<uint16_t>(length));
+            out.append(result.message, 0, length);
+        }
+        return out;
+    }
+    
+    static bool decodeResults(const std::string& payload, std::vector<ItemResult>& results) {
+        size_t offset = 0;
+        uint32_t count;
+        if (!getU32(payload, offset, count) || count > MAX_BATCH) return false;
+        
+        results.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            ItemResult result;
+            uint16_t length;
+            if (payload.size() < offset + 1) return false;
+            result.status = static_cast<ItemStatus>(payload[offset++]);
+            if (!getU16(payload, offset, length) || payload.size() < offset + length) return false;
+            result.message.assign(payload, offset, length);
+            offset += length;
+            results.push_back(std::move(result));
+        }
+        return offset == payload.size();
+    }
+};
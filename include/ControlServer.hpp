@@ -0,0 +1,130 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <ostream>
+#include <cstdint>
+#include "SocketUtils.hpp"
+#include "WorkerPool.hpp"
+#include "ControlProtocol.hpp"
+#include "ProcessEvents.hpp"
+
+// Line-oriented control protocol: one command per line, answered with
+// "OK <length>\n<body>" (or "BYE <length>\n<body>" before the server hangs up).
+// Commands run on a worker pool; the epoll loop only moves bytes, so a slow
+// reader or a long-running stop never holds up other clients.
+// Connections opening with a zero byte speak the binary ControlProtocol instead:
+// requests are pipelined and the items of a batch fan out over a separate pool.
+// Either kind of client may subscribe to the process event stream, which is then
+// interleaved with its responses as EVENT frames.
+class ControlServer {
+public:
+    using CommandHandler = std::function<bool(const std::string& command, std::ostream& out)>;
+    using ItemHandler = std::function<ControlProtocol::ItemResult(ControlProtocol::Opcode op, const std::string& name)>;
+    
+    ControlServer(CommandHandler handler, ItemHandler item_handler, size_t workers, size_t batch_workers);
+    ~ControlServer();
+    
+    bool start(const SocketSpec& spec);
+    void stop();
+    void setEventQueueSize(size_t size) { event_queue_size = size; }
+
+private:
+    enum class Mode {
+        UNKNOWN,
+        TEXT,
+        BINARY
+    };
+    
+    struct Client {
+        int fd = -1;
+        Mode mode = Mode::UNKNOWN;
+        std::string input;
+        std::string output;
+        std::deque<std::string> pending;
+        std::deque<ControlProtocol::Frame> frames;
+        size_t in_flight = 0;
+        bool closing = false;
+        bool input_closed = false;
+        uint32_t events = 0;
+        std::shared_ptr<EventSubscription> subscription;
+        uint32_t subscription_id = 0;
+        
+        bool idle() const { return pending.empty() && frames.empty() && in_flight == 0; }
+    };
+    
+    struct Completion {
+        uint64_t client_id;
+        std::string response;
+        bool keep_open;
+    };
+    
+    // Per-item results of one binary batch; the last item to finish posts the response
+    struct Batch {
+        uint64_t client_id;
+        uint32_t request_id;
+        ControlProtocol::Opcode opcode;
+        std::vector<std::string> names;
+        std::vector<ControlProtocol::ItemResult> results;
+        std::atomic<size_t> remaining;
+    };
+    
+    void loop();
+    void acceptClients();
+    void readClient(uint64_t id, Client& client);
+    void writeClient(Client& client);
+    bool parseInput(uint64_t id, Client& client);
+    void dispatchNext(uint64_t id, Client& client);
+    void dispatchText(uint64_t id, Client& client);
+    void dispatchBinary(uint64_t id, Client& client);
+    void dispatchBatch(uint64_t id, ControlProtocol::Frame& frame);
+    void complete(Completion completion);
+    bool subscribe(Client& client, const std::string& arguments, uint32_t request_id, std::string& message);
+    void pumpEvents(Client& client);
+    void drainSubscriptions();
+    void drainCompletions();
+    void updateEvents(uint64_t id, Client& client);
+    void closeClient(uint64_t id);
+    void wake();
+    
+    static std::string frame(const char* status, const std::string& body);
+    
+    CommandHandler handler;
+    ItemHandler item_handler;
+    size_t worker_count;
+    size_t batch_worker_count;
+    std::unique_ptr<WorkerPool> pool;
+    std::unique_ptr<WorkerPool> batch_pool;
+    SocketSpec spec;
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    uint64_t next_client_id = FIRST_CLIENT_ID;
+    std::map<uint64_t, Client> clients;
+    
+    std::mutex completions_mutex;
+    std::vector<Completion> completions;
+    
+    size_t event_queue_size = DEFAULT_EVENT_QUEUE;
+    
+    std::atomic<bool> running{false};
+    std::thread loop_thread;
+    
+    static constexpr uint64_t LISTEN_ID = 0;
+    static constexpr uint64_t WAKE_ID = 1;
+    static constexpr uint64_t FIRST_CLIENT_ID = 2;
+    static constexpr int SOCKET_MODE = 0600;
+    static constexpr size_t MAX_LINE = 64 * 1024;
+    static constexpr size_t OUTPUT_HIGH_WATER = 1024 * 1024;
+    static constexpr size_t MAX_IN_FLIGHT = 64;
+    static constexpr size_t MAX_QUEUED = 4 * MAX_IN_FLIGHT;   // Parsed requests waiting to be dispatched
+    static constexpr size_t DEFAULT_EVENT_QUEUE = 1024;
+    static constexpr size_t EVENT_BATCH = 256;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sys/types.h>
+
+enum class AffinityMode {
+    NONE,
+    CPUSET,
+    ROUND_ROBIN,
+    NUMA_SPREAD
+};
+
+enum class MemPolicy {
+    NONE,
+    BIND,
+    INTERLEAVE,
+    PREFERRED
+};
+
+struct AffinityPolicy {
+    AffinityMode mode = AffinityMode::NONE;
+    std::vector<int> cpus;          // explicit cpuset, or the pool used by round-robin
+    MemPolicy mempolicy = MemPolicy::NONE;
+    
+    bool operator==(const AffinityPolicy& other) const {
+        return mode == other.mode && cpus == other.cpus && mempolicy == other.mempolicy;
+    }
+    bool operator!=(const AffinityPolicy& other) const { return !(*this == other); }
+};
+
+struct AffinityPlacement {
+    std::vector<int> cpus;
+    std::vector<int> nodes;
+};
+
+class CpuAffinity {
+public:
+    static bool parseAffinity(const std::string& value, AffinityPolicy& policy);
+    static bool parseMemPolicy(const std::string& value, MemPolicy& mempolicy);
+    static bool parseCpuList(const std::string& list, std::vector<int>& cpus);
+    static std::string formatCpuList(const std::vector<int>& cpus);
+    
+    // Resolves the policy for one numprocs instance; must be called before fork()
+    static AffinityPlacement resolvePlacement(const AffinityPolicy& policy, int process_num);
+    // Async-signal-safe enough for the child side of fork(): only raw syscalls
+    static bool applyPlacement(const AffinityPolicy& policy, const AffinityPlacement& placement);
+    // CPU half of a placement, for a process that is already running (pid 0 is the caller)
+    static bool applyCpus(pid_t pid, const std::vector<int>& cpus);
+    
+    static std::string describeCpuMask(pid_t pid);
+    static int currentNode(pid_t pid);
+
+private:
+    struct Topology {
+        std::vector<int> online_cpus;
+        std::map<int, std::vector<int>> node_cpus;
+        std::map<int, int> cpu_node;
+    };
+    
+    static const Topology& topology();
+    static Topology loadTopology();
+    static std::string readFirstLine(const std::string& path);
+};
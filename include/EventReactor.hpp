@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <linux/io_uring.h>
+
+// Readiness loop for one monitor shard. With io_uring every new watch, re-arm and removal is queued
+// as an SQE and submitted by the same io_uring_enter that waits, so a loop iteration is one syscall
+// however many children exited. Falls back to epoll where io_uring is missing or not permitted, and
+// switches to it when the ring keeps failing.
+class EventReactor {
+public:
+    enum class Backend { AUTO, IO_URING, EPOLL };
+    
+    EventReactor() = default;
+    ~EventReactor();
+    EventReactor(const EventReactor&) = delete;
+    EventReactor& operator=(const EventReactor&) = delete;
+    
+    bool open(Backend preferred);
+    void close();
+    bool isOpen() const { return backend_open; }
+    const char* backendName() const;
+    
+    // One-shot: token is reported by the next wait() that finds fd readable, and watch() is called
+    // again to re-arm it. fd must stay open until it is unwatched
+    bool watch(int fd, uint64_t token);
+    void unwatch(uint64_t token);
+    // Returns at the deadline or once at least one watched fd is readable
+    void wait(std::chrono::steady_clock::time_point deadline, std::vector<uint64_t>& ready);
+    
+    static Backend parseBackend(const std::string& value);
+
+private:
+    struct Ring {
+        int fd = -1;
+        void* sq_map = nullptr;
+        size_t sq_map_size = 0;
+        void* cq_map = nullptr;
+        size_t cq_map_size = 0;
+        io_uring_sqe* sqes = nullptr;
+        size_t sqes_size = 0;
+        unsigned* sq_head = nullptr;
+        unsigned* sq_tail = nullptr;
+        unsigned* sq_mask = nullptr;
+        unsigned* sq_array = nullptr;
+        unsigned* cq_head = nullptr;
+        unsigned* cq_tail = nullptr;
+        unsigned* cq_mask = nullptr;
+        io_uring_cqe* cqes = nullptr;
+        unsigned entries = 0;
+    };
+    
+    bool openRing();
+    void closeRing();
+    io_uring_sqe* nextSqe();
+    void waitRing(std::chrono::steady_clock::time_point deadline, std::vector<uint64_t>& ready);
+    void waitEpoll(std::chrono::steady_clock::time_point deadline, std::vector<uint64_t>& ready);
+    void fallBackToEpoll(int error, std::vector<uint64_t>& ready);
+    
+    Backend backend = Backend::EPOLL;
+    bool backend_open = false;
+    Ring ring;
+    int epoll_fd = -1;
+    
+    // A poll id is never reused, so a late completion of a removed watch cannot be mistaken for
+    // its successor; 0 means the watch is not armed
+    struct Watch {
+        int fd;
+        uint64_t poll_id;
+    };
+    std::map<uint64_t, Watch> watches;
+    std::map<uint64_t, uint64_t> poll_tokens;
+    uint64_t next_poll_id = 1;
+    int ring_failures = 0;   // Consecutive waits that failed to enter or had a poll fail
+    
+    static constexpr unsigned RING_ENTRIES = 256;
+    static constexpr int MAX_EVENTS = 256;
+    static constexpr int RING_FAILURE_LIMIT = 3;
+};
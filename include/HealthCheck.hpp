@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+enum class HealthCheckType {
+    NONE,
+    EXEC,
+    TCP,
+    HTTP,
+    UNIX
+};
+
+struct HealthCheckConfig {
+    HealthCheckType type = HealthCheckType::NONE;
+    std::string command;            // exec: run through /bin/sh -c
+    std::string host = "127.0.0.1"; // tcp/http, an IPv4 or IPv6 literal
+    int port = 0;
+    std::string path = "/";         // http: request path, unix: socket path
+    int interval = 10;              // seconds between checks
+    int timeout = 2;                // seconds before a check counts as failed
+    int threshold = 3;              // consecutive failures before the instance is restarted
+    std::string text;
+    
+    bool enabled() const { return type != HealthCheckType::NONE; }
+    
+    bool operator==(const HealthCheckConfig& other) const {
+        return text == other.text && interval == other.interval &&
+               timeout == other.timeout && threshold == other.threshold;
+    }
+    bool operator!=(const HealthCheckConfig& other) const { return !(*this == other); }
+};
+
+class HealthCheck {
+public:
+    // Accepts exec:<command>, tcp:[host:]port, http:[host:]port[/path] or http://host:port/path, unix:/path.
+    // The host is an IPv4 address or a bracketed IPv6 one ([::1]); names other than localhost are refused
+    static bool parse(const std::string& value, HealthCheckConfig& check);
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sys/types.h>
+#include "HealthCheck.hpp"
+
+class Process;
+
+// Runs every configured probe from one thread: sockets and exec probes (through pidfds)
+// are multiplexed on a single epoll set and all deadlines live in one ordered timer set,
+// so the cost per probe is a file descriptor while it is in flight, not a thread.
+class HealthChecker {
+public:
+    HealthChecker();
+    ~HealthChecker();
+    
+    void start();
+    void stop();
+    
+    // Replaces the probe set; probes whose instance and check are unchanged keep their history
+    void setTargets(const std::map<std::string, std::shared_ptr<Process>>& processes);
+    
+    // Instances that reached their failure threshold since the last call
+    std::vector<std::string> takeUnhealthy();
+    std::string describe(const std::string& name);
+    // True when the instance has no check or its last result is a pass for this very pid
+    bool isPassing(const std::string& name, pid_t pid);
+    // Runs the next check now instead of after a full interval, unless one is in flight
+    void expedite(const std::string& name);
+    bool ownsChild(pid_t pid);
+
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    enum class Phase {
+        IDLE,
+        CONNECTING,
+        READING,
+        WAITING
+    };
+    
+    struct Probe {
+        std::string name;
+        std::weak_ptr<Process> process;
+        HealthCheckConfig config;
+        
+        Phase phase = Phase::IDLE;
+        int fd = -1;
+        pid_t child = -1;
+        pid_t target_pid = -1;
+        pid_t result_pid = -1;
+        std::string response;
+        Clock::time_point timer;
+        bool removed = false;
+        
+        int consecutive_failures = 0;
+        bool has_result = false;
+        bool last_ok = false;
+        std::string last_message;
+        Clock::time_point last_check;
+    };
+    
+    void loop();
+    void schedule(uint64_t id, Probe& probe, Clock::time_point when);
+    void fire(uint64_t id, Probe& probe, Clock::time_point now);
+    void launch(uint64_t id, Probe& probe, Clock::time_point now);
+    void launchSocket(uint64_t id, Probe& probe);
+    void launchExec(uint64_t id, Probe& probe);
+    void handleEvent(uint64_t id, Probe& probe, uint32_t events);
+    void finish(uint64_t id, Probe& probe, bool ok, const std::string& message);
+    void watch(uint64_t id, int fd, uint32_t events, bool add);
+    void release(Probe& probe);
+    void wake();
+    
+    std::mutex probes_mutex;
+    std::map<uint64_t, Probe> probes;
+    std::map<std::string, uint64_t> probe_ids;
+    std::set<std::pair<Clock::time_point, uint64_t>> timers;
+    std::vector<std::string> unhealthy;
+    uint64_t next_id = FIRST_PROBE_ID;
+    
+    std::mutex children_mutex;
+    std::set<pid_t> children;
+    
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    std::atomic<bool> running{false};
+    std::thread loop_thread;
+    
+    static constexpr uint64_t WAKE_ID = 0;
+    static constexpr uint64_t FIRST_PROBE_ID = 1;
+    static constexpr size_t MAX_RESPONSE = 4096;
+};
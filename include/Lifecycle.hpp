@@ -0,0 +1,107 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <queue>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <coroutine>
+#include <exception>
+#include <cstdint>
+
+class LifecycleExecutor;
+
+// A process lifecycle written as a coroutine. It does nothing until handed to a LifecycleExecutor,
+// which owns its frame from then on and resumes it on the executor's thread only.
+class LifecycleTask {
+public:
+    struct promise_type {
+        uint64_t id = 0;
+        std::exception_ptr exception;
+        
+        LifecycleTask get_return_object() {
+            return LifecycleTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+    
+    LifecycleTask(LifecycleTask&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    LifecycleTask(const LifecycleTask&) = delete;
+    LifecycleTask& operator=(const LifecycleTask&) = delete;
+    ~LifecycleTask();
+
+private:
+    explicit LifecycleTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    
+    std::coroutine_handle<promise_type> handle;
+    
+    friend class LifecycleExecutor;
+};
+
+// Single-threaded timer loop for lifecycle coroutines, at most one per instance name. The owner
+// sleeps until nextDue() and calls runDue(); the clock is injectable so a virtual one can drive it.
+class LifecycleExecutor {
+public:
+    using Clock = std::chrono::steady_clock;
+    
+    struct SleepAwaiter {
+        LifecycleExecutor& executor;
+        Clock::time_point due;
+        
+        bool await_ready() const { return executor.now() >= due; }
+        void await_suspend(std::coroutine_handle<LifecycleTask::promise_type> handle) {
+            executor.schedule(handle.promise().id, due);
+        }
+        void await_resume() const noexcept {}
+    };
+    
+    explicit LifecycleExecutor(std::function<Clock::time_point()> clock = Clock::now);
+    ~LifecycleExecutor();
+    
+    // Runs the task up to its first suspension; false if the instance already has a lifecycle
+    bool spawn(const std::string& name, LifecycleTask task);
+    bool has(const std::string& name) const { return by_name.count(name) > 0; }
+    size_t size() const { return tasks.size(); }
+    
+    std::optional<Clock::time_point> nextDue() const;
+    void runDue();
+    // Brings the instance's pending timer forward to now, for a lifecycle whose wait has been answered early
+    void wake(const std::string& name);
+    void cancelAll();
+    
+    Clock::time_point now() const { return clock(); }
+    SleepAwaiter sleepUntil(Clock::time_point due) { return {*this, due}; }
+    SleepAwaiter sleepFor(Clock::duration delay) { return {*this, now() + delay}; }
+
+private:
+    struct Timer {
+        Clock::time_point due;
+        uint64_t seq;
+        uint64_t id;
+        
+        bool operator>(const Timer& other) const {
+            return due != other.due ? due > other.due : seq > other.seq;
+        }
+    };
+    
+    struct Entry {
+        std::string name;
+        std::coroutine_handle<LifecycleTask::promise_type> handle;
+        uint64_t armed_seq = UINT64_MAX;   // The only timer still allowed to resume it
+    };
+    
+    void schedule(uint64_t id, Clock::time_point due);
+    void resume(uint64_t id);
+    
+    std::function<Clock::time_point()> clock;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+    std::map<uint64_t, Entry> tasks;
+    std::map<std::string, uint64_t> by_name;
+    uint64_t next_id = 1;
+    uint64_t next_seq = 0;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "SocketUtils.hpp"
+
+struct ProcessSample {
+    std::string name;
+    std::string program;
+    std::string state;
+    pid_t pid = -1;
+    int restarts = 0;
+    int last_exit_status = 0;
+    double uptime_seconds = 0;
+    size_t rss_bytes = 0;
+    double cpu_seconds = 0;
+    double cpu_percent = 0;
+    int file_descriptors = 0;
+    size_t fd_limit = 0;
+    int tree_processes = 0;
+    double ready_latency_seconds = -1;  // Fork to READY=1, negative when the instance never reported
+};
+
+using ProcessSampleSet = std::vector<ProcessSample>;
+
+// Serves the last published sample set in OpenMetrics text format over HTTP.
+// Scrapes never touch the process table; the sampler publishes immutable sets.
+class MetricsServer {
+public:
+    MetricsServer() = default;
+    ~MetricsServer();
+    
+    bool start(const SocketSpec& spec);
+    void stop();
+    
+    void publish(std::shared_ptr<const ProcessSampleSet> samples);
+    void render(std::string& buffer);
+
+private:
+    void serve();
+    void handleClient(int client_fd);
+    
+    SocketSpec spec;
+    int listen_fd = -1;
+    std::atomic<bool> running{false};
+    std::thread server_thread;
+    std::shared_ptr<const ProcessSampleSet> current;
+    std::string response_buffer;
+    size_t last_render_size = 4096;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <sys/types.h>
+
+// Receives sd_notify-style datagrams (READY=1, STATUS=..., WATCHDOG=1) from managed
+// processes on one supervisor-wide socket. The sender is identified by the kernel
+// through SCM_CREDENTIALS, so a child can only speak for itself.
+class NotifyListener {
+public:
+    using Handler = std::function<void(pid_t sender, const std::map<std::string, std::string>& fields)>;
+    
+    NotifyListener() = default;
+    ~NotifyListener();
+    
+    // An empty name binds a per-supervisor socket; a fixed one lets children outlive a supervisor restart.
+    // inherited_fd is a socket already bound by a previous image of the supervisor
+    bool start(Handler handler, const std::string& socket_name = "", int inherited_fd = -1);
+    void stop();
+    // Stops serving but leaves the socket open and bound, for a supervisor about to re-exec itself
+    int release();
+    
+    // Value for NOTIFY_SOCKET; abstract sockets are written with a leading '@'
+    const std::string& getPath() const { return path; }
+    
+    static std::map<std::string, std::string> parseMessage(const char* data, size_t length);
+
+private:
+    void serve();
+    
+    Handler handler;
+    std::string path;
+    int socket_fd = -1;
+    std::atomic<bool> running{false};
+    std::thread listener_thread;
+    
+    static constexpr size_t MAX_MESSAGE = 4096;
+};
@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 #include <chrono>
 #include <atomic>
 #include <unistd.h>
@@ -16,22 +17,18 @@
 #include <chrono>
 #include <errno.h>
 #include <algorithm>
-
-enum class ProcessState {
-    STOPPED,
-    STARTING,
-    RUNNING,
-    BACKOFF,
-    STOPPING,
-    EXITED,
-    FATAL,
-    UNKNOWN
-};
+#include <mutex>
+#include "CpuAffinity.hpp"
+#include "Watchdog.hpp"
+#include "HealthCheck.hpp"
+#include "SocketUtils.hpp"
+#include "StateMachine.hpp"
 
 enum class AutoStart {
     FALSE,
     TRUE,
-    UNEXPECTED
+    UNEXPECTED,
+    ON_DEMAND   // Started by the first connection to one of its listen= sockets
 };
 
 enum class AutoRestart {
@@ -40,6 +37,15 @@ enum class AutoRestart {
     UNEXPECTED
 };
 
+// What went wrong last, so a config that can never work is not retried like a crash
+enum class FailureKind {
+    NONE,
+    SPAWN,      // chdir, a log file or execve failed in the child, known before start() returns
+    STARTUP,    // exited or never became ready within starttime/ready_timeout
+    RUNTIME,    // died or failed its checks after a successful startup
+    STOP        // could not be stopped
+};
+
 struct ProcessConfig {
     std::string name;
     std::string command;
@@ -57,23 +63,56 @@ struct ProcessConfig {
     std::string workingdir = "/tmp";
     std::map<std::string, std::string> environment;
     int umask = 022;
+    int process_num = 0;
+    AffinityPolicy affinity;
+    std::vector<WatchdogRule> watchdog;
+    int watchdog_cooldown = 60;
+    HealthCheckConfig healthcheck;
+    bool notify_ready = false;
+    int ready_timeout = 60;
+    int notify_watchdog = 0;
+    std::vector<SocketSpec> listen;
+    int listen_backlog = 1024;
+    int idle_timeout = 0;
+    bool rolling_reload = false;
+    int max_unavailable = 1;
+    int max_surge = 0;
+    int warm_spares = 0;
+    bool spare_gate_program = false;  // Spares exec at once and wait on TASKMASTER_GATE_FD themselves
+    bool zygote = false;              // Instances are forked by a pre-initialised template, see ZygotePool
 };
 
+class ZygotePool;
+class StateJournal;
+
 class Process {
 public:
-    explicit Process(const ProcessConfig& config);
+    Process(const ProcessConfig& config, const std::string& name);
     ~Process();
     
     bool start();
     bool stop();
-    bool restart();
+    // stop() in two halves for callers that wait without blocking: the stop signal, which sets the
+    // stoptime deadline, then the cleanup, which force kills a child still alive at that point
+    bool beginStop(std::chrono::steady_clock::time_point& deadline);
+    bool finishStop();
+    static constexpr int STOP_POLL_MS = 100;
+    // Overlaps old and new instance when listen sockets allow it, unless allow_overlap is false
+    bool restart(bool allow_overlap = true);
     
     ProcessState getState() const { return state; }
     std::string getStateString() const;
+    static const char* stateName(ProcessState state);
+    const std::string& getName() const { return name; }
     pid_t getPid() const { return pid; }
+    pid_t getProcessGroup() const { return group_id; }
     const ProcessConfig& getConfig() const { return config; }
     
     bool isAlive();
+    // The leader or anything left in its process group; stops wait on this until the deadline
+    bool hasSurvivors();
+    // A child exists and has not been asked to stop: RUNNING, or STARTING while awaiting READY=1
+    bool isActive() const;
     
     std::chrono::seconds getUptime() const;
     
@@ -85,19 +124,127 @@ public:
     
     std::chrono::steady_clock::time_point getStartTime() const { return start_time; }
     
-    void setState(ProcessState state);
+    // Applies the change only if STATE_TRANSITIONS allows it from the current state for this event
+    bool setState(ProcessState state, StateEvent event);
+    std::chrono::steady_clock::time_point getStateSince() const {
+        return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(state_since.load()));
+    }
+    bool sendSignal(const std::string& signal) { return killProcess(signal); }
+    
+    // Keeps the last failure for status output; earlier ones are only in the log
+    void recordFailure(FailureKind kind, const std::string& detail);
+    FailureKind getLastFailure() const { return last_failure; }
+    std::string getLastError() const;
+    static const char* failureName(FailureKind kind);
+    
+    void markHealthCheckFailed() { health_check_failed = true; }
+    bool hasFailedHealthCheck() const { return health_check_failed; }
+    
+    // sd_notify messages; each returns false when the message does not apply in the current state
+    bool markReady(std::chrono::steady_clock::time_point when);
+    void touchKeepalive();
+    void setStatusText(const std::string& text);
+    std::string getStatusText() const;
+    bool isReady() const { return ready; }
+    double getReadyLatency() const { return ready_latency; }
+    std::chrono::steady_clock::time_point getSpawnTime() const { return spawn_time; }
+    bool isKeepaliveOverdue() const;
+    
+    static void setNotifySocket(const std::string& path) { notify_socket = path; }
+    static void setZygotePool(ZygotePool* pool) { zygote_pool = pool; }
+    static void setStateJournal(StateJournal* state_journal) { journal = state_journal; }
+    // Leaves the child running when this object goes away, for a supervisor exiting with its children
+    // journaled for the next one to re-adopt
+    void detachChild() { detached = true; }
+    
+    // Listening sockets owned by the supervisor, passed to every child as LISTEN_FDS from fd 3
+    void setListenFds(const std::vector<int>& fds) { listen_fds = fds; }
+    bool hasListenSockets() const { return !listen_fds.empty(); }
+    const std::vector<int>& getListenFds() const { return listen_fds; }
+    
+    // Forks a standby child of this program, set up but held on a gate pipe until promoted
+    pid_t spawnSpare(int& gate_fd);
+    // Takes over a promoted spare as this instance's child
+    void adoptSpare(pid_t child);
+    // Starts the program as a zygote template, serving fork requests on the returned control socket
+    pid_t spawnZygote(int& control_fd);
+    // Takes over a child left running by a previous supervisor; it is watched through its pidfd
+    // since it is usually not our child and cannot be waited for
+    void adoptOrphan(pid_t child, pid_t group, int pidfd, ProcessState recovered_state,
+                     std::chrono::steady_clock::time_point started, int restarts, int exit_status);
+    bool isAdopted() const { return adopted_pidfd != -1; }
+    int getAdoptedPidfd() const { return adopted_pidfd; }
+    uint64_t getConfigFingerprint() const { return config_fingerprint; }
+    // Hand-over to a re-executed supervisor (the upgrade command), as "key value" lines
+    void saveState(std::ostream& out) const;
+    void restoreState(const std::map<std::string, std::string>& fields);
+    
+    // Last connection seen on the listen sockets, for the on-demand idle stop
+    void touchActivity();
+    std::chrono::steady_clock::duration getIdleTime() const;
+    
+    // Held by callers around start/stop/restart so one instance never sees overlapping operations
+    std::mutex& getOperationMutex() { return operation_mutex; }
 
 private:
     ProcessConfig config;
+    std::string name;
     std::atomic<ProcessState> state;
+    std::atomic<int64_t> state_since;
+    std::shared_ptr<StateTimings::Program> timings;
     std::atomic<pid_t> pid;
     std::atomic<int> restart_count;
     std::atomic<int> last_exit_status;
+    std::atomic<pid_t> group_id;
+    std::atomic<bool> health_check_failed;
+    std::atomic<bool> ready;
+    std::atomic<double> ready_latency;
+    std::atomic<std::chrono::steady_clock::rep> last_keepalive;
+    std::atomic<std::chrono::steady_clock::rep> last_activity;
+    mutable std::mutex status_mutex;
+    std::string status_text;
+    std::atomic<FailureKind> last_failure;
+    std::string last_error;
+    std::atomic<bool> spawn_error_permanent;
+    std::chrono::time_point<std::chrono::steady_clock> spawn_time;
+    std::vector<int> listen_fds;
     std::chrono::time_point<std::chrono::steady_clock> start_time;
     std::chrono::time_point<std::chrono::steady_clock> last_restart;
+    std::mutex operation_mutex;
+    uint64_t config_fingerprint;
+    std::atomic<int> adopted_pidfd;
+    std::atomic<bool> detached{false};
     
     bool executeCommand();
-    void setupChildProcess();
+    bool spawnFromZygote(const AffinityPlacement& placement);
+    void setupChildProcess(const AffinityPlacement& placement, int status_fd = -1);
+    [[noreturn]] void execCommand(int status_fd = -1);
+    
+    // Child-to-parent report on the CLOEXEC status pipe; EOF instead means execve succeeded
+    enum class SpawnStage { CHDIR, STDOUT_LOG, STDERR_LOG, EXEC };
+    struct SpawnReport {
+        int stage;
+        int error;
+    };
+    [[noreturn]] static void failChild(int status_fd, SpawnStage stage, int error);
+    bool collectSpawnStatus(pid_t child, int status_fd);
+    std::string describeStage(SpawnStage stage) const;
+    static bool isPermanentSpawnError(int error);
+    static void passDescriptor(int fd, int target, const char* variable);
+    bool transition(ProcessState from, ProcessState to, StateEvent event);
+    void recordTransition(ProcessState from, ProcessState to);
+    bool overlappedRestart();
+    bool waitForStartup();
+    void retire(pid_t old_pid, pid_t old_group, int old_pidfd);
+    void journalChild();
+    void clearChild();
+    static int signalNumber(const std::string& signal);
     std::vector<std::string> parseCommand() const;
     bool killProcess(const std::string& signal = "TERM");
+    void killProcessGroup(int sig);
+    bool isGroupAlive();
+    
+    static std::string notify_socket;
+    static ZygotePool* zygote_pool;
+    static StateJournal* journal;
 };
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <sys/types.h>
+#include "Process.hpp"
+
+struct ProcessEvent {
+    uint64_t seq = 0;
+    uint64_t timestamp_ns = 0;
+    std::string name;
+    std::string program;
+    ProcessState from = ProcessState::UNKNOWN;
+    ProcessState to = ProcessState::UNKNOWN;
+    pid_t pid = -1;
+    int exit_status = 0;
+    uint64_t dropped = 0;  // Non-zero for overflow markers: events lost starting at seq
+    
+    bool isOverflow() const { return dropped > 0; }
+};
+
+// One consumer's filtered, bounded view of the event stream. When the queue is full new
+// events are dropped and counted; the count is delivered as a marker in their place.
+class EventSubscription {
+public:
+    EventSubscription(const std::string& pattern, std::vector<ProcessState> types, size_t capacity,
+                      std::function<void()> notify);
+    
+    bool matches(const ProcessEvent& event) const;
+    void push(const ProcessEvent& event);
+    size_t drain(std::vector<ProcessEvent>& out, size_t max);
+    
+    const std::string& getPattern() const { return pattern; }
+
+private:
+    std::string pattern;
+    std::vector<ProcessState> types;
+    size_t capacity;
+    std::function<void()> notify;
+    
+    std::mutex queue_mutex;
+    std::deque<ProcessEvent> queue;
+    ProcessEvent overflow;
+};
+
+// Fan-out of every Process::setState transition to the current subscribers
+class ProcessEvents {
+public:
+    static ProcessEvents& getInstance();
+    
+    std::shared_ptr<EventSubscription> subscribe(const std::string& pattern, std::vector<ProcessState> types,
+                                                 size_t capacity, std::function<void()> notify);
+    void unsubscribe(const std::shared_ptr<EventSubscription>& subscription);
+    
+    void publish(const std::string& name, const std::string& program, ProcessState from, ProcessState to,
+                 pid_t pid, int exit_status);
+    
+    static bool parseTypes(const std::string& value, std::vector<ProcessState>& types);
+    static std::string format(const ProcessEvent& event);
+
+private:
+    ProcessEvents() = default;
+    
+    std::mutex subscribers_mutex;
+    std::vector<std::shared_ptr<EventSubscription>> subscribers;
+    uint64_t next_seq = 1;
+};
@@ -4,18 +4,52 @@
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <map>
+#include <vector>
+#include <sys/types.h>
 
 struct ProcessMetrics {
+    pid_t pid = 0;
     size_t memory_usage_mb = 0;
     size_t memory_peak_mb = 0;
     int file_descriptors = 0;
+    int process_count = 0;
+    unsigned long long cpu_ticks = 0;
+    double cpu_percent = 0;
+    size_t fd_limit = 0;
     
     ProcessMetrics() = default;
 };
 
+struct ProcStatEntry {
+    pid_t pid = 0;
+    pid_t ppid = 0;
+    pid_t pgid = 0;
+    char state = '?';
+    unsigned long long cpu_ticks = 0;
+    size_t rss_bytes = 0;
+};
+
+// One pass over /proc, indexed by pid and by parent pid
+class ProcessTreeSnapshot {
+public:
+    static ProcessTreeSnapshot capture();
+    
+    const ProcStatEntry* find(pid_t pid) const;
+    std::vector<pid_t> subtree(pid_t root) const;
+    std::vector<pid_t> zombieChildrenOf(pid_t parent) const;
+    
+private:
+    std::map<pid_t, ProcStatEntry> entries;
+    std::map<pid_t, std::vector<pid_t>> children;
+    
+    static bool readStat(pid_t pid, ProcStatEntry& entry);
+};
+
 class MetricsCollector {
 public:
     ProcessMetrics collectMetrics(pid_t pid);
+    ProcessMetrics collectMetrics(pid_t pid, const ProcessTreeSnapshot& snapshot);
     std::string formatUptime(const std::chrono::steady_clock::time_point& start_time);
     std::string formatBytes(size_t bytes);
     
@@ -23,4 +57,5 @@ private:
     size_t readMemoryUsage(pid_t pid);
     size_t readMemoryPeak(pid_t pid);
     int countFileDescriptors(pid_t pid);
-};
\ No newline at end of file
+    size_t readFileDescriptorLimit(pid_t pid);
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include "Process.hpp"
+
+// Owns the listening sockets declared with listen= so they outlive any single child.
+// Instances of one program share a socket, except TCP sockets of numprocs > 1 groups:
+// those get one SO_REUSEPORT socket per instance and the kernel balances between them.
+class SocketRegistry {
+public:
+    SocketRegistry() = default;
+    ~SocketRegistry();
+    
+    // Points the instance at the sockets its config asks for, binding any that do not exist yet.
+    // Sockets it no longer uses are closed once no other instance holds them.
+    bool assign(const std::string& instance, const ProcessConfig& config, std::vector<int>& fds, std::string& error);
+    // Registers sockets recovered from a child of a previous supervisor, in config.listen order,
+    // so later instances share them instead of binding new ones; fds is rewritten to the registered ones
+    void adopt(const std::string& instance, const ProcessConfig& config, std::vector<int>& fds);
+    void release(const std::string& instance);
+    // Drops only sockets no other instance can accept from (per-instance SO_REUSEPORT sockets);
+    // returns the descriptors that were closed
+    std::vector<int> releaseExclusive(const std::string& instance);
+    void closeAll();
+
+private:
+    struct Entry {
+        SocketSpec spec;
+        int fd = -1;
+        bool exclusive = false;
+        std::set<std::string> users;
+    };
+    
+    static std::string keyFor(const ProcessConfig& config, const SocketSpec& spec, bool& exclusive);
+    std::vector<int> drop(const std::string& instance, const std::set<std::string>& keep, bool exclusive_only);
+    void closeEntry(Entry& entry);
+    
+    std::mutex sockets_mutex;
+    std::map<std::string, Entry> sockets;
+};
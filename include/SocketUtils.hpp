@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+
+enum class SocketFamily {
+    UNIX,
+    TCP
+};
+
+struct SocketSpec {
+    SocketFamily family = SocketFamily::UNIX;
+    std::string path;       // unix sockets
+    std::string host;       // tcp sockets
+    int port = 0;
+    
+    std::string toString() const;
+    bool operator==(const SocketSpec& other) const { return toString() == other.toString(); }
+    bool operator!=(const SocketSpec& other) const { return !(*this == other); }
+};
+
+class SocketUtils {
+public:
+    // Accepts "unix:/path", "/path", "tcp:host:port" and "host:port"
+    static bool parseSpec(const std::string& value, SocketSpec& spec);
+    // unix_mode, when not -1, is applied to a unix socket's file before it starts listening
+    static int createListener(const SocketSpec& spec, std::string& error, int backlog = 128,
+                              bool reuse_port = false, bool non_blocking = true, int unix_mode = -1);
+    static bool setNonBlocking(int fd);
+};
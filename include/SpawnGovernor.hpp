@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <set>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <utility>
+#include <cstdint>
+
+// Paces automatic restarts so that programs crashing together do not all respawn at once. A token
+// bucket allows spawn_rate restarts per second with bursts of spawn_burst; while the host reports
+// CPU, memory or IO pressure above the threshold (/proc/pressure, some avg10) the rate is scaled
+// down in proportion and bursts are not allowed. Waiting restarts are served lowest priority value
+// first, as at startup, then in arrival order; a head that has not asked again by its retry time,
+// because its shard is busy, lets the next waiter that asks have the token.
+class SpawnGovernor {
+public:
+    using Clock = std::chrono::steady_clock;
+    
+    // Holds a place in the queue until granted or destroyed, so a cancelled restart gives it up
+    class Ticket {
+    public:
+        Ticket(SpawnGovernor& governor, int priority);
+        ~Ticket();
+        Ticket(const Ticket&) = delete;
+        Ticket& operator=(const Ticket&) = delete;
+        
+        // False with retry_at set when this restart has to wait
+        bool acquire(Clock::time_point now, Clock::time_point& retry_at);
+    
+    private:
+        SpawnGovernor& governor;
+        uint64_t id;
+        bool waiting = true;
+    };
+    
+    // rate 0 disables the governor
+    void configure(double rate, int burst, double pressure_threshold);
+    // Called once a second by the metrics sampler
+    void samplePressure();
+    
+    double getPressure() const;
+    bool isEnabled() const;
+    
+    static bool readPressure(const std::string& path, double& avg10);
+
+private:
+    uint64_t enqueue(int priority, Clock::time_point now);
+    bool tryAcquire(uint64_t id, Clock::time_point now, Clock::time_point& retry_at);
+    void cancel(uint64_t id);
+    void refill(Clock::time_point now);
+    double effectiveRate() const;
+    
+    mutable std::mutex governor_mutex;
+    double rate = 0;
+    double burst = 1;
+    double threshold = 0;
+    double tokens = 0;
+    double pressure = 0;
+    Clock::time_point refilled = Clock::now();
+    
+    struct Waiter {
+        int priority;
+        Clock::time_point since;
+        Clock::time_point due;   // When it is expected to ask again
+        bool deferred;   // Refused at least once
+    };
+    std::set<std::pair<int, uint64_t>> queue;   // (priority, arrival)
+    std::map<uint64_t, Waiter> waiters;
+    uint64_t next_id = 1;
+    
+    static constexpr auto MIN_RETRY = std::chrono::milliseconds(10);
+    static constexpr auto HEAD_GRACE = std::chrono::milliseconds(100);
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <set>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include "StateMachine.hpp"
+
+class Process;
+
+// Instances of the process table grouped by state, kept current by every transition so that
+// counting them costs nothing and listing one state costs only the size of the answer.
+// Processes not installed in the table (a replacement being prepared, one already removed)
+// are not members and are ignored.
+class StateIndex {
+public:
+    struct Totals {
+        size_t instances = 0;
+        size_t by_state[StateTimings::STATES] = {};
+        uint64_t restarts = 0;
+        std::chrono::seconds running_uptime{0};  // Summed over RUNNING instances
+    };
+    
+    // Never destroyed: the process table is torn down by the global TaskMaster after function statics are gone
+    static StateIndex& getInstance() {
+        static StateIndex* instance = new StateIndex();
+        return *instance;
+    }
+    
+    // Replaces any other process registered under the same name
+    void attach(const std::string& name, const Process* process);
+    void detach(const std::string& name, const Process* process);
+    // Re-reads the state from the process rather than trusting the transition that triggered the
+    // call, so updates from racing transitions cannot leave a stale entry behind
+    void refresh(const Process& process);
+    
+    Totals totals() const;
+    std::vector<std::string> members(ProcessState state) const;
+
+private:
+    StateIndex() = default;
+    
+    struct Member {
+        const Process* process;
+        ProcessState state;
+        int restarts;
+        int64_t started;  // steady_clock seconds, only counted while RUNNING
+    };
+    
+    void place(const std::string& name, Member& member, const Process& process);
+    void remove(const std::string& name, const Member& member);
+    
+    mutable std::mutex index_mutex;
+    std::map<std::string, Member> by_name;
+    std::set<std::string> by_state[StateTimings::STATES];
+    uint64_t restart_total = 0;
+    int64_t running_started_total = 0;
+};
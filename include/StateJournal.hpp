@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <cstdint>
+#include <chrono>
+#include <sys/types.h>
+#include "Process.hpp"
+
+// Append-only log of which child each instance has, kept in a shared file mapping so every
+// record survives a supervisor crash without a write() or fsync() on the spawn path.
+// A restarted supervisor replays it to find the children that outlived the previous one.
+class StateJournal {
+public:
+    struct Entry {
+        std::string name;
+        pid_t pid = -1;
+        pid_t group = -1;
+        ProcessState state = ProcessState::STOPPED;
+        uint64_t start_ticks = 0;   // /proc/<pid>/stat starttime, tells the child from a recycled pid
+        uint64_t fingerprint = 0;
+        int restart_count = 0;
+        int last_exit_status = 0;
+    };
+    
+    StateJournal() = default;
+    ~StateJournal();
+    
+    // Maps the journal, replays it and compacts it down to the instances that still had a child
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return map != nullptr; }
+    
+    // Instances that had a child when the previous supervisor went away, as found by open()
+    const std::map<std::string, Entry>& getRecovered() const { return recovered; }
+    
+    void record(const Entry& entry);
+    
+    static uint64_t fingerprint(const ProcessConfig& config);
+    static uint64_t processStartTicks(pid_t pid);
+    // Where a process started in /proc ticks sits on the steady clock, so adopted uptimes carry on
+    static std::chrono::steady_clock::time_point startTimeOf(uint64_t start_ticks);
+    static uint64_t hash(const std::string& text);
+
+private:
+    struct Header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t record_size;
+        uint64_t capacity;
+    };
+    
+    struct Record {
+        uint32_t committed;   // Written last; a record torn by a crash is never marked
+        int32_t pid;
+        int32_t group;
+        int32_t state;
+        uint64_t seq;
+        uint64_t start_ticks;
+        uint64_t fingerprint;
+        int32_t restart_count;
+        int32_t last_exit_status;
+        char name[80];
+    };
+    
+    bool compact();
+    void append(const Entry& entry);
+    
+    std::mutex journal_mutex;
+    std::string path;
+    void* map = nullptr;
+    size_t map_size = 0;
+    uint64_t capacity = 0;
+    uint64_t next_index = 0;
+    uint64_t next_seq = 1;
+    std::map<std::string, Entry> latest;
+    std::map<std::string, Entry> recovered;
+    
+    static constexpr uint64_t MAGIC = 0x314e524a4d4b5354ULL;  // "TSKMJRN1"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t COMMITTED = 0x434f4d54;
+    static constexpr uint64_t CAPACITY = 8192;   // Records, or twice the live instances if that is more
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+enum class ProcessState {
+    STOPPED,
+    STARTING,
+    RUNNING,
+    BACKOFF,
+    STOPPING,
+    EXITED,
+    FATAL,
+    UNKNOWN
+};
+
+// Why a state change is requested; the same pair of states can be legal for one reason and not another
+enum class StateEvent {
+    START,            // start() or a promoted spare
+    SPAWNED,          // Child running, no readiness notification configured
+    SPAWN_FAILED,
+    READY,            // READY=1
+    RESTART,          // Overlapped restart: the replacement is starting next to the old child
+    ROLLBACK,         // Overlapped restart failed, the old child carries on
+    STOP,
+    STOPPED,
+    STOP_FAILED,
+    EXITED,           // Child reaped by the monitor
+    STARTUP_FAILED,
+    CHECK_FAILED,     // Stopped for a failed health check or a missed WATCHDOG=1, to be restarted
+    GIVE_UP,          // Out of startretries
+    SETTLE,           // Exited for good under its autorestart policy
+    ADOPT,            // Child re-adopted from the state journal
+    RESTORE           // State handed over by a live upgrade
+};
+
+struct StateTransition {
+    ProcessState from;
+    ProcessState to;
+    StateEvent event;
+};
+
+inline constexpr StateTransition STATE_TRANSITIONS[] = {
+    {ProcessState::STOPPED,  ProcessState::STARTING, StateEvent::START},
+    {ProcessState::EXITED,   ProcessState::STARTING, StateEvent::START},
+    {ProcessState::BACKOFF,  ProcessState::STARTING, StateEvent::START},
+    {ProcessState::FATAL,    ProcessState::STARTING, StateEvent::START},
+    {ProcessState::STARTING, ProcessState::RUNNING,  StateEvent::SPAWNED},
+    {ProcessState::STARTING, ProcessState::BACKOFF,  StateEvent::SPAWN_FAILED},
+    {ProcessState::STARTING, ProcessState::FATAL,    StateEvent::SPAWN_FAILED},
+    {ProcessState::STARTING, ProcessState::RUNNING,  StateEvent::READY},
+    {ProcessState::RUNNING,  ProcessState::STARTING, StateEvent::RESTART},
+    {ProcessState::STARTING, ProcessState::RUNNING,  StateEvent::ROLLBACK},
+    {ProcessState::RUNNING,  ProcessState::STOPPING, StateEvent::STOP},
+    {ProcessState::STARTING, ProcessState::STOPPING, StateEvent::STOP},
+    {ProcessState::STOPPING, ProcessState::STOPPED,  StateEvent::STOPPED},
+    {ProcessState::STOPPING, ProcessState::FATAL,    StateEvent::STOP_FAILED},
+    {ProcessState::RUNNING,  ProcessState::EXITED,   StateEvent::EXITED},
+    {ProcessState::STARTING, ProcessState::EXITED,   StateEvent::EXITED},
+    {ProcessState::EXITED,   ProcessState::BACKOFF,  StateEvent::STARTUP_FAILED},
+    {ProcessState::STOPPED,  ProcessState::BACKOFF,  StateEvent::STARTUP_FAILED},
+    {ProcessState::STOPPED,  ProcessState::EXITED,   StateEvent::CHECK_FAILED},
+    {ProcessState::EXITED,   ProcessState::FATAL,    StateEvent::GIVE_UP},
+    {ProcessState::BACKOFF,  ProcessState::FATAL,    StateEvent::GIVE_UP},
+    {ProcessState::EXITED,   ProcessState::STOPPED,  StateEvent::SETTLE},
+    {ProcessState::BACKOFF,  ProcessState::STOPPED,  StateEvent::SETTLE},
+    {ProcessState::STOPPED,  ProcessState::STARTING, StateEvent::ADOPT},
+    {ProcessState::STOPPED,  ProcessState::RUNNING,  StateEvent::ADOPT},
+    {ProcessState::STOPPED,  ProcessState::STARTING, StateEvent::RESTORE},
+    {ProcessState::STOPPED,  ProcessState::RUNNING,  StateEvent::RESTORE},
+    {ProcessState::STOPPED,  ProcessState::BACKOFF,  StateEvent::RESTORE},
+    {ProcessState::STOPPED,  ProcessState::STOPPING, StateEvent::RESTORE},
+    {ProcessState::STOPPED,  ProcessState::EXITED,   StateEvent::RESTORE},
+    {ProcessState::STOPPED,  ProcessState::FATAL,    StateEvent::RESTORE},
+};
+
+constexpr bool isAllowedTransition(ProcessState from, ProcessState to, StateEvent event) {
+    for (const auto& transition : STATE_TRANSITIONS) {
+        if (transition.from == from && transition.to == to && transition.event == event) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// A child reaped while a stop is in progress belongs to that stop, not to the crash handling
+static_assert(!isAllowedTransition(ProcessState::STOPPING, ProcessState::EXITED, StateEvent::EXITED));
+static_assert(!isAllowedTransition(ProcessState::STOPPING, ProcessState::STARTING, StateEvent::START));
+static_assert(!isAllowedTransition(ProcessState::STOPPING, ProcessState::RUNNING, StateEvent::READY));
+
+const char* stateEventName(StateEvent event);
+
+// Time spent in each state before each transition out of it, per program. Instances of a program
+// share one set of buckets, updated with relaxed atomics by whichever thread changes the state.
+class StateTimings {
+public:
+    static constexpr size_t STATES = static_cast<size_t>(ProcessState::UNKNOWN) + 1;
+    static constexpr uint64_t BUCKET_BOUNDS_NS[] = {
+        1000000ULL, 5000000ULL, 10000000ULL, 50000000ULL, 100000000ULL, 500000000ULL,
+        1000000000ULL, 5000000000ULL, 10000000000ULL, 30000000000ULL, 60000000000ULL, 300000000000ULL
+    };
+    static constexpr size_t BUCKETS = sizeof(BUCKET_BOUNDS_NS) / sizeof(BUCKET_BOUNDS_NS[0]);
+    
+    struct Histogram {
+        std::atomic<uint64_t> buckets[BUCKETS + 1] = {};   // Not cumulative; the last one is +Inf
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum_ns{0};
+    };
+    
+    struct Program {
+        Histogram transitions[STATES][STATES];
+        
+        void record(ProcessState from, ProcessState to, uint64_t elapsed_ns);
+    };
+    
+    static StateTimings& getInstance() {
+        static StateTimings instance;
+        return instance;
+    }
+    
+    std::shared_ptr<Program> forProgram(const std::string& program);
+    std::vector<std::pair<std::string, std::shared_ptr<Program>>> programs() const;
+
+private:
+    StateTimings() = default;
+    
+    mutable std::mutex timings_mutex;
+    std::map<std::string, std::shared_ptr<Program>> by_program;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Process-wide counters, updated with relaxed atomics from any thread
+struct SupervisorCounters {
+    std::atomic<uint64_t> spawns{0};
+    std::atomic<uint64_t> spawn_failures{0};
+    std::atomic<uint64_t> exec_failures{0};
+    std::atomic<uint64_t> startup_failures{0};
+    std::atomic<uint64_t> stop_failures{0};
+    std::atomic<uint64_t> exits{0};
+    std::atomic<uint64_t> auto_restarts{0};
+    std::atomic<uint64_t> spawns_deferred{0};       // Automatic restarts held back by the spawn governor
+    std::atomic<uint64_t> spawn_deferred_ns{0};     // Their total wait
+    std::atomic<uint64_t> spawns_waiting{0};
+    std::atomic<uint64_t> pressure_permille{0};     // Highest of cpu/memory/io some avg10, last sampled
+    std::atomic<uint64_t> watchdog_actions{0};
+    std::atomic<uint64_t> ready_notifications{0};
+    std::atomic<uint64_t> ready_timeouts{0};
+    std::atomic<uint64_t> keepalive_timeouts{0};
+    std::atomic<uint64_t> activations{0};
+    std::atomic<uint64_t> idle_stops{0};
+    std::atomic<uint64_t> spare_promotions{0};
+    std::atomic<uint64_t> readopted{0};
+    std::atomic<uint64_t> rejected_transitions{0};
+    std::atomic<uint64_t> monitor_cycles{0};
+    std::atomic<uint64_t> samples{0};
+    std::atomic<uint64_t> last_sample_ns{0};
+    std::atomic<uint64_t> scrapes{0};
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    
+    static SupervisorCounters& getInstance() {
+        static SupervisorCounters instance;
+        return instance;
+    }
+    
+    static void increment(std::atomic<uint64_t>& counter, uint64_t value = 1) {
+        counter.fetch_add(value, std::memory_order_relaxed);
+    }
+
+private:
+    SupervisorCounters() = default;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <set>
+#include <vector>
+#include <memory>
+#include <functional>
+#include "Process.hpp"
+
+// Resolves the targets of start/stop/restart to instance names: an instance, a program (all of its
+// instances), a glob such as web_*, group:<name> for a [group:] section, or all. Instance names are
+// kept sorted, so a glob only visits the names sharing its literal prefix.
+class TargetIndex {
+public:
+    using GroupMap = std::map<std::string, std::vector<std::string>>;
+    
+    void rebuild(const std::map<std::string, std::shared_ptr<Process>>& processes, const GroupMap& group_configs);
+    
+    // The instances named by the targets, each once, in the order the targets name them; false with
+    // error set on the first target that names nothing
+    bool resolve(const std::vector<std::string>& targets, std::vector<std::string>& names, std::string& error) const;
+    
+    static bool isPattern(const std::string& target);
+
+private:
+    using Collector = std::function<void(const std::string&)>;
+    bool resolveOne(const std::string& target, const Collector& add, std::string& error) const;
+    void addProgram(const std::string& program, const Collector& add) const;
+    
+    std::set<std::string> instances;
+    std::map<std::string, std::vector<std::string>> by_program;
+    GroupMap groups;
+};
@@ -9,9 +9,28 @@
 #include <atomic>
 #include <vector>
 #include <fstream>
+#include <optional>
+#include <deque>
+#include <set>
 #include "Process.hpp"
 #include "ConfigParser.hpp"
 #include "ProcessMetrics.hpp"
+#include "Watchdog.hpp"
+#include "MetricsServer.hpp"
+#include "SupervisorCounters.hpp"
+#include "ControlServer.hpp"
+#include "HealthChecker.hpp"
+#include "NotifyListener.hpp"
+#include "SocketRegistry.hpp"
+#include "ActivationWatcher.hpp"
+#include "ZygotePool.hpp"
+#include "StateJournal.hpp"
+#include "Lifecycle.hpp"
+#include "EventReactor.hpp"
+#include "StateIndex.hpp"
+#include "TargetIndex.hpp"
+#include "WorkerPool.hpp"
+#include "SpawnGovernor.hpp"
 #include <iostream>
 #include <iomanip>
 #include "Logger.hpp"
@@ -21,62 +40,214 @@ public:
     explicit TaskMaster(const std::string& config_file);
     ~TaskMaster();
     
-    void run();
+    void run(bool interactive = true);
     void shutdown();
+    void requestShutdown();
+    // Async-signal-safe: only sets flags, which the run loop polls
+    void requestShutdownFromSignal(int signum);
+    // Re-executes binary in place, handing the process table over; children keep running untouched
+    void requestUpgrade(const std::string& binary);
     
     bool startProgram(const std::string& name);
     bool stopProgram(const std::string& name);
     bool restartProgram(const std::string& name);
+    bool rollingRestart(const std::string& program, std::ostream& out);
     std::string getStatus(const std::string& name = "");
     
     bool reloadConfig();
     
-    const std::map<std::string, std::unique_ptr<Process>>& getProcesses() const { return processes; }
+    const std::map<std::string, std::shared_ptr<Process>>& getProcesses() const { return processes; }
 
 private:
+    struct WarmSpare {
+        pid_t pid;
+        int gate_fd;
+        ProcessConfig config;
+    };
+    
+    struct RolloutItem {
+        std::string name;
+        std::optional<ProcessConfig> config;  // Set by reloads: the instance is replaced with this config
+    };
+    
+    struct ShardMessage {
+        enum class Kind { UNHEALTHY, WATCHDOG_RESTART };
+        Kind kind;
+        std::string name;
+    };
+    
+    // The instances whose name hashes to one index, supervised by their own thread. Only that thread
+    // touches members and lifecycles; everyone else reaches it through the inbox
+    struct MonitorShard {
+        ~MonitorShard();
+        
+        size_t index = 0;
+        std::thread thread;
+        std::mutex inbox_mutex;
+        std::condition_variable inbox_cv;
+        std::deque<ShardMessage> inbox;
+        uint64_t generation = UINT64_MAX;
+        std::map<std::string, std::shared_ptr<Process>> members;
+        // Restarts and stops in progress, each holding its instance's operation mutex while it waits
+        LifecycleExecutor lifecycles;
+        // A pidfd per child, so an exit is handled when it happens rather than at the next cycle
+        EventReactor reactor;
+        int wake_fd = -1;
+        struct ExitWatch {
+            pid_t pid;
+            int pidfd;
+            uint64_t token;
+        };
+        std::map<std::string, ExitWatch> exit_watches;
+        std::map<uint64_t, std::string> exit_tokens;
+        uint64_t next_token = WAKE_TOKEN + 1;
+    };
+    
+    // What a stopLifecycle leaves behind: EXITED after a failed health check or a missed WATCHDOG=1,
+    // BACKOFF after a missed ready_timeout, STOPPED when idle, or a fresh child
+    enum class AfterStop { EXIT, UNRESPONSIVE, STARTUP_FAILED, IDLE, RESTART };
+    
     void monitorProcesses();
-    void checkProcessHealth();
-    void restartFailedProcesses();
-    bool shouldRestartProcess(const std::string& name, const std::unique_ptr<Process>& process);
-    void handleProcessNotRestarting(const std::string& name, const std::unique_ptr<Process>& process);
-    void attemptProcessRestart(const std::string& name, const std::unique_ptr<Process>& process);
+    void monitorShard(MonitorShard& shard);
+    void refreshShard(MonitorShard& shard);
+    void handleShardMessage(MonitorShard& shard, const ShardMessage& message);
+    void routeToShard(ShardMessage::Kind kind, const std::string& name);
+    size_t shardOf(const std::string& name) const;
+    void stopShards();
+    void checkProcessHealth(MonitorShard& shard);
+    void checkInstance(MonitorShard& shard, const std::string& name, const std::shared_ptr<Process>& process);
+    void restartFailedProcesses(MonitorShard& shard);
+    void restartIfFailed(MonitorShard& shard, const std::string& name, const std::shared_ptr<Process>& process);
+    void watchExits(MonitorShard& shard);
+    void dropExitWatch(MonitorShard& shard, std::map<std::string, MonitorShard::ExitWatch>::iterator it);
+    void handleExitEvent(MonitorShard& shard, uint64_t token);
+    LifecycleTask restartLifecycle(std::string name, std::shared_ptr<Process> process, MonitorShard& shard);
+    LifecycleTask stopLifecycle(std::string name, std::shared_ptr<Process> process, MonitorShard& shard,
+                                AfterStop after);
+    void handleFailedHealthChecks();
+    void checkStartingProcess(MonitorShard& shard, const std::string& name, const std::shared_ptr<Process>& process,
+                              std::unique_lock<std::mutex>& operation);
+    void handleNotify(pid_t sender, const std::map<std::string, std::string>& fields);
+    bool shouldRestartProcess(const std::string& name, const std::shared_ptr<Process>& process);
+    void handleProcessNotRestarting(const std::string& name, const std::shared_ptr<Process>& process);
+    void attemptProcessRestart(const std::string& name, const std::shared_ptr<Process>& process, MonitorShard& shard);
+    void reapOrphans();
+    void sampleMetrics();
+    void startNotifyListener(int inherited_fd);
+    void startServices();
+    void startMonitoring();
+    void handleWatchdogEvent(const WatchdogEvent& event);
     void startAutostartProcesses();
+    void readoptChildren();
+    bool recoverListenSockets(int pidfd, size_t count, std::vector<int>& fds);
+    void restartStaleChildren();
+    // Returns only when the upgrade was abandoned, with supervision resumed
+    void performUpgrade();
+    void resumeSupervision(int notify_fd);
+    void restoreHandoff(int fd);
+    void applyHandoff(const std::string& name, const std::map<std::string, std::string>& fields,
+                      const std::vector<std::pair<int, std::string>>& sockets, std::set<int>& kept);
+    static std::vector<std::string> currentArguments();
+    void attachSockets(const std::string& name, const std::shared_ptr<Process>& process);
+    void updateActivationTargets();
+    void handleActivation(const std::vector<std::string>& names);
+    void stopIdleProcesses(MonitorShard& shard);
+    void maintainWarmSpares();
+    void maintainZygotes();
+    bool promoteSpare(const std::string& name, const std::shared_ptr<Process>& process);
+    void retireSpare(const WarmSpare& spare);
+    bool isSpare(pid_t pid) const;
+    bool spareMatches(const WarmSpare& spare, const ProcessConfig& config);
+    bool runRollout(const std::string& program, const std::vector<RolloutItem>& items, std::ostream& out);
+    bool replaceInstance(const RolloutItem& item, bool overlap);
+    bool waitUntilServing(const std::string& name, const std::shared_ptr<Process>& process);
+    std::shared_ptr<Process> findProcess(const std::string& name);
+    ControlProtocol::ItemResult executeBatchItem(ControlProtocol::Opcode op, const std::string& name);
     void processCommands();
     std::string trimString(const std::string& str);
-    bool executeCommand(const std::string& command);
-    bool handleStatusCommand(std::istringstream& iss);
-    bool handleStartCommand(std::istringstream& iss);
-    bool handleStopCommand(std::istringstream& iss);
-    bool handleRestartCommand(std::istringstream& iss);
-    bool handleReloadCommand();
-    bool handleStatsCommand();
-    bool handleLogsCommand(std::istringstream& iss);
-    bool handleHelpCommand();
-    bool handleClearCommand();
+    bool executeCommand(const std::string& command, std::ostream& out);
+    bool handleStatusCommand(std::istringstream& iss, std::ostream& out);
+    bool handleStartCommand(std::istringstream& iss, std::ostream& out);
+    bool handleStopCommand(std::istringstream& iss, std::ostream& out);
+    bool handleRestartCommand(std::istringstream& iss, std::ostream& out);
+    bool handleReloadCommand(std::ostream& out);
+    bool handleUpgradeCommand(std::istringstream& iss, std::ostream& out);
+    bool handleStatsCommand(std::ostream& out);
+    bool handleLogsCommand(std::istringstream& iss, std::ostream& out);
+    bool handleHelpCommand(std::ostream& out);
+    bool handleClearCommand(std::ostream& out);
+    std::vector<std::string> readTargets(std::istringstream& iss);
+    bool resolveTargets(const std::vector<std::string>& targets, std::vector<std::string>& names, std::string& error);
+    void runOnTargets(ControlProtocol::Opcode op, const std::vector<std::string>& targets, std::ostream& out);
+    WorkerPool& bulkPool();
     
-    void printDetailedStatus(const std::string& filter = "");
-    void printProcessDetails(const std::string& name, const std::unique_ptr<Process>& process);
-    void printProcessStats();
-    void showProcessLogs(const std::string& process_name, int lines = 10);
-    void showLogFile(const std::string& log_file, int lines);
+    void printDetailedStatus(const std::string& filter, std::ostream& out);
+    void printStatusByState(const std::vector<ProcessState>& states, bool detailed, std::ostream& out);
+    void printProcessDetails(const std::string& name, const std::shared_ptr<Process>& process,
+                             const ProcessTreeSnapshot& snapshot, std::ostream& out);
+    void printProcessStats(std::ostream& out);
+    void showProcessLogs(const std::string& process_name, int lines, std::ostream& out);
+    void showLogFile(const std::string& log_file, int lines, std::ostream& out);
     std::string getStatusColor(ProcessState status);
+    std::string describeFailure(const std::shared_ptr<Process>& process);
     
     void removeObsoleteProcesses(const std::map<std::string, ProcessConfig>& new_configs);
     void updateProcessConfigurations(const std::map<std::string, ProcessConfig>& new_configs);
     void addNewProcess(const std::string& instance_name, const ProcessConfig& config);
     void updateExistingProcess(const std::string& instance_name, const ProcessConfig& new_config, 
-                              std::unique_ptr<Process>& process);
+                              std::shared_ptr<Process>& process);
     bool hasConfigurationChanged(const ProcessConfig& old_config, const ProcessConfig& new_config);
     std::string createInstanceName(const std::string& base_name, int numprocs, int instance_index);
     std::string extractBaseName(const std::string& instance_name);
     std::string config_file;
     ConfigParser config_parser;
-    std::map<std::string, std::unique_ptr<Process>> processes;
+    std::map<std::string, std::shared_ptr<Process>> processes;
     
     std::atomic<bool> running;
     std::thread monitor_thread;
     std::mutex processes_mutex;
     std::condition_variable cv;
+    std::atomic<uint64_t> processes_generation{0};   // Bumped whenever instances are added, replaced or removed
+    SpawnGovernor spawn_governor;                    // Paces the automatic restarts of every shard; outlives their lifecycles
+    std::vector<std::unique_ptr<MonitorShard>> shards;
+    TargetIndex target_index;                        // Rebuilt when processes_generation moves on
+    uint64_t targets_generation = UINT64_MAX;
+    size_t bulk_workers = 64;
+    std::mutex bulk_mutex;
+    std::unique_ptr<WorkerPool> bulk_pool;           // Started by the first command naming several instances
+    
+    std::thread sampler_thread;
+    std::mutex metrics_mutex;
+    std::condition_variable sampler_cv;
+    std::map<std::string, ProcessMetrics> sampled_metrics;
+    Watchdog watchdog;
+    std::map<std::string, std::vector<RolloutItem>> pending_rollouts;
+    std::map<std::string, std::deque<WarmSpare>> warm_spares;
+    mutable std::mutex spares_mutex;
+    MetricsServer metrics_server;
+    std::unique_ptr<ControlServer> control_server;
+    HealthChecker health_checker;
+    NotifyListener notify_listener;
+    SocketRegistry socket_registry;
+    ActivationWatcher activation_watcher;
+    ZygotePool zygote_pool;
+    StateJournal journal;
+    std::vector<std::string> stale_children;   // Re-adopted but started from a different config
+    std::atomic<bool> shutdown_requested;
+    std::atomic<bool> upgrade_requested;
+    std::atomic<int> shutdown_signal{0};
+    std::atomic<bool> detach_requested{false};   // The detach command: exit without stopping anything
+    std::string upgrade_binary;
+    std::string binary_path;        // This image, as found at startup; the default upgrade target
+    bool resumed = false;           // Took over from a previous image through the upgrade command
+    int inherited_notify_fd = -1;
+    std::mutex run_mutex;
+    std::condition_variable run_cv;
     
     static constexpr int MONITOR_INTERVAL_MS = 1000;
+    static constexpr int RESTART_DELAY_MS = 1000;
+    static constexpr int SAMPLE_INTERVAL_MS = 1000;
+    static constexpr int ROLLOUT_POLL_MS = 100;
+    static constexpr int SIGNAL_POLL_MS = 200;
+    static constexpr uint64_t WAKE_TOKEN = 0;
 };
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <chrono>
+#include "ProcessMetrics.hpp"
+
+enum class WatchdogMetric {
+    RSS,
+    CPU,
+    FDS
+};
+
+enum class WatchdogAction {
+    WARN,
+    RESTART,
+    SIGNAL
+};
+
+struct WatchdogRule {
+    WatchdogMetric metric = WatchdogMetric::RSS;
+    double threshold = 0;           // bytes for rss, percent for cpu, count (or percent of limit) for fds
+    bool percent_of_limit = false;
+    int duration = 0;               // seconds the breach must last before acting
+    WatchdogAction action = WatchdogAction::WARN;
+    std::string signal;
+    std::string text;
+    
+    bool operator==(const WatchdogRule& other) const { return text == other.text; }
+    bool operator!=(const WatchdogRule& other) const { return !(*this == other); }
+};
+
+struct WatchdogEvent {
+    std::string instance_name;
+    WatchdogRule rule;
+    std::string reason;
+};
+
+class Watchdog {
+public:
+    static std::vector<WatchdogRule> parseRules(const std::string& value);
+    
+    // Called by the metrics sampler once per sample for every running instance. A breach only
+    // counts towards a rule's duration while the same pid keeps breaching it
+    std::vector<WatchdogEvent> evaluate(const std::string& instance_name, const ProcessMetrics& metrics,
+                                        const std::vector<WatchdogRule>& rules, int cooldown);
+    // Called after each sample with the instances it evaluated: breaches of any other instance are
+    // dropped, and its entry with them once its cooldown has run out
+    void retain(const std::set<std::string>& running);
+
+private:
+    struct InstanceState {
+        pid_t pid = 0;
+        std::map<size_t, std::chrono::steady_clock::time_point> breach_since;
+        std::chrono::steady_clock::time_point last_action;
+        int cooldown = 0;
+        bool acted = false;
+    };
+    
+    std::map<std::string, InstanceState> states;
+    
+    static WatchdogRule parseRule(const std::string& text);
+    static double parseSize(const std::string& value);
+    static int parseDuration(const std::string& value);
+    static bool isBreached(const WatchdogRule& rule, const ProcessMetrics& metrics, double& observed);
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+// Fixed set of threads draining a FIFO of jobs; concurrency is bounded by the thread count
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t threads);
+    ~WorkerPool();
+    
+    // False once the pool is shutting down; the job is not run
+    bool submit(std::function<void()> job);
+    void shutdown();
+    size_t size() const { return workers.size(); }
+
+private:
+    void workerLoop();
+    
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex jobs_mutex;
+    std::condition_variable jobs_cv;
+    bool stopping = false;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <sys/types.h>
+#include "Process.hpp"
+
+// One pre-initialised template process per spawn_mode=zygote program. The template execs the
+// program once, does its expensive setup, then forks every instance on request over a control
+// socket, so instances start from its warm copy-on-write memory. Each instance double-forks and
+// is reparented to the supervisor (a child subreaper), which then tracks it like any other child.
+class ZygotePool {
+public:
+    ZygotePool() = default;
+    ~ZygotePool();
+    
+    // Forks a new instance of the process's program from its template, starting the template first
+    // if needed. The instance is a child of the supervisor, held on its gate until release() is called
+    pid_t spawn(Process& process, int& gate_fd, std::string& error);
+    // Lets a spawned instance run; done once its pid is recorded so an early READY=1 finds it
+    static void release(int gate_fd);
+    
+    // Reaps templates that died and stops those of programs no longer in zygote mode
+    void retireStale(const std::set<std::string>& programs);
+    bool owns(pid_t pid) const;
+    size_t count() const;
+    void closeAll();
+
+private:
+    struct Template {
+        std::mutex mutex;
+        std::atomic<pid_t> pid{-1};
+        int control_fd = -1;
+        ProcessConfig config;
+    };
+    
+    pid_t request(Template& entry, const Process& process, int& gate_fd, std::string& error);
+    pid_t awaitReply(Template& entry, std::chrono::steady_clock::time_point deadline, std::string& error);
+    bool adopt(pid_t child, std::chrono::steady_clock::time_point deadline, std::string& error);
+    void stopTemplate(Template& entry);
+    static bool sameTemplate(const ProcessConfig& a, const ProcessConfig& b);
+    
+    mutable std::mutex pool_mutex;
+    std::map<std::string, std::shared_ptr<Template>> templates;
+    
+    static constexpr size_t MAX_REPLY = 512;
+    static constexpr int ADOPT_POLL_MS = 2;
+    static constexpr int ADOPT_TIMEOUT_MS = 2000;
+};
@@ -0,0 +1,87 @@
+#include "../include/ActivationWatcher.hpp"
+#include "../include/Logger.hpp"
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+ActivationWatcher::~ActivationWatcher() {
+    stop();
+}
+
+bool ActivationWatcher::start(Handler activation_handler) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) {
+        Logger::getInstance().error("Could not create activation epoll set: " + std::string(strerror(errno)));
+        return false;
+    }
+    
+    // Targets set before start() are registered now that the epoll set exists
+    std::map<int, std::vector<std::string>> initial;
+    {
+        std::lock_guard<std::mutex> lock(targets_mutex);
+        initial.swap(targets);
+    }
+    setTargets(initial);
+    
+    handler = std::move(activation_handler);
+    running = true;
+    loop_thread = std::thread(&ActivationWatcher::loop, this);
+    return true;
+}
+
+void ActivationWatcher::stop() {
+    if (!running) return;
+    
+    running = false;
+    if (loop_thread.joinable()) {
+        loop_thread.join();
+    }
+    close(epoll_fd);
+    epoll_fd = -1;
+}
+
+void ActivationWatcher::setTargets(const std::map<int, std::vector<std::string>>& new_targets) {
+    std::lock_guard<std::mutex> lock(targets_mutex);
+    if (epoll_fd == -1) {
+        targets = new_targets;
+        return;
+    }
+    
+    for (const auto& [fd, instances] : targets) {
+        if (new_targets.find(fd) == new_targets.end()) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        }
+    }
+    // An fd number seen before may now be a different socket: one closed by a reload left the epoll
+    // set with it, and the lowest free number is handed to the next socket bound. Every target is
+    // registered afresh rather than trusting the number
+    for (const auto& [fd, instances] : new_targets) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            Logger::getInstance().error("Could not watch listen socket for " + instances.front() + ": " +
+                                        strerror(errno));
+        }
+    }
+    targets = new_targets;
+}
+
+void ActivationWatcher::loop() {
+    epoll_event events[MAX_EVENTS];
+    while (running) {
+        int count = epoll_wait(epoll_fd, events, MAX_EVENTS, WAIT_MS);
+        for (int i = 0; i < count; i++) {
+            std::vector<std::string> instances;
+            {
+                std::lock_guard<std::mutex> lock(targets_mutex);
+                auto it = targets.find(events[i].data.fd);
+                if (it == targets.end()) continue;
+                instances = it->second;
+            }
+            handler(instances);
+        }
+    }
+}
@@ -1,5 +1,8 @@
 #include "../include/ConfigParser.hpp"
 #include "../include/ini.h"
+#include <climits>
+#include <cstdlib>
+#include <cstdio>
 
 int ConfigParser::iniHandler(void* user, const char* section, const char* name, const char* value) {
     IniParserData* data = static_cast<IniParserData*>(user);
@@ -22,13 +25,37 @@ bool ConfigParser::parseFile(const std::string& filename) {
     }
     
     process_configs.clear();
+    group_configs.clear();
+    supervisor_config = SupervisorConfig();
+    
+    // %(here)s: the directory holding the configuration file
+    char resolved[PATH_MAX];
+    std::string path = realpath(filename.c_str(), resolved) ? std::string(resolved) : filename;
+    size_t slash = path.find_last_of('/');
+    config_dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
     
     for (const auto& [section_name, section_data] : data.sections) {
         if (section_name.substr(0, 8) == "program:") {
             parseProgramSection(section_name, section_data);
+        } else if (section_name.substr(0, 6) == "group:") {
+            parseGroupSection(section_name, section_data);
+        } else if (section_name == "taskmaster") {
+            parseSupervisorSection(section_data);
         }
     }
     
+    // Groups are checked once every program is known, whatever the section order
+    for (auto& [group_name, programs] : group_configs) {
+        auto unknown = std::remove_if(programs.begin(), programs.end(), [this, &group_name](const std::string& program) {
+            if (process_configs.count(program)) {
+                return false;
+            }
+            std::cerr << "Warning: Group " << group_name << " lists unknown program " << program << std::endl;
+            return true;
+        });
+        programs.erase(unknown, programs.end());
+    }
+    
     return true;
 }
 
@@ -36,6 +63,65 @@ std::map<std::string, ProcessConfig> ConfigParser::getProcessConfigs() const {
     return process_configs;
 }
 
+void ConfigParser::parseSupervisorSection(const std::map<std::string, std::string>& section_data) {
+    for (const auto& [key, value] : section_data) {
+        try {
+            if (key == "metrics_listen") {
+                supervisor_config.metrics_listen = value;
+            } else if (key == "control_socket") {
+                supervisor_config.control_socket = value;
+            } else if (key == "control_workers") {
+                supervisor_config.control_workers = std::stoi(value);
+            } else if (key == "control_batch_workers") {
+                supervisor_config.control_batch_workers = std::stoi(value);
+            } else if (key == "event_queue_size") {
+                supervisor_config.event_queue_size = std::stoi(value);
+            } else if (key == "state_journal") {
+                supervisor_config.state_journal = value;
+            } else if (key == "monitor_shards") {
+                supervisor_config.monitor_shards = std::max(0, std::stoi(value));
+            } else if (key == "bulk_workers") {
+                supervisor_config.bulk_workers = std::max(1, std::stoi(value));
+            } else if (key == "spawn_rate") {
+                supervisor_config.spawn_rate = std::max(0.0, std::stod(value));
+            } else if (key == "spawn_burst") {
+                supervisor_config.spawn_burst = std::max(1, std::stoi(value));
+            } else if (key == "spawn_pressure_threshold") {
+                supervisor_config.spawn_pressure_threshold = std::clamp(std::stod(value), 0.0, 100.0);
+            } else if (key == "upgrade_binaries") {
+                std::istringstream iss(value);
+                std::string binary;
+                while (std::getline(iss, binary, ',')) {
+                    binary.erase(0, binary.find_first_not_of(" \t"));
+                    binary.erase(binary.find_last_not_of(" \t") + 1);
+                    if (binary.empty()) continue;
+                    if (binary.front() != '/') {
+                        throw std::invalid_argument("expected absolute paths");
+                    }
+                    supervisor_config.upgrade_binaries.push_back(binary);
+                }
+            } else if (key == "exit_action") {
+                if (value == "stop" || value == "detach") {
+                    supervisor_config.detach_on_exit = value == "detach";
+                } else {
+                    std::cerr << "Warning: Invalid exit_action " << value << ", using stop" << std::endl;
+                }
+            } else if (key == "event_backend") {
+                if (value == "auto" || value == "io_uring" || value == "epoll") {
+                    supervisor_config.event_backend = value;
+                } else {
+                    std::cerr << "Warning: Invalid event_backend " << value << ", using auto" << std::endl;
+                }
+            } else {
+                std::cerr << "Warning: Unknown option " << key << " in [taskmaster] section" << std::endl;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: Invalid value for " << key << " in [taskmaster] section: " << value
+                      << " (" << e.what() << ")" << std::endl;
+        }
+    }
+}
+
 void ConfigParser::parseProgramSection(const std::string& section_name, 
                                      const std::map<std::string, std::string>& section_data) {
     
@@ -77,6 +163,88 @@ void ConfigParser::parseProgramSection(const std::string& section_name,
                 config.environment = parseEnvironment(value);
             } else if (key == "umask") {
                 config.umask = std::stoi(value, nullptr, 8);
+            } else if (key == "cpu_affinity") {
+                if (!CpuAffinity::parseAffinity(value, config.affinity)) {
+                    throw std::invalid_argument("expected none, round-robin[:cpus], numa-spread or a cpu list");
+                }
+            } else if (key == "watchdog") {
+                config.watchdog = Watchdog::parseRules(value);
+            } else if (key == "watchdog_cooldown") {
+                config.watchdog_cooldown = std::stoi(value);
+            } else if (key == "healthcheck") {
+                if (!HealthCheck::parse(value, config.healthcheck)) {
+                    throw std::invalid_argument("expected exec:<command>, tcp:[host:]port, http:[host:]port[/path] "
+                                                "or unix:<path>, with host an IP address");
+                }
+            } else if (key == "healthcheck_interval") {
+                config.healthcheck.interval = std::max(1, std::stoi(value));
+            } else if (key == "healthcheck_timeout") {
+                config.healthcheck.timeout = std::max(1, std::stoi(value));
+            } else if (key == "healthcheck_threshold") {
+                config.healthcheck.threshold = std::max(1, std::stoi(value));
+            } else if (key == "readiness") {
+                if (value == "notify") {
+                    config.notify_ready = true;
+                } else if (value == "none") {
+                    config.notify_ready = false;
+                } else {
+                    throw std::invalid_argument("expected none or notify");
+                }
+            } else if (key == "ready_timeout") {
+                config.ready_timeout = std::max(1, std::stoi(value));
+            } else if (key == "notify_watchdog") {
+                config.notify_watchdog = std::max(0, std::stoi(value));
+            } else if (key == "listen") {
+                config.listen.clear();
+                std::istringstream specs(value);
+                std::string item;
+                while (std::getline(specs, item, ',')) {
+                    item.erase(0, item.find_first_not_of(" \t"));
+                    item.erase(item.find_last_not_of(" \t") + 1);
+                    SocketSpec spec;
+                    if (!SocketUtils::parseSpec(item, spec)) {
+                        throw std::invalid_argument("expected tcp:host:port or unix:/path");
+                    }
+                    config.listen.push_back(spec);
+                }
+            } else if (key == "idle_timeout") {
+                config.idle_timeout = std::max(0, std::stoi(value));
+            } else if (key == "reload_policy") {
+                if (value == "rolling") {
+                    config.rolling_reload = true;
+                } else if (value == "restart") {
+                    config.rolling_reload = false;
+                } else {
+                    throw std::invalid_argument("expected restart or rolling");
+                }
+            } else if (key == "max_unavailable") {
+                config.max_unavailable = std::max(0, std::stoi(value));
+            } else if (key == "max_surge") {
+                config.max_surge = std::max(0, std::stoi(value));
+            } else if (key == "warm_spares") {
+                config.warm_spares = std::max(0, std::stoi(value));
+            } else if (key == "warm_spare_gate") {
+                if (value == "program") {
+                    config.spare_gate_program = true;
+                } else if (value == "exec") {
+                    config.spare_gate_program = false;
+                } else {
+                    throw std::invalid_argument("expected exec or program");
+                }
+            } else if (key == "spawn_mode") {
+                if (value == "zygote") {
+                    config.zygote = true;
+                } else if (value == "fork") {
+                    config.zygote = false;
+                } else {
+                    throw std::invalid_argument("expected fork or zygote");
+                }
+            } else if (key == "listen_backlog") {
+                config.listen_backlog = std::max(1, std::stoi(value));
+            } else if (key == "numa_policy") {
+                if (!CpuAffinity::parseMemPolicy(value, config.affinity.mempolicy)) {
+                    throw std::invalid_argument("expected none, bind, interleave or preferred");
+                }
             }
         } catch (const std::exception& e) {
             std::cerr << "Warning: Invalid value for " << key << " in program " << prog_name 
@@ -89,9 +257,152 @@ void ConfigParser::parseProgramSection(const std::string& section_name,
         return;
     }
     
+    bool per_instance_sockets = config.numprocs > 1 &&
+        std::any_of(config.listen.begin(), config.listen.end(),
+                    [](const SocketSpec& spec) { return spec.family == SocketFamily::TCP; });
+    if (config.warm_spares > 0 && per_instance_sockets) {
+        std::cerr << "Warning: Program " << prog_name << " has per-instance SO_REUSEPORT sockets, warm_spares disabled" << std::endl;
+        config.warm_spares = 0;
+    }
+    if (config.zygote && per_instance_sockets) {
+        std::cerr << "Warning: Program " << prog_name << " has per-instance SO_REUSEPORT sockets, spawn_mode=zygote disabled" << std::endl;
+        config.zygote = false;
+    }
+    if (config.zygote && config.warm_spares > 0) {
+        std::cerr << "Warning: Program " << prog_name << " uses spawn_mode=zygote, warm_spares ignored" << std::endl;
+        config.warm_spares = 0;
+    }
+    
+    // Unknown references are reported once here and otherwise left as written
+    std::string error;
+    ProcessConfig first = instanceConfig(config, 0, &error);
+    if (!error.empty()) {
+        std::cerr << "Warning: Program " << prog_name << ": " << error << std::endl;
+    }
+    // Spares and zygote children inherit one instance's command, environment and logs
+    if (config.numprocs > 1 && (config.warm_spares > 0 || config.zygote)) {
+        ProcessConfig second = instanceConfig(config, 1);
+        if (first.command != second.command || first.environment != second.environment ||
+            first.stdout_logfile != second.stdout_logfile || first.stderr_logfile != second.stderr_logfile ||
+            first.workingdir != second.workingdir) {
+            std::cerr << "Warning: Program " << prog_name << " expands %(process_num)d per instance, "
+                      << (config.zygote ? "spawn_mode=zygote" : "warm_spares") << " disabled" << std::endl;
+            config.zygote = false;
+            config.warm_spares = 0;
+        }
+    }
+    
+    if (config.autostart == AutoStart::ON_DEMAND && config.listen.empty()) {
+        std::cerr << "Warning: Program " << prog_name << " uses autostart=on-demand without a listen socket and will only start manually" << std::endl;
+    }
+    
     process_configs[prog_name] = config;
 }
 
+ProcessConfig ConfigParser::instanceConfig(const ProcessConfig& program, int process_num, std::string* error) const {
+    std::map<std::string, std::string> variables = {
+        {"program_name", program.name},
+        {"process_num", std::to_string(process_num)},
+        {"numprocs", std::to_string(program.numprocs)},
+        {"here", config_dir}
+    };
+    std::string first_error;
+    auto expand = [&variables, &first_error](const std::string& value) {
+        return expandTemplate(value, variables, &first_error);
+    };
+    
+    ProcessConfig config = program;
+    config.process_num = process_num;
+    config.command = expand(program.command);
+    config.stdout_logfile = expand(program.stdout_logfile);
+    config.stderr_logfile = expand(program.stderr_logfile);
+    config.workingdir = expand(program.workingdir);
+    for (auto& [key, value] : config.environment) {
+        value = expand(value);
+    }
+    
+    if (error) {
+        *error = first_error;
+    }
+    return config;
+}
+
+// Python-style %(name)<flags><width><type> references, as supervisord writes them; type is d, i or s.
+// Only the first problem is kept in error
+std::string ConfigParser::expandTemplate(const std::string& value, const std::map<std::string, std::string>& variables,
+                                         std::string* error) {
+    std::string result;
+    size_t position = 0;
+    while (true) {
+        size_t start = value.find("%(", position);
+        if (start == std::string::npos) {
+            break;
+        }
+        result.append(value, position, start - position);
+        
+        size_t close = value.find(')', start + 2);
+        size_t type = close == std::string::npos ? std::string::npos : value.find_first_not_of("-+ #0123456789.", close + 1);
+        if (type == std::string::npos || std::string("dis").find(value[type]) == std::string::npos) {
+            if (error && error->empty()) *error = "malformed reference in " + value;
+            result.append(value, start, 2);
+            position = start + 2;
+            continue;
+        }
+        
+        std::string name = value.substr(start + 2, close - start - 2);
+        auto variable = variables.find(name);
+        if (variable == variables.end()) {
+            if (error && error->empty()) *error = "unknown variable %(" + name + ") in " + value;
+            result.append(value, start, type + 1 - start);
+            position = type + 1;
+            continue;
+        }
+        
+        std::string format = "%" + value.substr(close + 1, type - close - 1);
+        char buffer[PATH_MAX];
+        if (value[type] == 's') {
+            std::snprintf(buffer, sizeof(buffer), (format + "s").c_str(), variable->second.c_str());
+        } else {
+            char* end = nullptr;
+            long long number = std::strtoll(variable->second.c_str(), &end, 10);
+            if (variable->second.empty() || *end != '\0') {
+                if (error && error->empty()) *error = "%(" + name + ") is not a number in " + value;
+                number = 0;
+            }
+            std::snprintf(buffer, sizeof(buffer), (format + "lld").c_str(), number);
+        }
+        result += buffer;
+        position = type + 1;
+    }
+    result.append(value, position, std::string::npos);
+    return result;
+}
+
+void ConfigParser::parseGroupSection(const std::string& section_name,
+                                     const std::map<std::string, std::string>& section_data) {
+    std::string group_name = section_name.substr(6);
+    if (group_name.empty()) return;
+    
+    std::vector<std::string> programs;
+    for (const auto& [key, value] : section_data) {
+        if (key != "programs") {
+            std::cerr << "Warning: Unknown option " << key << " in group " << group_name << std::endl;
+            continue;
+        }
+        std::istringstream iss(value);
+        std::string program;
+        while (std::getline(iss, program, ',')) {
+            program.erase(0, program.find_first_not_of(" \t"));
+            program.erase(program.find_last_not_of(" \t") + 1);
+            if (!program.empty() && std::find(programs.begin(), programs.end(), program) == programs.end()) {
+                programs.push_back(program);
+            }
+        }
+    }
+    
+    group_configs[group_name] = programs;
+}
+
 std::map<std::string, std::string> ConfigParser::parseEnvironment(const std::string& env_str) {
     std::map<std::string, std::string> env_map;
     
@@ -145,6 +456,8 @@ AutoStart ConfigParser::parseAutoStart(const std::string& value) {
         return AutoStart::FALSE;
     } else if (lower_value == "unexpected") {
         return AutoStart::UNEXPECTED;
+    } else if (lower_value == "on-demand" || lower_value == "on_demand") {
+        return AutoStart::ON_DEMAND;
     }
     
     return AutoStart::TRUE;
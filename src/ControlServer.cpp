@@ -0,0 +1,526 @@
+#include "../include/ControlServer.hpp"
+#include "../include/Logger.hpp"
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+ControlServer::ControlServer(CommandHandler handler, ItemHandler item_handler, size_t workers, size_t batch_workers)
+    : handler(std::move(handler)), item_handler(std::move(item_handler)),
+      worker_count(workers), batch_worker_count(batch_workers) {
+}
+
+ControlServer::~ControlServer() {
+    stop();
+}
+
+bool ControlServer::start(const SocketSpec& listen_spec) {
+    std::string error;
+    spec = listen_spec;
+    // Anyone who can connect can stop every process or upgrade the supervisor
+    listen_fd = SocketUtils::createListener(spec, error, 128, false, true, SOCKET_MODE);
+    if (listen_fd == -1) {
+        Logger::getInstance().error("Could not start control socket: " + error);
+        return false;
+    }
+    
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd == -1 || wake_fd == -1) {
+        Logger::getInstance().error("Could not create control socket event loop: " + std::string(strerror(errno)));
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = LISTEN_ID;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+    ev.data.u64 = WAKE_ID;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+    
+    pool = std::make_unique<WorkerPool>(worker_count);
+    batch_pool = std::make_unique<WorkerPool>(batch_worker_count);
+    running = true;
+    loop_thread = std::thread(&ControlServer::loop, this);
+    Logger::getInstance().info("Control socket listening on " + spec.toString());
+    return true;
+}
+
+void ControlServer::stop() {
+    if (!running) return;
+    
+    running = false;
+    wake();
+    if (loop_thread.joinable()) {
+        loop_thread.join();
+    }
+    pool->shutdown();
+    batch_pool->shutdown();
+    
+    // Replies that completed after the loop stopped, such as the one to the shutdown command itself
+    std::vector<Completion> ready;
+    {
+        std::lock_guard<std::mutex> lock(completions_mutex);
+        ready.swap(completions);
+    }
+    for (auto& completion : ready) {
+        auto it = clients.find(completion.client_id);
+        if (it != clients.end()) {
+            it->second.output += completion.response;
+            writeClient(it->second);
+        }
+    }
+    
+    for (auto& [id, client] : clients) {
+        if (client.subscription) {
+            ProcessEvents::getInstance().unsubscribe(client.subscription);
+        }
+        close(client.fd);
+    }
+    clients.clear();
+    close(listen_fd);
+    close(epoll_fd);
+    close(wake_fd);
+    listen_fd = epoll_fd = wake_fd = -1;
+    if (spec.family == SocketFamily::UNIX) {
+        unlink(spec.path.c_str());
+    }
+}
+
+void ControlServer::wake() {
+    uint64_t one = 1;
+    ssize_t result = write(wake_fd, &one, sizeof(one));
+    (void)result;
+}
+
+void ControlServer::loop() {
+    epoll_event events[64];
+    
+    while (running) {
+        int count = epoll_wait(epoll_fd, events, 64, 500);
+        if (count == -1 && errno != EINTR) {
+            Logger::getInstance().error("Control socket epoll_wait failed: " + std::string(strerror(errno)));
+            break;
+        }
+        
+        for (int i = 0; i < count; ++i) {
+            uint64_t id = events[i].data.u64;
+            
+            if (id == LISTEN_ID) {
+                acceptClients();
+                continue;
+            }
+            if (id == WAKE_ID) {
+                uint64_t value;
+                ssize_t result = read(wake_fd, &value, sizeof(value));
+                (void)result;
+                drainCompletions();
+                drainSubscriptions();
+                continue;
+            }
+            
+            auto it = clients.find(id);
+            if (it == clients.end()) continue;
+            
+            if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                closeClient(id);
+                continue;
+            }
+            if (events[i].events & EPOLLIN) {
+                readClient(id, it->second);
+            }
+            it = clients.find(id);
+            if (it != clients.end() && (events[i].events & EPOLLOUT)) {
+                writeClient(it->second);
+                pumpEvents(it->second);
+                if (it->second.closing && it->second.output.empty() && it->second.idle()) {
+                    closeClient(id);
+                } else {
+                    dispatchNext(id, it->second);
+                    updateEvents(id, it->second);
+                }
+            }
+        }
+    }
+}
+
+void ControlServer::acceptClients() {
+    while (true) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            return;
+        }
+        
+        uint64_t id = next_client_id++;
+        Client& client = clients[id];
+        client.fd = fd;
+        client.events = EPOLLIN;
+        
+        epoll_event ev = {};
+        ev.events = client.events;
+        ev.data.u64 = id;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+void ControlServer::readClient(uint64_t id, Client& client) {
+    char buffer[16384];
+    
+    while (true) {
+        ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            client.input.append(buffer, static_cast<size_t>(n));
+            // The rest stays in the socket until what was read has been parsed and queued
+            if (client.input.size() >= MAX_LINE) {
+                break;
+            }
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            // Subscribers may half-close after subscribing; the stream runs until they disconnect
+            if (client.subscription) {
+                client.input_closed = true;
+                break;
+            }
+            // Peer hung up: answer what is already queued only if it still reads
+            if (client.idle() && client.input.empty()) {
+                closeClient(id);
+                return;
+            }
+            client.closing = true;
+        }
+        break;
+    }
+    
+    if (!parseInput(id, client)) {
+        return;
+    }
+    
+    dispatchNext(id, client);
+    updateEvents(id, client);
+}
+
+// Splits buffered input into commands or frames; returns false if the client was dropped
+bool ControlServer::parseInput(uint64_t id, Client& client) {
+    if (client.mode == Mode::UNKNOWN && !client.input.empty()) {
+        client.mode = client.input[0] == '\0' ? Mode::BINARY : Mode::TEXT;
+    }
+    
+    if (client.mode == Mode::BINARY) {
+        ControlProtocol::Frame frame;
+        int result;
+        while ((result = ControlProtocol::takeFrame(client.input, frame)) == 1) {
+            client.frames.push_back(std::move(frame));
+        }
+        if (result == -1) {
+            Logger::getInstance().warning("Control client sent a malformed frame, disconnecting");
+            closeClient(id);
+            return false;
+        }
+        // A truncated frame left behind by a half-closed peer can never complete
+        if (client.closing) {
+            client.input.clear();
+        }
+        return true;
+    }
+    
+    size_t start = 0;
+    size_t newline;
+    while ((newline = client.input.find('\n', start)) != std::string::npos) {
+        std::string line = client.input.substr(start, newline - start);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        client.pending.push_back(std::move(line));
+        start = newline + 1;
+    }
+    client.input.erase(0, start);
+    if (client.closing && !client.input.empty()) {
+        client.pending.push_back(std::move(client.input));
+        client.input.clear();
+    }
+    
+    if (client.input.size() > MAX_LINE) {
+        Logger::getInstance().warning("Control client sent an oversized command, disconnecting");
+        closeClient(id);
+        return false;
+    }
+    return true;
+}
+
+void ControlServer::writeClient(Client& client) {
+    while (!client.output.empty()) {
+        ssize_t n = send(client.fd, client.output.data(), client.output.size(), MSG_NOSIGNAL);
+        if (n > 0) {
+            client.output.erase(0, static_cast<size_t>(n));
+            continue;
+        }
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return;
+        }
+        client.output.clear();
+        client.closing = true;
+        client.pending.clear();
+        client.frames.clear();
+        return;
+    }
+}
+
+void ControlServer::dispatchNext(uint64_t id, Client& client) {
+    if (client.mode == Mode::BINARY) {
+        dispatchBinary(id, client);
+    } else {
+        dispatchText(id, client);
+    }
+}
+
+// Commands from one text client run one at a time so its responses stay in order
+void ControlServer::dispatchText(uint64_t id, Client& client) {
+    while (client.in_flight == 0 && !client.pending.empty() && client.output.size() < OUTPUT_HIGH_WATER) {
+        std::string command = std::move(client.pending.front());
+        client.pending.pop_front();
+        
+        size_t first = command.find_first_not_of(" \t");
+        if (first == std::string::npos) {
+            client.output += frame("OK", "");
+            continue;
+        }
+        
+        std::istringstream words(command);
+        std::string verb;
+        words >> verb;
+        if (verb == "subscribe") {
+            std::string arguments;
+            std::getline(words, arguments);
+            std::string message;
+            subscribe(client, arguments, 0, message);
+            client.output += frame("OK", message);
+            continue;
+        }
+        
+        client.in_flight++;
+        pool->submit([this, id, command]() {
+            std::ostringstream out;
+            bool keep_open = true;
+            try {
+                keep_open = handler(command.substr(command.find_first_not_of(" \t")), out);
+            } catch (const std::exception& e) {
+                out << "Error: " << e.what() << "\n";
+            }
+            
+            complete({id, frame(keep_open ? "OK" : "BYE", out.str()), keep_open});
+        });
+    }
+}
+
+// Binary requests are tagged with an id, so several run at once and finish in any order
+void ControlServer::dispatchBinary(uint64_t id, Client& client) {
+    using Opcode = ControlProtocol::Opcode;
+    
+    while (client.in_flight < MAX_IN_FLIGHT && !client.frames.empty() && client.output.size() < OUTPUT_HIGH_WATER) {
+        ControlProtocol::Frame request = std::move(client.frames.front());
+        client.frames.pop_front();
+        client.in_flight++;
+        
+        if (ControlProtocol::isBatch(request.opcode)) {
+            dispatchBatch(id, request);
+        } else if (request.opcode == Opcode::SUBSCRIBE) {
+            std::string message;
+            Opcode reply = subscribe(client, request.payload, request.request_id, message) ? Opcode::SUBSCRIBE : Opcode::ERROR;
+            complete({id, ControlProtocol::encodeFrame(request.request_id, reply, message), true});
+        } else if (request.opcode == Opcode::COMMAND) {
+            uint32_t request_id = request.request_id;
+            pool->submit([this, id, request_id, command = std::move(request.payload)]() {
+                std::ostringstream out;
+                bool keep_open = true;
+                try {
+                    keep_open = handler(command, out);
+                } catch (const std::exception& e) {
+                    out << "Error: " << e.what() << "\n";
+                }
+                
+                std::string payload(1, keep_open ? '\1' : '\0');
+                payload += out.str();
+                complete({id, ControlProtocol::encodeFrame(request_id, Opcode::COMMAND, payload), keep_open});
+            });
+        } else {
+            complete({id, ControlProtocol::encodeFrame(request.request_id, Opcode::ERROR, "unknown opcode"), true});
+        }
+    }
+}
+
+void ControlServer::dispatchBatch(uint64_t id, ControlProtocol::Frame& request) {
+    using Opcode = ControlProtocol::Opcode;
+    
+    auto batch = std::make_shared<Batch>();
+    batch->client_id = id;
+    batch->request_id = request.request_id;
+    batch->opcode = request.opcode;
+    if (!ControlProtocol::decodeNames(request.payload, batch->names)) {
+        complete({id, ControlProtocol::encodeFrame(request.request_id, Opcode::ERROR, "malformed batch"), true});
+        return;
+    }
+    if (batch->names.empty()) {
+        complete({id, ControlProtocol::encodeFrame(request.request_id, request.opcode, ControlProtocol::encodeResults({})), true});
+        return;
+    }
+    
+    batch->results.resize(batch->names.size());
+    batch->remaining = batch->names.size();
+    for (size_t i = 0; i < batch->names.size(); ++i) {
+        batch_pool->submit([this, batch, i]() {
+            ControlProtocol::ItemResult result;
+            try {
+                result = item_handler(batch->opcode, batch->names[i]);
+            } catch (const std::exception& e) {
+                result = {ControlProtocol::ItemStatus::FAILED, e.what()};
+            }
+            batch->results[i] = std::move(result);
+            
+            if (batch->remaining.fetch_sub(1) == 1) {
+                complete({batch->client_id, ControlProtocol::encodeFrame(batch->request_id, batch->opcode,
+                                                                         ControlProtocol::encodeResults(batch->results)), true});
+            }
+        });
+    }
+}
+
+void ControlServer::complete(Completion completion) {
+    {
+        std::lock_guard<std::mutex> lock(completions_mutex);
+        completions.push_back(std::move(completion));
+    }
+    wake();
+}
+
+bool ControlServer::subscribe(Client& client, const std::string& arguments, uint32_t request_id, std::string& message) {
+    std::istringstream iss(arguments);
+    std::string pattern = "*";
+    std::string type_list;
+    iss >> pattern >> type_list;
+    
+    std::vector<ProcessState> types;
+    if (!ProcessEvents::parseTypes(type_list, types)) {
+        message = "Unknown event type in '" + type_list + "'\n";
+        return false;
+    }
+    if (client.subscription) {
+        ProcessEvents::getInstance().unsubscribe(client.subscription);
+    }
+    
+    client.subscription = ProcessEvents::getInstance().subscribe(pattern, types, event_queue_size, [this]() { wake(); });
+    client.subscription_id = request_id;
+    // A peer that half-closed right after subscribing still wants the stream
+    if (client.closing) {
+        client.closing = false;
+        client.input_closed = true;
+    }
+    message = "Subscribed to " + client.subscription->getPattern() + " (" +
+              (type_list.empty() ? std::string("all") : type_list) + ")\n";
+    return true;
+}
+
+// Moves queued events into the client's output until it reaches the high-water mark;
+// anything beyond stays in the bounded subscription queue and overflows there
+void ControlServer::pumpEvents(Client& client) {
+    if (!client.subscription) return;
+    
+    std::vector<ProcessEvent> pending_events;
+    while (client.output.size() < OUTPUT_HIGH_WATER) {
+        pending_events.clear();
+        if (client.subscription->drain(pending_events, EVENT_BATCH) == 0) {
+            break;
+        }
+        for (const auto& event : pending_events) {
+            std::string line = ProcessEvents::format(event);
+            if (client.mode == Mode::BINARY) {
+                client.output += ControlProtocol::encodeFrame(client.subscription_id, ControlProtocol::Opcode::EVENT, line);
+            } else {
+                client.output += frame("EVENT", line);
+            }
+        }
+    }
+}
+
+void ControlServer::drainSubscriptions() {
+    for (auto& [id, client] : clients) {
+        if (!client.subscription || client.closing) continue;
+        
+        pumpEvents(client);
+        writeClient(client);
+        updateEvents(id, client);
+    }
+}
+
+void ControlServer::drainCompletions() {
+    std::vector<Completion> ready;
+    {
+        std::lock_guard<std::mutex> lock(completions_mutex);
+        ready.swap(completions);
+    }
+    
+    for (auto& completion : ready) {
+        auto it = clients.find(completion.client_id);
+        if (it == clients.end()) continue;
+        
+        Client& client = it->second;
+        client.in_flight--;
+        client.output += completion.response;
+        if (!completion.keep_open) {
+            client.closing = true;
+            client.pending.clear();
+            client.frames.clear();
+        }
+        
+        writeClient(client);
+        if (client.closing && client.output.empty() && client.idle()) {
+            closeClient(completion.client_id);
+            continue;
+        }
+        dispatchNext(completion.client_id, client);
+        updateEvents(completion.client_id, client);
+    }
+}
+
+void ControlServer::updateEvents(uint64_t id, Client& client) {
+    uint32_t wanted = 0;
+    // Stop reading from a client that is not draining its responses, or that pipelines requests faster
+    // than they complete
+    if (!client.closing && !client.input_closed && client.output.size() < OUTPUT_HIGH_WATER &&
+        client.pending.size() + client.frames.size() < MAX_QUEUED) {
+        wanted |= EPOLLIN;
+    }
+    if (!client.output.empty()) {
+        wanted |= EPOLLOUT;
+    }
+    
+    if (wanted != client.events) {
+        epoll_event ev = {};
+        ev.events = wanted;
+        ev.data.u64 = id;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client.fd, &ev);
+        client.events = wanted;
+    }
+}
+
+void ControlServer::closeClient(uint64_t id) {
+    auto it = clients.find(id);
+    if (it == clients.end()) return;
+    
+    if (it->second.subscription) {
+        ProcessEvents::getInstance().unsubscribe(it->second.subscription);
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+    close(it->second.fd);
+    clients.erase(it);
+}
+
+std::string ControlServer::frame(const char* status, const std::string& body) {
+    std::string result = status;
+    result += " " + std::to_string(body.size()) + "\n";
+    result += body;
+    return result;
+}
@@ -0,0 +1,297 @@
+#include "../include/CpuAffinity.hpp"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+bool CpuAffinity::parseAffinity(const std::string& value, AffinityPolicy& policy) {
+    std::string lower_value = value;
+    std::transform(lower_value.begin(), lower_value.end(), lower_value.begin(), ::tolower);
+    
+    policy.cpus.clear();
+    
+    if (lower_value.empty() || lower_value == "none") {
+        policy.mode = AffinityMode::NONE;
+        return true;
+    }
+    if (lower_value == "numa-spread") {
+        policy.mode = AffinityMode::NUMA_SPREAD;
+        return true;
+    }
+    if (lower_value.rfind("round-robin", 0) == 0) {
+        policy.mode = AffinityMode::ROUND_ROBIN;
+        if (lower_value.size() > 11) {
+            if (lower_value[11] != ':' || !parseCpuList(lower_value.substr(12), policy.cpus)) {
+                policy.mode = AffinityMode::NONE;
+                policy.cpus.clear();
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    policy.mode = AffinityMode::CPUSET;
+    if (!parseCpuList(lower_value, policy.cpus)) {
+        policy.mode = AffinityMode::NONE;
+        policy.cpus.clear();
+        return false;
+    }
+    return true;
+}
+
+bool CpuAffinity::parseMemPolicy(const std::string& value, MemPolicy& mempolicy) {
+    std::string lower_value = value;
+    std::transform(lower_value.begin(), lower_value.end(), lower_value.begin(), ::tolower);
+    
+    if (lower_value.empty() || lower_value == "none" || lower_value == "default") {
+        mempolicy = MemPolicy::NONE;
+    } else if (lower_value == "bind") {
+        mempolicy = MemPolicy::BIND;
+    } else if (lower_value == "interleave") {
+        mempolicy = MemPolicy::INTERLEAVE;
+    } else if (lower_value == "preferred") {
+        mempolicy = MemPolicy::PREFERRED;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool CpuAffinity::parseCpuList(const std::string& list, std::vector<int>& cpus) {
+    std::istringstream iss(list);
+    std::string token;
+    
+    while (std::getline(iss, token, ',')) {
+        token.erase(0, token.find_first_not_of(" \t"));
+        token.erase(token.find_last_not_of(" \t") + 1);
+        if (token.empty()) continue;
+        
+        size_t dash = token.find('-');
+        try {
+            if (dash == std::string::npos) {
+                cpus.push_back(std::stoi(token));
+            } else {
+                int first = std::stoi(token.substr(0, dash));
+                int last = std::stoi(token.substr(dash + 1));
+                // Bounded before expanding, so a huge range cannot allocate without limit or overflow
+                if (first < 0 || last < first || last >= CPU_SETSIZE) return false;
+                for (int cpu = first; cpu <= last; ++cpu) {
+                    cpus.push_back(cpu);
+                }
+            }
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return !cpus.empty() && cpus.front() >= 0 && cpus.back() < CPU_SETSIZE;
+}
+
+std::string CpuAffinity::formatCpuList(const std::vector<int>& cpus) {
+    std::stringstream ss;
+    for (size_t i = 0; i < cpus.size();) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+            ++j;
+        }
+        if (i > 0) ss << ",";
+        ss << cpus[i];
+        if (j > i) ss << "-" << cpus[j];
+        i = j + 1;
+    }
+    return ss.str();
+}
+
+AffinityPlacement CpuAffinity::resolvePlacement(const AffinityPolicy& policy, int process_num) {
+    const Topology& topo = topology();
+    AffinityPlacement placement;
+    int index = std::max(process_num, 0);
+    
+    switch (policy.mode) {
+        case AffinityMode::CPUSET:
+            placement.cpus = policy.cpus;
+            break;
+        case AffinityMode::ROUND_ROBIN: {
+            const std::vector<int>& pool = policy.cpus.empty() ? topo.online_cpus : policy.cpus;
+            if (!pool.empty()) {
+                placement.cpus.push_back(pool[index % pool.size()]);
+            }
+            break;
+        }
+        case AffinityMode::NUMA_SPREAD:
+            if (!topo.node_cpus.empty()) {
+                auto it = topo.node_cpus.begin();
+                std::advance(it, index % topo.node_cpus.size());
+                placement.cpus = it->second;
+                placement.nodes.push_back(it->first);
+            }
+            break;
+        case AffinityMode::NONE:
+        default:
+            break;
+    }
+    
+    if (placement.nodes.empty()) {
+        for (int cpu : placement.cpus) {
+            auto it = topo.cpu_node.find(cpu);
+            if (it != topo.cpu_node.end()) {
+                placement.nodes.push_back(it->second);
+            }
+        }
+        std::sort(placement.nodes.begin(), placement.nodes.end());
+        placement.nodes.erase(std::unique(placement.nodes.begin(), placement.nodes.end()), placement.nodes.end());
+    }
+    if (placement.nodes.empty() && policy.mempolicy != MemPolicy::NONE) {
+        for (const auto& [node, cpus] : topo.node_cpus) {
+            placement.nodes.push_back(node);
+        }
+    }
+    
+    return placement;
+}
+
+bool CpuAffinity::applyPlacement(const AffinityPolicy& policy, const AffinityPlacement& placement) {
+    bool ok = true;
+    
+    if (!placement.cpus.empty() && !applyCpus(0, placement.cpus)) {
+        ok = false;
+    }
+    
+    if (policy.mempolicy != MemPolicy::NONE && !placement.nodes.empty()) {
+        constexpr int BITS = 8 * sizeof(unsigned long);
+        unsigned long nodemask[16] = {0};
+        int mode = MPOL_DEFAULT;
+        
+        for (int node : placement.nodes) {
+            if (node >= 0 && node < 16 * BITS) {
+                nodemask[node / BITS] |= 1UL << (node % BITS);
+            }
+        }
+        
+        switch (policy.mempolicy) {
+            case MemPolicy::BIND:       mode = MPOL_BIND; break;
+            case MemPolicy::INTERLEAVE: mode = MPOL_INTERLEAVE; break;
+            case MemPolicy::PREFERRED:  mode = MPOL_PREFERRED; break;
+            default: break;
+        }
+        
+        if (syscall(SYS_set_mempolicy, mode, nodemask, 16 * BITS) != 0) {
+            ok = false;
+        }
+    }
+    
+    return ok;
+}
+
+bool CpuAffinity::applyCpus(pid_t pid, const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    return sched_setaffinity(pid, sizeof(set), &set) == 0;
+}
+
+std::string CpuAffinity::describeCpuMask(pid_t pid) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pid <= 0 || sched_getaffinity(pid, sizeof(set), &set) != 0) {
+        return "unknown";
+    }
+    
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus.push_back(cpu);
+        }
+    }
+    return formatCpuList(cpus);
+}
+
+int CpuAffinity::currentNode(pid_t pid) {
+    std::ifstream stat_file("/proc/" + std::to_string(pid) + "/stat");
+    std::string content;
+    if (!stat_file.is_open() || !std::getline(stat_file, content)) {
+        return -1;
+    }
+    
+    // Fields after the command name; "processor" is field 39 overall
+    size_t paren = content.rfind(')');
+    if (paren == std::string::npos) {
+        return -1;
+    }
+    std::istringstream iss(content.substr(paren + 2));
+    std::string field;
+    int cpu = -1;
+    for (int i = 3; i <= 39 && (iss >> field); ++i) {
+        if (i == 39) {
+            cpu = std::stoi(field);
+        }
+    }
+    
+    const Topology& topo = topology();
+    auto it = topo.cpu_node.find(cpu);
+    return it != topo.cpu_node.end() ? it->second : -1;
+}
+
+const CpuAffinity::Topology& CpuAffinity::topology() {
+    static const Topology topo = loadTopology();
+    return topo;
+}
+
+CpuAffinity::Topology CpuAffinity::loadTopology() {
+    Topology topo;
+    
+    parseCpuList(readFirstLine("/sys/devices/system/cpu/online"), topo.online_cpus);
+    if (topo.online_cpus.empty()) {
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long cpu = 0; cpu < count; ++cpu) {
+            topo.online_cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    
+    DIR* dir = opendir("/sys/devices/system/node");
+    if (dir) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            std::string name = entry->d_name;
+            if (name.size() <= 4 || name.substr(0, 4) != "node" ||
+                !std::all_of(name.begin() + 4, name.end(), ::isdigit)) {
+                continue;
+            }
+            int node = std::stoi(name.substr(4));
+            std::vector<int> cpus;
+            if (parseCpuList(readFirstLine("/sys/devices/system/node/" + name + "/cpulist"), cpus)) {
+                topo.node_cpus[node] = cpus;
+                for (int cpu : cpus) {
+                    topo.cpu_node[cpu] = node;
+                }
+            }
+        }
+        closedir(dir);
+    }
+    
+    if (topo.node_cpus.empty()) {
+        topo.node_cpus[0] = topo.online_cpus;
+        for (int cpu : topo.online_cpus) {
+            topo.cpu_node[cpu] = 0;
+        }
+    }
+    
+    return topo;
+}
+
+std::string CpuAffinity::readFirstLine(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    if (file.is_open()) {
+        std::getline(file, line);
+    }
+    return line;
+}
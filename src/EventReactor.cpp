@@ -0,0 +1,317 @@
+#include "../include/EventReactor.hpp"
+#include "../include/Logger.hpp"
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+EventReactor::~EventReactor() {
+    close();
+}
+
+bool EventReactor::open(Backend preferred) {
+    if (preferred != Backend::EPOLL) {
+        if (openRing()) {
+            backend = Backend::IO_URING;
+            backend_open = true;
+            return true;
+        }
+        if (preferred == Backend::IO_URING) {
+            Logger::getInstance().warning("io_uring unavailable (" + std::string(strerror(errno)) +
+                                          "), falling back to epoll");
+        }
+    }
+    
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) {
+        Logger::getInstance().error("Could not create event loop: " + std::string(strerror(errno)));
+        return false;
+    }
+    backend = Backend::EPOLL;
+    backend_open = true;
+    return true;
+}
+
+void EventReactor::close() {
+    closeRing();
+    if (epoll_fd != -1) {
+        ::close(epoll_fd);
+        epoll_fd = -1;
+    }
+    watches.clear();
+    poll_tokens.clear();
+    backend_open = false;
+}
+
+const char* EventReactor::backendName() const {
+    return backend == Backend::IO_URING ? "io_uring" : "epoll";
+}
+
+EventReactor::Backend EventReactor::parseBackend(const std::string& value) {
+    if (value == "io_uring") {
+        return Backend::IO_URING;
+    } else if (value == "epoll") {
+        return Backend::EPOLL;
+    }
+    return Backend::AUTO;
+}
+
+bool EventReactor::watch(int fd, uint64_t token) {
+    if (!backend_open) {
+        return false;
+    }
+    
+    auto it = watches.find(token);
+    if (it != watches.end() && it->second.fd != fd) {
+        unwatch(token);
+        it = watches.end();
+    }
+    if (it != watches.end() && it->second.poll_id != 0) {
+        return true;
+    }
+    
+    if (backend == Backend::EPOLL) {
+        epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLONESHOT;
+        event.data.u64 = token;
+        // A fired one-shot stays registered, disabled, until it is re-armed or removed
+        int op = it != watches.end() ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (epoll_ctl(epoll_fd, op, fd, &event) != 0) {
+            return false;
+        }
+        watches[token] = {fd, 1};
+        return true;
+    }
+    
+    io_uring_sqe* sqe = nextSqe();
+    if (!sqe) {
+        return false;
+    }
+    uint64_t poll_id = next_poll_id++;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = poll_id;
+    watches[token] = {fd, poll_id};
+    poll_tokens[poll_id] = token;
+    return true;
+}
+
+void EventReactor::unwatch(uint64_t token) {
+    auto it = watches.find(token);
+    if (it == watches.end()) {
+        return;
+    }
+    
+    if (backend == Backend::EPOLL) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+    } else if (it->second.poll_id != 0) {
+        // Sent with the next wait; the ring holds its own reference to the file until then
+        poll_tokens.erase(it->second.poll_id);
+        if (io_uring_sqe* sqe = nextSqe()) {
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = it->second.poll_id;
+            sqe->user_data = 0;
+        }
+    }
+    watches.erase(it);
+}
+
+void EventReactor::wait(std::chrono::steady_clock::time_point deadline, std::vector<uint64_t>& ready) {
+    if (backend == Backend::IO_URING) {
+        waitRing(deadline, ready);
+    } else {
+        waitEpoll(deadline, ready);
+    }
+}
+
+void EventReactor::waitEpoll(std::chrono::steady_clock::time_point deadline, std::vector<uint64_t>& ready) {
+    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    int timeout = static_cast<int>(std::max<int64_t>(0, remaining.count()));
+    
+    epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+    for (int i = 0; i < count; i++) {
+        uint64_t token = events[i].data.u64;
+        auto it = watches.find(token);
+        if (it != watches.end()) {
+            it->second.poll_id = 0;
+            ready.push_back(token);
+        }
+    }
+}
+
+void EventReactor::waitRing(std::chrono::steady_clock::time_point deadline, std::vector<uint64_t>& ready) {
+    auto remaining = std::max(std::chrono::steady_clock::duration::zero(), deadline - std::chrono::steady_clock::now());
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(remaining);
+    __kernel_timespec timeout;
+    timeout.tv_sec = seconds.count();
+    timeout.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining - seconds).count();
+    
+    io_uring_getevents_arg arg;
+    std::memset(&arg, 0, sizeof(arg));
+    arg.ts = reinterpret_cast<uint64_t>(&timeout);
+    arg.sigmask_sz = _NSIG / 8;
+    
+    // Queued watches and removals go in with the wait itself; ETIME is the timeout expiring
+    unsigned to_submit = *ring.sq_tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+    int error = 0;
+    if (syscall(__NR_io_uring_enter, ring.fd, to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+                sizeof(arg)) < 0 && errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        error = errno;
+    }
+    
+    unsigned head = *ring.cq_head;
+    unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+    std::vector<uint64_t> failed;
+    for (; head != tail; head++) {
+        const io_uring_cqe& cqe = ring.cqes[head & *ring.cq_mask];
+        auto found = poll_tokens.find(cqe.user_data);
+        if (found == poll_tokens.end()) {
+            continue;
+        }
+        uint64_t token = found->second;
+        poll_tokens.erase(found);
+        auto it = watches.find(token);
+        if (it == watches.end() || it->second.poll_id != cqe.user_data) {
+            continue;
+        }
+        it->second.poll_id = 0;
+        if (cqe.res < 0) {
+            error = -cqe.res;
+            failed.push_back(token);
+        } else {
+            ready.push_back(token);
+        }
+    }
+    __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    
+    // A failed poll never saw its fd become readable, so it is armed again rather than reported
+    for (uint64_t token : failed) {
+        watch(watches[token].fd, token);
+    }
+    ring_failures = error ? ring_failures + 1 : 0;
+    if (ring_failures >= RING_FAILURE_LIMIT) {
+        fallBackToEpoll(error, ready);
+    }
+}
+
+// Armed watches move to epoll as they are; disarmed ones are forgotten so the next watch() adds them,
+// and ones epoll refuses are reported ready for the caller to look at itself
+void EventReactor::fallBackToEpoll(int error, std::vector<uint64_t>& ready) {
+    Logger::getInstance().warning("io_uring keeps failing (" + std::string(strerror(error)) +
+                                  "), switching to epoll");
+    int fd = epoll_create1(EPOLL_CLOEXEC);
+    if (fd == -1) {
+        Logger::getInstance().error("Could not create event loop: " + std::string(strerror(errno)));
+        ring_failures = 0;
+        return;
+    }
+    closeRing();
+    poll_tokens.clear();
+    epoll_fd = fd;
+    backend = Backend::EPOLL;
+    ring_failures = 0;
+    
+    for (auto it = watches.begin(); it != watches.end();) {
+        if (it->second.poll_id == 0) {
+            it = watches.erase(it);
+            continue;
+        }
+        epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLONESHOT;
+        event.data.u64 = it->first;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, it->second.fd, &event) != 0) {
+            ready.push_back(it->first);
+            it = watches.erase(it);
+            continue;
+        }
+        it->second.poll_id = 1;
+        ++it;
+    }
+}
+
+bool EventReactor::openRing() {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+    if (fd == -1) {
+        return false;
+    }
+    // EXT_ARG (5.11) carries the wait timeout without a timeout SQE, and implies SINGLE_MMAP
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        ::close(fd);
+        errno = ENOSYS;
+        return false;
+    }
+    
+    ring.fd = fd;
+    ring.sq_map_size = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                                params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    ring.sq_map = mmap(nullptr, ring.sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                       IORING_OFF_SQ_RING);
+    if (ring.sq_map == MAP_FAILED) {
+        ring.sq_map = nullptr;
+        closeRing();
+        return false;
+    }
+    ring.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, ring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                      IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        closeRing();
+        return false;
+    }
+    ring.sqes = static_cast<io_uring_sqe*>(sqes);
+    
+    char* sq = static_cast<char*>(ring.sq_map);
+    ring.sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    ring.sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring.sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring.sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    ring.cq_head = reinterpret_cast<unsigned*>(sq + params.cq_off.head);
+    ring.cq_tail = reinterpret_cast<unsigned*>(sq + params.cq_off.tail);
+    ring.cq_mask = reinterpret_cast<unsigned*>(sq + params.cq_off.ring_mask);
+    ring.cqes = reinterpret_cast<io_uring_cqe*>(sq + params.cq_off.cqes);
+    ring.entries = params.sq_entries;
+    return true;
+}
+
+void EventReactor::closeRing() {
+    if (ring.sqes) {
+        munmap(ring.sqes, ring.sqes_size);
+    }
+    if (ring.sq_map) {
+        munmap(ring.sq_map, ring.sq_map_size);
+    }
+    if (ring.fd != -1) {
+        ::close(ring.fd);
+    }
+    ring = Ring();
+}
+
+// Without SQPOLL the kernel only reads entries during io_uring_enter, so the tail can move first
+io_uring_sqe* EventReactor::nextSqe() {
+    unsigned tail = *ring.sq_tail;
+    if (tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) >= ring.entries) {
+        // Full: submit what is queued without waiting
+        syscall(__NR_io_uring_enter, ring.fd, ring.entries, 0, 0, nullptr, 0);
+        if (tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) >= ring.entries) {
+            return nullptr;
+        }
+    }
+    
+    unsigned index = tail & *ring.sq_mask;
+    ring.sq_array[index] = index;
+    io_uring_sqe* sqe = &ring.sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
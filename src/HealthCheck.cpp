@@ -0,0 +1,67 @@
+#include "../include/HealthCheck.hpp"
+#include <arpa/inet.h>
+
+namespace {
+
+bool parseHostPort(const std::string& value, std::string& host, int& port) {
+    size_t colon = value.rfind(':');
+    std::string port_text = colon == std::string::npos ? value : value.substr(colon + 1);
+    if (colon != std::string::npos) {
+        host = value.substr(0, colon);
+        bool bracketed = host.size() >= 2 && host.front() == '[' && host.back() == ']';
+        if (bracketed) {
+            host = host.substr(1, host.size() - 2);
+        } else if (host.find(':') != std::string::npos) {
+            return false;  // An IPv6 address needs brackets to be told apart from the port
+        }
+        if (host.empty() || host == "localhost") host = "127.0.0.1";
+    }
+    
+    // Probes connect without resolving, so a host name would only fail later, at every check
+    in6_addr address;
+    if (inet_pton(host.find(':') != std::string::npos ? AF_INET6 : AF_INET, host.c_str(), &address) != 1) {
+        return false;
+    }
+    
+    try {
+        size_t used = 0;
+        port = std::stoi(port_text, &used);
+        return used == port_text.size() && port > 0 && port < 65536;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+}
+
+bool HealthCheck::parse(const std::string& value, HealthCheckConfig& check) {
+    HealthCheckConfig parsed = check;
+    parsed.text = value;
+    
+    if (value.empty() || value == "none") {
+        parsed.type = HealthCheckType::NONE;
+    } else if (value.rfind("exec:", 0) == 0) {
+        parsed.type = HealthCheckType::EXEC;
+        parsed.command = value.substr(5);
+        if (parsed.command.empty()) return false;
+    } else if (value.rfind("tcp:", 0) == 0) {
+        parsed.type = HealthCheckType::TCP;
+        if (!parseHostPort(value.substr(4), parsed.host, parsed.port)) return false;
+    } else if (value.rfind("http:", 0) == 0) {
+        parsed.type = HealthCheckType::HTTP;
+        std::string rest = value.substr(5);
+        if (rest.rfind("//", 0) == 0) rest = rest.substr(2);
+        size_t slash = rest.find('/');
+        parsed.path = slash == std::string::npos ? "/" : rest.substr(slash);
+        if (!parseHostPort(rest.substr(0, slash), parsed.host, parsed.port)) return false;
+    } else if (value.rfind("unix:", 0) == 0) {
+        parsed.type = HealthCheckType::UNIX;
+        parsed.path = value.substr(5);
+        if (parsed.path.empty()) return false;
+    } else {
+        return false;
+    }
+    
+    check = parsed;
+    return true;
+}
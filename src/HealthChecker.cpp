@@ -0,0 +1,535 @@
+#include "../include/HealthChecker.hpp"
+#include "../include/Process.hpp"
+#include "../include/Logger.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+HealthChecker::HealthChecker() {
+}
+
+HealthChecker::~HealthChecker() {
+    stop();
+}
+
+void HealthChecker::start() {
+    if (running) return;
+    
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd == -1 || wake_fd == -1) {
+        Logger::getInstance().error("Could not create health check event loop: " + std::string(strerror(errno)));
+        return;
+    }
+    
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = WAKE_ID;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+    
+    running = true;
+    loop_thread = std::thread(&HealthChecker::loop, this);
+}
+
+void HealthChecker::stop() {
+    if (!running) return;
+    
+    running = false;
+    wake();
+    if (loop_thread.joinable()) {
+        loop_thread.join();
+    }
+    
+    std::lock_guard<std::mutex> lock(probes_mutex);
+    for (auto& [id, probe] : probes) {
+        if (probe.child != -1) {
+            kill(-probe.child, SIGKILL);
+            waitpid(probe.child, nullptr, 0);
+        }
+        if (probe.fd != -1) {
+            close(probe.fd);
+        }
+    }
+    probes.clear();
+    probe_ids.clear();
+    timers.clear();
+    close(epoll_fd);
+    close(wake_fd);
+    epoll_fd = wake_fd = -1;
+}
+
+void HealthChecker::wake() {
+    uint64_t one = 1;
+    ssize_t result = write(wake_fd, &one, sizeof(one));
+    (void)result;
+}
+
+void HealthChecker::setTargets(const std::map<std::string, std::shared_ptr<Process>>& processes) {
+    std::lock_guard<std::mutex> lock(probes_mutex);
+    auto now = Clock::now();
+    
+    auto retire = [this](uint64_t id) {
+        Probe& probe = probes[id];
+        probe_ids.erase(probe.name);
+        probe.removed = true;
+        if (probe.phase != Phase::IDLE) {
+            return;  // Dropped once the check in flight finishes
+        }
+        timers.erase({probe.timer, id});
+        if (probe.child == -1) {
+            probes.erase(id);
+        }
+    };
+    
+    std::set<std::string> configured;
+    for (const auto& [name, process] : processes) {
+        const HealthCheckConfig& check = process->getConfig().healthcheck;
+        if (!check.enabled()) continue;
+        configured.insert(name);
+        
+        auto existing = probe_ids.find(name);
+        if (existing != probe_ids.end()) {
+            Probe& probe = probes[existing->second];
+            if (probe.config == check) {
+                probe.process = process;
+                continue;
+            }
+            retire(existing->second);
+        }
+        
+        uint64_t id = next_id++;
+        Probe& probe = probes[id];
+        probe.name = name;
+        probe.process = process;
+        probe.config = check;
+        probe_ids[name] = id;
+        schedule(id, probe, now + std::chrono::seconds(check.interval));
+    }
+    
+    std::vector<uint64_t> obsolete;
+    for (const auto& [name, id] : probe_ids) {
+        if (configured.find(name) == configured.end()) {
+            obsolete.push_back(id);
+        }
+    }
+    for (uint64_t id : obsolete) {
+        retire(id);
+    }
+    
+    if (running) {
+        wake();
+    }
+}
+
+std::vector<std::string> HealthChecker::takeUnhealthy() {
+    std::lock_guard<std::mutex> lock(probes_mutex);
+    std::vector<std::string> result;
+    result.swap(unhealthy);
+    return result;
+}
+
+std::string HealthChecker::describe(const std::string& name) {
+    std::lock_guard<std::mutex> lock(probes_mutex);
+    auto it = probe_ids.find(name);
+    if (it == probe_ids.end()) {
+        return "";
+    }
+    
+    const Probe& probe = probes[it->second];
+    if (!probe.has_result) {
+        return "PENDING (" + probe.config.text + ")";
+    }
+    
+    auto age = std::chrono::duration_cast<std::chrono::seconds>(Clock::now() - probe.last_check).count();
+    if (probe.last_ok) {
+        return "OK (" + probe.config.text + ", " + std::to_string(age) + "s ago)";
+    }
+    return "FAILING " + std::to_string(probe.consecutive_failures) + "/" + std::to_string(probe.config.threshold) +
+           " (" + probe.last_message + ", " + std::to_string(age) + "s ago)";
+}
+
+bool HealthChecker::isPassing(const std::string& name, pid_t pid) {
+    std::lock_guard<std::mutex> lock(probes_mutex);
+    auto it = probe_ids.find(name);
+    if (it == probe_ids.end()) {
+        return true;
+    }
+    const Probe& probe = probes[it->second];
+    return probe.has_result && probe.last_ok && probe.result_pid == pid;
+}
+
+void HealthChecker::expedite(const std::string& name) {
+    std::lock_guard<std::mutex> lock(probes_mutex);
+    auto it = probe_ids.find(name);
+    if (it == probe_ids.end()) {
+        return;
+    }
+    Probe& probe = probes[it->second];
+    if (probe.phase == Phase::IDLE && probe.child == -1) {
+        schedule(it->second, probe, Clock::now());
+        if (running) {
+            wake();
+        }
+    }
+}
+
+bool HealthChecker::ownsChild(pid_t pid) {
+    std::lock_guard<std::mutex> lock(children_mutex);
+    return children.find(pid) != children.end();
+}
+
+void HealthChecker::loop() {
+    epoll_event events[64];
+    
+    while (running) {
+        int timeout_ms = 1000;
+        {
+            std::lock_guard<std::mutex> lock(probes_mutex);
+            if (!timers.empty()) {
+                auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(timers.begin()->first - Clock::now());
+                timeout_ms = static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(wait.count() + 1, 1000)));
+            }
+        }
+        
+        int count = epoll_wait(epoll_fd, events, 64, timeout_ms);
+        if (count == -1 && errno != EINTR) {
+            Logger::getInstance().error("Health check epoll_wait failed: " + std::string(strerror(errno)));
+            break;
+        }
+        
+        std::lock_guard<std::mutex> lock(probes_mutex);
+        for (int i = 0; i < count; ++i) {
+            uint64_t id = events[i].data.u64;
+            if (id == WAKE_ID) {
+                uint64_t value;
+                ssize_t result = read(wake_fd, &value, sizeof(value));
+                (void)result;
+                continue;
+            }
+            
+            auto it = probes.find(id);
+            if (it != probes.end()) {
+                handleEvent(id, it->second, events[i].events);
+            }
+        }
+        
+        auto now = Clock::now();
+        while (!timers.empty() && timers.begin()->first <= now) {
+            uint64_t id = timers.begin()->second;
+            timers.erase(timers.begin());
+            
+            auto it = probes.find(id);
+            if (it != probes.end()) {
+                fire(id, it->second, now);
+            }
+        }
+    }
+}
+
+void HealthChecker::schedule(uint64_t id, Probe& probe, Clock::time_point when) {
+    timers.erase({probe.timer, id});
+    probe.timer = when;
+    timers.insert({when, id});
+}
+
+void HealthChecker::fire(uint64_t id, Probe& probe, Clock::time_point now) {
+    if (probe.phase != Phase::IDLE) {
+        finish(id, probe, false, "timed out after " + std::to_string(probe.config.timeout) + "s");
+        return;
+    }
+    launch(id, probe, now);
+}
+
+void HealthChecker::launch(uint64_t id, Probe& probe, Clock::time_point now) {
+    auto interval = std::chrono::seconds(probe.config.interval);
+    std::shared_ptr<Process> process = probe.process.lock();
+    
+    // Only running instances past their start period are probed; anything else starts a fresh count
+    if (!process || process->getState() != ProcessState::RUNNING ||
+        process->getUptime().count() < process->getConfig().starttime) {
+        probe.consecutive_failures = 0;
+        schedule(id, probe, now + interval);
+        return;
+    }
+    if (process->getPid() != probe.target_pid) {
+        probe.target_pid = process->getPid();
+        probe.consecutive_failures = 0;
+    }
+    // A timed-out exec probe that has not been reaped yet
+    if (probe.child != -1) {
+        schedule(id, probe, now + interval);
+        return;
+    }
+    
+    probe.response.clear();
+    schedule(id, probe, now + std::chrono::seconds(probe.config.timeout));
+    if (probe.config.type == HealthCheckType::EXEC) {
+        launchExec(id, probe);
+    } else {
+        launchSocket(id, probe);
+    }
+}
+
+void HealthChecker::launchSocket(uint64_t id, Probe& probe) {
+    const HealthCheckConfig& check = probe.config;
+    bool is_unix = check.type == HealthCheckType::UNIX;
+    
+    sockaddr_storage storage;
+    std::memset(&storage, 0, sizeof(storage));
+    socklen_t length;
+    if (is_unix) {
+        sockaddr_un* addr = reinterpret_cast<sockaddr_un*>(&storage);
+        addr->sun_family = AF_UNIX;
+        std::strncpy(addr->sun_path, check.path.c_str(), sizeof(addr->sun_path) - 1);
+        length = sizeof(sockaddr_un);
+    } else if (check.host.find(':') != std::string::npos) {
+        sockaddr_in6* addr = reinterpret_cast<sockaddr_in6*>(&storage);
+        addr->sin6_family = AF_INET6;
+        addr->sin6_port = htons(static_cast<uint16_t>(check.port));
+        if (inet_pton(AF_INET6, check.host.c_str(), &addr->sin6_addr) != 1) {
+            finish(id, probe, false, "invalid address " + check.host);
+            return;
+        }
+        length = sizeof(sockaddr_in6);
+    } else {
+        sockaddr_in* addr = reinterpret_cast<sockaddr_in*>(&storage);
+        addr->sin_family = AF_INET;
+        addr->sin_port = htons(static_cast<uint16_t>(check.port));
+        if (inet_pton(AF_INET, check.host.c_str(), &addr->sin_addr) != 1) {
+            finish(id, probe, false, "invalid address " + check.host);
+            return;
+        }
+        length = sizeof(sockaddr_in);
+    }
+    
+    int fd = socket(storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        finish(id, probe, false, std::string("socket: ") + strerror(errno));
+        return;
+    }
+    
+    // Completion is reported as writability, including for sockets that connected immediately
+    if (connect(fd, reinterpret_cast<sockaddr*>(&storage), length) != 0 && errno != EINPROGRESS) {
+        std::string error = strerror(errno);
+        close(fd);
+        finish(id, probe, false, error);
+        return;
+    }
+    
+    probe.fd = fd;
+    probe.phase = Phase::CONNECTING;
+    watch(id, fd, EPOLLOUT, true);
+}
+
+void HealthChecker::launchExec(uint64_t id, Probe& probe) {
+    std::shared_ptr<Process> process = probe.process.lock();
+    std::string directory = process ? process->getConfig().workingdir : "/";
+    const char* argv[] = {"/bin/sh", "-c", probe.config.command.c_str(), nullptr};
+    
+    pid_t child;
+    {
+        // Registered before the orphan reaper can see the child exit
+        std::lock_guard<std::mutex> lock(children_mutex);
+        child = fork();
+        if (child == 0) {
+            setpgid(0, 0);
+            int devnull = open("/dev/null", O_RDWR);
+            if (devnull != -1) {
+                dup2(devnull, STDIN_FILENO);
+                dup2(devnull, STDOUT_FILENO);
+                dup2(devnull, STDERR_FILENO);
+            }
+            if (chdir(directory.c_str()) != 0) {
+                _exit(126);
+            }
+            execv("/bin/sh", const_cast<char* const*>(argv));
+            _exit(127);
+        }
+        if (child > 0) {
+            children.insert(child);
+        }
+    }
+    
+    if (child == -1) {
+        finish(id, probe, false, std::string("fork: ") + strerror(errno));
+        return;
+    }
+    setpgid(child, child);
+    
+    int pidfd = static_cast<int>(syscall(SYS_pidfd_open, child, 0));
+    if (pidfd == -1) {
+        std::string error = strerror(errno);
+        kill(child, SIGKILL);
+        waitpid(child, nullptr, 0);
+        std::lock_guard<std::mutex> lock(children_mutex);
+        children.erase(child);
+        finish(id, probe, false, "pidfd_open: " + error);
+        return;
+    }
+    
+    probe.child = child;
+    probe.fd = pidfd;
+    probe.phase = Phase::WAITING;
+    watch(id, pidfd, EPOLLIN, true);
+}
+
+void HealthChecker::handleEvent(uint64_t id, Probe& probe, uint32_t events) {
+    if (probe.fd == -1) {
+        return;
+    }
+    
+    if (probe.child != -1) {
+        int status = 0;
+        pid_t result = waitpid(probe.child, &status, WNOHANG);
+        if (result == 0) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(children_mutex);
+            children.erase(probe.child);
+        }
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, probe.fd, nullptr);
+        close(probe.fd);
+        probe.fd = -1;
+        probe.child = -1;
+        
+        if (probe.phase == Phase::WAITING) {
+            if (result == -1) {
+                finish(id, probe, false, "exit status lost");
+            } else if (WIFEXITED(status)) {
+                finish(id, probe, WEXITSTATUS(status) == 0, "exit " + std::to_string(WEXITSTATUS(status)));
+            } else {
+                finish(id, probe, false, "killed by signal " + std::to_string(WTERMSIG(status)));
+            }
+        } else if (probe.removed) {
+            probes.erase(id);
+        }
+        return;
+    }
+    
+    if (probe.phase == Phase::CONNECTING) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(probe.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+        if (error != 0) {
+            finish(id, probe, false, strerror(error));
+            return;
+        }
+        if (probe.config.type != HealthCheckType::HTTP) {
+            finish(id, probe, true, "connected");
+            return;
+        }
+        
+        std::string request = "GET " + probe.config.path + " HTTP/1.0\r\nHost: localhost\r\n"
+                              "User-Agent: taskmaster-healthcheck\r\nConnection: close\r\n\r\n";
+        if (send(probe.fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+            finish(id, probe, false, "request not sent");
+            return;
+        }
+        probe.phase = Phase::READING;
+        watch(id, probe.fd, EPOLLIN, false);
+        return;
+    }
+    
+    if (probe.phase == Phase::READING && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        char buffer[1024];
+        bool eof = false;
+        while (probe.response.size() < MAX_RESPONSE) {
+            ssize_t n = recv(probe.fd, buffer, sizeof(buffer), 0);
+            if (n > 0) {
+                probe.response.append(buffer, static_cast<size_t>(n));
+                continue;
+            }
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                eof = true;
+            }
+            break;
+        }
+        
+        // Only the status line matters
+        size_t line_end = probe.response.find("\r\n");
+        if (line_end == std::string::npos && !eof && probe.response.size() < MAX_RESPONSE) {
+            return;
+        }
+        
+        int code = 0;
+        if (probe.response.rfind("HTTP/", 0) == 0) {
+            size_t space = probe.response.find(' ');
+            if (space != std::string::npos) {
+                code = std::atoi(probe.response.c_str() + space + 1);
+            }
+        }
+        if (code == 0) {
+            finish(id, probe, false, "invalid HTTP response");
+        } else {
+            finish(id, probe, code >= 200 && code < 400, "HTTP " + std::to_string(code));
+        }
+    }
+}
+
+void HealthChecker::finish(uint64_t id, Probe& probe, bool ok, const std::string& message) {
+    timers.erase({probe.timer, id});
+    if (probe.child != -1) {
+        // The pidfd stays registered so the killed probe is still reaped
+        kill(-probe.child, SIGKILL);
+    } else {
+        release(probe);
+    }
+    probe.phase = Phase::IDLE;
+    
+    probe.has_result = true;
+    probe.result_pid = probe.target_pid;
+    probe.last_ok = ok;
+    probe.last_message = message;
+    probe.last_check = Clock::now();
+    
+    if (ok) {
+        probe.consecutive_failures = 0;
+    } else {
+        probe.consecutive_failures++;
+        Logger::getInstance().debug("Health check for " + probe.name + " failed: " + message);
+        // Reported on every failed check past the threshold until the instance is restarted
+        if (probe.consecutive_failures >= probe.config.threshold && !probe.removed) {
+            Logger::getInstance().warning("Process " + probe.name + " failed " +
+                                          std::to_string(probe.consecutive_failures) + " consecutive health checks (" +
+                                          message + ")");
+            if (std::find(unhealthy.begin(), unhealthy.end(), probe.name) == unhealthy.end()) {
+                unhealthy.push_back(probe.name);
+            }
+        }
+    }
+    
+    if (probe.removed) {
+        if (probe.child == -1) {
+            probes.erase(id);
+        }
+        return;
+    }
+    schedule(id, probe, probe.last_check + std::chrono::seconds(probe.config.interval));
+}
+
+void HealthChecker::watch(uint64_t id, int fd, uint32_t events, bool add) {
+    epoll_event ev = {};
+    ev.events = events;
+    ev.data.u64 = id;
+    epoll_ctl(epoll_fd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev);
+}
+
+void HealthChecker::release(Probe& probe) {
+    if (probe.fd != -1) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, probe.fd, nullptr);
+        close(probe.fd);
+        probe.fd = -1;
+    }
+}
@@ -0,0 +1,103 @@
+#include "../include/Lifecycle.hpp"
+#include "../include/Logger.hpp"
+
+LifecycleTask::~LifecycleTask() {
+    if (handle) {
+        handle.destroy();
+    }
+}
+
+LifecycleExecutor::LifecycleExecutor(std::function<Clock::time_point()> clock) : clock(std::move(clock)) {}
+
+LifecycleExecutor::~LifecycleExecutor() {
+    cancelAll();
+}
+
+bool LifecycleExecutor::spawn(const std::string& name, LifecycleTask task) {
+    if (has(name)) {
+        return false;
+    }
+    
+    uint64_t id = next_id++;
+    task.handle.promise().id = id;
+    tasks[id] = {name, task.handle};
+    by_name[name] = id;
+    task.handle = nullptr;
+    resume(id);
+    return true;
+}
+
+std::optional<LifecycleExecutor::Clock::time_point> LifecycleExecutor::nextDue() const {
+    if (timers.empty()) {
+        return std::nullopt;
+    }
+    return timers.top().due;
+}
+
+void LifecycleExecutor::runDue() {
+    // Timers armed by the lifecycles resumed here wait for the next call, even if already due
+    Clock::time_point until = now();
+    uint64_t armed_before = next_seq;
+    while (!timers.empty() && timers.top().due <= until && timers.top().seq < armed_before) {
+        Timer timer = timers.top();
+        timers.pop();
+        auto it = tasks.find(timer.id);
+        if (it != tasks.end() && it->second.armed_seq == timer.seq) {
+            resume(timer.id);
+        }
+    }
+}
+
+void LifecycleExecutor::wake(const std::string& name) {
+    auto found = by_name.find(name);
+    if (found == by_name.end()) {
+        return;
+    }
+    auto it = tasks.find(found->second);
+    if (it != tasks.end() && it->second.armed_seq != UINT64_MAX) {
+        schedule(it->first, now());
+    }
+}
+
+// Frames are destroyed where they stand, running the destructors of their locals
+void LifecycleExecutor::cancelAll() {
+    for (auto& [id, entry] : tasks) {
+        entry.handle.destroy();
+    }
+    tasks.clear();
+    by_name.clear();
+    timers = {};
+}
+
+void LifecycleExecutor::schedule(uint64_t id, Clock::time_point due) {
+    uint64_t seq = next_seq++;
+    tasks[id].armed_seq = seq;
+    timers.push({due, seq, id});
+}
+
+void LifecycleExecutor::resume(uint64_t id) {
+    auto it = tasks.find(id);
+    if (it == tasks.end()) {
+        return;
+    }
+    
+    auto handle = it->second.handle;
+    it->second.armed_seq = UINT64_MAX;
+    handle.resume();
+    if (!handle.done()) {
+        return;
+    }
+    
+    if (handle.promise().exception) {
+        try {
+            std::rethrow_exception(handle.promise().exception);
+        } catch (const std::exception& e) {
+            Logger::getInstance().error("Lifecycle of " + it->second.name + " failed: " + e.what());
+        } catch (...) {
+            Logger::getInstance().error("Lifecycle of " + it->second.name + " failed");
+        }
+    }
+    by_name.erase(it->second.name);
+    tasks.erase(it);
+    handle.destroy();
+}
@@ -0,0 +1,294 @@
+#include "../include/MetricsServer.hpp"
+#include "../include/SupervisorCounters.hpp"
+#include "../include/StateMachine.hpp"
+#include "../include/Logger.hpp"
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <algorithm>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+namespace {
+
+void appendf(std::string& buffer, const char* format, ...) {
+    char line[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length > 0) {
+        buffer.append(line, std::min(static_cast<size_t>(length), sizeof(line) - 1));
+    }
+}
+
+const char* const STATE_NAMES[] = {
+    "STOPPED", "STARTING", "RUNNING", "BACKOFF", "STOPPING", "EXITED", "FATAL", "UNKNOWN"
+};
+
+}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+bool MetricsServer::start(const SocketSpec& listen_spec) {
+    std::string error;
+    spec = listen_spec;
+    listen_fd = SocketUtils::createListener(spec, error);
+    if (listen_fd == -1) {
+        Logger::getInstance().error("Could not start metrics endpoint: " + error);
+        return false;
+    }
+    
+    running = true;
+    server_thread = std::thread(&MetricsServer::serve, this);
+    Logger::getInstance().info("Metrics endpoint listening on " + spec.toString());
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (!running) return;
+    
+    running = false;
+    if (server_thread.joinable()) {
+        server_thread.join();
+    }
+    close(listen_fd);
+    listen_fd = -1;
+    if (spec.family == SocketFamily::UNIX) {
+        unlink(spec.path.c_str());
+    }
+}
+
+void MetricsServer::publish(std::shared_ptr<const ProcessSampleSet> samples) {
+    std::atomic_store(&current, std::move(samples));
+}
+
+void MetricsServer::serve() {
+    while (running) {
+        pollfd pfd = {listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
+        
+        int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client_fd == -1) {
+            continue;
+        }
+        handleClient(client_fd);
+        close(client_fd);
+    }
+}
+
+void MetricsServer::handleClient(int client_fd) {
+    // Scrapers send a small request and wait; do not let a silent client hold the loop
+    timeval timeout = {0, 200000};
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    
+    char request[2048];
+    ssize_t received = recv(client_fd, request, sizeof(request) - 1, 0);
+    if (received <= 0) {
+        return;
+    }
+    request[received] = '\0';
+    
+    std::string& body = response_buffer;
+    std::string header;
+    if (std::strncmp(request, "GET /metrics", 12) == 0 || std::strncmp(request, "GET / ", 6) == 0) {
+        render(body);
+        header = "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n";
+    } else {
+        body = "Not Found\n";
+        header = "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\n";
+    }
+    header += "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+    
+    send(client_fd, header.data(), header.size(), MSG_NOSIGNAL);
+    size_t sent = 0;
+    while (sent < body.size()) {
+        ssize_t n = send(client_fd, body.data() + sent, body.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) break;
+        sent += static_cast<size_t>(n);
+    }
+}
+
+void MetricsServer::render(std::string& buffer) {
+    SupervisorCounters& counters = SupervisorCounters::getInstance();
+    SupervisorCounters::increment(counters.scrapes);
+    
+    std::shared_ptr<const ProcessSampleSet> samples = std::atomic_load(&current);
+    
+    buffer.clear();
+    buffer.reserve(last_render_size + last_render_size / 4);
+    
+    double uptime = std::chrono::duration<double>(std::chrono::steady_clock::now() - counters.started).count();
+    appendf(buffer, "# TYPE taskmaster_uptime_seconds gauge\ntaskmaster_uptime_seconds %.3f\n", uptime);
+    appendf(buffer, "# TYPE taskmaster_spawns counter\ntaskmaster_spawns_total %llu\n",
+            static_cast<unsigned long long>(counters.spawns.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_spawn_failures counter\ntaskmaster_spawn_failures_total %llu\n",
+            static_cast<unsigned long long>(counters.spawn_failures.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_exec_failures counter\ntaskmaster_exec_failures_total %llu\n",
+            static_cast<unsigned long long>(counters.exec_failures.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_startup_failures counter\ntaskmaster_startup_failures_total %llu\n",
+            static_cast<unsigned long long>(counters.startup_failures.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_stop_failures counter\ntaskmaster_stop_failures_total %llu\n",
+            static_cast<unsigned long long>(counters.stop_failures.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_exits counter\ntaskmaster_exits_total %llu\n",
+            static_cast<unsigned long long>(counters.exits.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_auto_restarts counter\ntaskmaster_auto_restarts_total %llu\n",
+            static_cast<unsigned long long>(counters.auto_restarts.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_spawns_deferred counter\ntaskmaster_spawns_deferred_total %llu\n",
+            static_cast<unsigned long long>(counters.spawns_deferred.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_spawn_deferred_seconds counter\ntaskmaster_spawn_deferred_seconds_total %.3f\n",
+            counters.spawn_deferred_ns.load(std::memory_order_relaxed) / 1e9);
+    appendf(buffer, "# TYPE taskmaster_spawns_waiting gauge\ntaskmaster_spawns_waiting %llu\n",
+            static_cast<unsigned long long>(counters.spawns_waiting.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_host_pressure_ratio gauge\ntaskmaster_host_pressure_ratio %.3f\n",
+            counters.pressure_permille.load(std::memory_order_relaxed) / 1000.0);
+    appendf(buffer, "# TYPE taskmaster_watchdog_actions counter\ntaskmaster_watchdog_actions_total %llu\n",
+            static_cast<unsigned long long>(counters.watchdog_actions.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_ready_notifications counter\ntaskmaster_ready_notifications_total %llu\n",
+            static_cast<unsigned long long>(counters.ready_notifications.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_ready_timeouts counter\ntaskmaster_ready_timeouts_total %llu\n",
+            static_cast<unsigned long long>(counters.ready_timeouts.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_keepalive_timeouts counter\ntaskmaster_keepalive_timeouts_total %llu\n",
+            static_cast<unsigned long long>(counters.keepalive_timeouts.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_activations counter\ntaskmaster_activations_total %llu\n",
+            static_cast<unsigned long long>(counters.activations.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_idle_stops counter\ntaskmaster_idle_stops_total %llu\n",
+            static_cast<unsigned long long>(counters.idle_stops.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_spare_promotions counter\ntaskmaster_spare_promotions_total %llu\n",
+            static_cast<unsigned long long>(counters.spare_promotions.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_readopted counter\ntaskmaster_readopted_total %llu\n",
+            static_cast<unsigned long long>(counters.readopted.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_rejected_transitions counter\ntaskmaster_rejected_transitions_total %llu\n",
+            static_cast<unsigned long long>(counters.rejected_transitions.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_monitor_cycles counter\ntaskmaster_monitor_cycles_total %llu\n",
+            static_cast<unsigned long long>(counters.monitor_cycles.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_samples counter\ntaskmaster_samples_total %llu\n",
+            static_cast<unsigned long long>(counters.samples.load(std::memory_order_relaxed)));
+    appendf(buffer, "# TYPE taskmaster_sample_duration_seconds gauge\ntaskmaster_sample_duration_seconds %.6f\n",
+            counters.last_sample_ns.load(std::memory_order_relaxed) / 1e9);
+    appendf(buffer, "# TYPE taskmaster_scrapes counter\ntaskmaster_scrapes_total %llu\n",
+            static_cast<unsigned long long>(counters.scrapes.load(std::memory_order_relaxed)));
+    
+    if (samples) {
+        appendf(buffer, "# TYPE taskmaster_managed_processes gauge\ntaskmaster_managed_processes %zu\n",
+                samples->size());
+        
+        appendf(buffer, "# TYPE taskmaster_process_state stateset\n");
+        for (const auto& sample : *samples) {
+            for (const char* state : STATE_NAMES) {
+                appendf(buffer, "taskmaster_process_state{name=\"%s\",program=\"%s\",taskmaster_process_state=\"%s\"} %d\n",
+                        sample.name.c_str(), sample.program.c_str(), state, sample.state == state ? 1 : 0);
+            }
+        }
+        
+        appendf(buffer, "# TYPE taskmaster_process_restarts counter\n");
+        for (const auto& sample : *samples) {
+            appendf(buffer, "taskmaster_process_restarts_total{name=\"%s\",program=\"%s\"} %d\n",
+                    sample.name.c_str(), sample.program.c_str(), sample.restarts);
+        }
+        
+        appendf(buffer, "# TYPE taskmaster_process_last_exit_code gauge\n");
+        for (const auto& sample : *samples) {
+            appendf(buffer, "taskmaster_process_last_exit_code{name=\"%s\",program=\"%s\"} %d\n",
+                    sample.name.c_str(), sample.program.c_str(), sample.last_exit_status);
+        }
+        
+        // Latency of the most recent start that reported readiness
+        appendf(buffer, "# TYPE taskmaster_process_ready_latency_seconds gauge\n");
+        for (const auto& sample : *samples) {
+            if (sample.ready_latency_seconds < 0) continue;
+            appendf(buffer, "taskmaster_process_ready_latency_seconds{name=\"%s\",program=\"%s\"} %.6f\n",
+                    sample.name.c_str(), sample.program.c_str(), sample.ready_latency_seconds);
+        }
+        
+        // Resource series only exist while the process is alive
+        appendf(buffer, "# TYPE taskmaster_process_uptime_seconds gauge\n");
+        for (const auto& sample : *samples) {
+            if (sample.pid <= 0) continue;
+            appendf(buffer, "taskmaster_process_uptime_seconds{name=\"%s\",program=\"%s\"} %.3f\n",
+                    sample.name.c_str(), sample.program.c_str(), sample.uptime_seconds);
+        }
+        
+        appendf(buffer, "# TYPE taskmaster_process_resident_memory_bytes gauge\n");
+        for (const auto& sample : *samples) {
+            if (sample.pid <= 0) continue;
+            appendf(buffer, "taskmaster_process_resident_memory_bytes{name=\"%s\",program=\"%s\"} %zu\n",
+                    sample.name.c_str(), sample.program.c_str(), sample.rss_bytes);
+        }
+        
+        appendf(buffer, "# TYPE taskmaster_process_cpu_seconds counter\n");
+        for (const auto& sample : *samples) {
+            if (sample.pid <= 0) continue;
+            appendf(buffer, "taskmaster_process_cpu_seconds_total{name=\"%s\",program=\"%s\"} %.2f\n",
+                    sample.name.c_str(), sample.program.c_str(), sample.cpu_seconds);
+        }
+        
+        appendf(buffer, "# TYPE taskmaster_process_cpu_usage_ratio gauge\n");
+        for (const auto& sample : *samples) {
+            if (sample.pid <= 0) continue;
+            appendf(buffer, "taskmaster_process_cpu_usage_ratio{name=\"%s\",program=\"%s\"} %.4f\n",
+                    sample.name.c_str(), sample.program.c_str(), sample.cpu_percent / 100.0);
+        }
+        
+        appendf(buffer, "# TYPE taskmaster_process_open_fds gauge\n");
+        for (const auto& sample : *samples) {
+            if (sample.pid <= 0) continue;
+            appendf(buffer, "taskmaster_process_open_fds{name=\"%s\",program=\"%s\"} %d\n",
+                    sample.name.c_str(), sample.program.c_str(), sample.file_descriptors);
+        }
+        
+        appendf(buffer, "# TYPE taskmaster_process_max_fds gauge\n");
+        for (const auto& sample : *samples) {
+            if (sample.pid <= 0 || sample.fd_limit == 0) continue;
+            appendf(buffer, "taskmaster_process_max_fds{name=\"%s\",program=\"%s\"} %zu\n",
+                    sample.name.c_str(), sample.program.c_str(), sample.fd_limit);
+        }
+        
+        appendf(buffer, "# TYPE taskmaster_process_tree_processes gauge\n");
+        for (const auto& sample : *samples) {
+            if (sample.pid <= 0) continue;
+            appendf(buffer, "taskmaster_process_tree_processes{name=\"%s\",program=\"%s\"} %d\n",
+                    sample.name.c_str(), sample.program.c_str(), sample.tree_processes);
+        }
+    }
+    
+    // Time spent in a state before each transition out of it; only transitions that happened are listed
+    appendf(buffer, "# TYPE taskmaster_state_duration_seconds histogram\n");
+    for (const auto& [program, timings] : StateTimings::getInstance().programs()) {
+        for (size_t from = 0; from < StateTimings::STATES; from++) {
+            for (size_t to = 0; to < StateTimings::STATES; to++) {
+                const auto& histogram = timings->transitions[from][to];
+                if (histogram.count.load(std::memory_order_relaxed) == 0) continue;
+                
+                unsigned long long cumulative = 0;
+                for (size_t i = 0; i <= StateTimings::BUCKETS; i++) {
+                    cumulative += histogram.buckets[i].load(std::memory_order_relaxed);
+                    char bound[32];
+                    if (i < StateTimings::BUCKETS) {
+                        snprintf(bound, sizeof(bound), "%g", static_cast<double>(StateTimings::BUCKET_BOUNDS_NS[i]) / 1e9);
+                    } else {
+                        snprintf(bound, sizeof(bound), "+Inf");
+                    }
+                    appendf(buffer, "taskmaster_state_duration_seconds_bucket{program=\"%s\",from=\"%s\",to=\"%s\",le=\"%s\"} %llu\n",
+                            program.c_str(), STATE_NAMES[from], STATE_NAMES[to], bound, cumulative);
+                }
+                appendf(buffer, "taskmaster_state_duration_seconds_sum{program=\"%s\",from=\"%s\",to=\"%s\"} %.6f\n",
+                        program.c_str(), STATE_NAMES[from], STATE_NAMES[to],
+                        static_cast<double>(histogram.sum_ns.load(std::memory_order_relaxed)) / 1e9);
+                appendf(buffer, "taskmaster_state_duration_seconds_count{program=\"%s\",from=\"%s\",to=\"%s\"} %llu\n",
+                        program.c_str(), STATE_NAMES[from], STATE_NAMES[to], cumulative);
+            }
+        }
+    }
+    
+    buffer += "# EOF\n";
+    last_render_size = buffer.size();
+}
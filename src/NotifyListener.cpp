@@ -0,0 +1,146 @@
+#include "../include/NotifyListener.hpp"
+#include "../include/Logger.hpp"
+#include <cstring>
+#include <cstddef>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+NotifyListener::~NotifyListener() {
+    stop();
+}
+
+bool NotifyListener::start(Handler message_handler, const std::string& socket_name, int inherited_fd) {
+    // Abstract namespace: nothing to clean up on disk and nothing left behind after a crash
+    std::string name = socket_name.empty() ? "taskmaster-notify-" + std::to_string(getpid()) : socket_name;
+    if (inherited_fd != -1) {
+        // Bound to the same name before the re-exec; anything queued meanwhile is still in it
+        socket_fd = inherited_fd;
+        fcntl(socket_fd, F_SETFD, FD_CLOEXEC);
+        path = "@" + name;
+        handler = std::move(message_handler);
+        running = true;
+        listener_thread = std::thread(&NotifyListener::serve, this);
+        Logger::getInstance().info("Readiness notifications accepted on " + path + " (inherited)");
+        return true;
+    }
+    
+    socket_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (socket_fd == -1) {
+        Logger::getInstance().error("Could not create notify socket: " + std::string(strerror(errno)));
+        return false;
+    }
+    
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path + 1, name.data(), name.size());
+    socklen_t addr_len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + name.size());
+    
+    int enable = 1;
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_PASSCRED, &enable, sizeof(enable)) != 0 ||
+        bind(socket_fd, reinterpret_cast<sockaddr*>(&addr), addr_len) != 0) {
+        Logger::getInstance().error("Could not bind notify socket @" + name + ": " + strerror(errno));
+        close(socket_fd);
+        socket_fd = -1;
+        return false;
+    }
+    
+    path = "@" + name;
+    handler = std::move(message_handler);
+    running = true;
+    listener_thread = std::thread(&NotifyListener::serve, this);
+    Logger::getInstance().info("Readiness notifications accepted on " + path);
+    return true;
+}
+
+int NotifyListener::release() {
+    if (!running) return -1;
+    
+    running = false;
+    if (listener_thread.joinable()) {
+        listener_thread.join();
+    }
+    int fd = socket_fd;
+    socket_fd = -1;
+    return fd;
+}
+
+void NotifyListener::stop() {
+    if (!running) return;
+    
+    running = false;
+    if (listener_thread.joinable()) {
+        listener_thread.join();
+    }
+    close(socket_fd);
+    socket_fd = -1;
+}
+
+void NotifyListener::serve() {
+    char buffer[MAX_MESSAGE];
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(ucred))];
+    
+    while (running) {
+        pollfd pfd = {socket_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
+        
+        // Drain everything queued; a burst of starts produces a burst of READY=1
+        while (true) {
+            iovec iov = {buffer, sizeof(buffer)};
+            msghdr msg;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            
+            ssize_t received = recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC);
+            if (received < 0) {
+                break;
+            }
+            
+            pid_t sender = -1;
+            for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                    // Descriptor passing (FDSTORE) is not supported; do not leak what was sent
+                    int* fds = reinterpret_cast<int*>(CMSG_DATA(cmsg));
+                    size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                    for (size_t i = 0; i < count; i++) {
+                        close(fds[i]);
+                    }
+                } else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_CREDENTIALS) {
+                    ucred credentials;
+                    std::memcpy(&credentials, CMSG_DATA(cmsg), sizeof(credentials));
+                    sender = credentials.pid;
+                }
+            }
+            
+            if (sender <= 0 || (msg.msg_flags & MSG_TRUNC)) {
+                continue;
+            }
+            handler(sender, parseMessage(buffer, static_cast<size_t>(received)));
+        }
+    }
+}
+
+std::map<std::string, std::string> NotifyListener::parseMessage(const char* data, size_t length) {
+    std::map<std::string, std::string> fields;
+    size_t start = 0;
+    while (start < length) {
+        const char* end = static_cast<const char*>(std::memchr(data + start, '\n', length - start));
+        size_t line_end = end ? static_cast<size_t>(end - data) : length;
+        
+        std::string line(data + start, line_end - start);
+        size_t eq_pos = line.find('=');
+        if (eq_pos != std::string::npos && eq_pos > 0) {
+            fields[line.substr(0, eq_pos)] = line.substr(eq_pos + 1);
+        }
+        start = line_end + 1;
+    }
+    return fields;
+}
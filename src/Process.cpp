@@ -1,66 +1,135 @@
 #include "../include/Process.hpp"
 #include "../include/Logger.hpp"
+#include "../include/SupervisorCounters.hpp"
+#include "../include/ProcessEvents.hpp"
+#include "../include/ZygotePool.hpp"
+#include "../include/StateJournal.hpp"
+#include "../include/StateIndex.hpp"
+#include <poll.h>
+#include <sys/socket.h>
 
-Process::Process(const ProcessConfig& config) 
-    : config(config), state(ProcessState::STOPPED), pid(-1), restart_count(0), last_exit_status(0) {
+std::string Process::notify_socket;
+ZygotePool* Process::zygote_pool = nullptr;
+StateJournal* Process::journal = nullptr;
+
+Process::Process(const ProcessConfig& config, const std::string& name) 
+    : config(config), name(name), state(ProcessState::STOPPED),
+      state_since(std::chrono::steady_clock::now().time_since_epoch().count()),
+      timings(StateTimings::getInstance().forProgram(config.name)), pid(-1), restart_count(0), last_exit_status(0), group_id(-1), health_check_failed(false),
+      ready(false), ready_latency(-1), last_keepalive(0), last_activity(0), last_failure(FailureKind::NONE),
+      spawn_error_permanent(false), config_fingerprint(StateJournal::fingerprint(config)), adopted_pidfd(-1) {
 }
 
 Process::~Process() {
-    if (state == ProcessState::RUNNING) {
+    if (isActive() && !detached) {
         stop();
     }
+    StateIndex::getInstance().detach(name, this);
+    int pidfd = adopted_pidfd.exchange(-1);
+    if (pidfd != -1) {
+        close(pidfd);
+    }
 }
 
 bool Process::start() {
-    if (state == ProcessState::RUNNING) {
+    if (isActive()) {
         return true;
     }
     
-    setState(ProcessState::STARTING);
+    // Refused while a stop is still in progress
+    if (!setState(ProcessState::STARTING, StateEvent::START)) {
+        return false;
+    }
+    health_check_failed = false;
+    ready = false;
+    setStatusText("");
     
+    // Taken before fork: a fast child can report READY=1 before executeCommand() returns
+    spawn_time = std::chrono::steady_clock::now();
     if (!executeCommand()) {
-        setState(ProcessState::FATAL);
+        // A config that can never exec goes straight to FATAL, anything else is retried by the monitor
+        bool permanent = spawn_error_permanent;
+        Logger::getInstance().error("Could not start " + name + ": " + getLastError() +
+                                    (permanent ? ", not retrying" : ""));
+        setState(permanent ? ProcessState::FATAL : ProcessState::BACKOFF, StateEvent::SPAWN_FAILED);
         return false;
     }
     
-    setState(ProcessState::RUNNING);
-    start_time = std::chrono::steady_clock::now();
+    start_time = spawn_time;
+    last_keepalive = spawn_time.time_since_epoch().count();
+    last_activity = spawn_time.time_since_epoch().count();
+    
+    // With readiness notification the instance stays STARTING until it sends READY=1
+    if (!config.notify_ready) {
+        setState(ProcessState::RUNNING, StateEvent::SPAWNED);
+    }
+    journalChild();
     return true;
 }
 
 bool Process::stop() {
-    if (state != ProcessState::RUNNING) {
+    if (!isActive()) {
         return true;
     }
     
-    setState(ProcessState::STOPPING);
+    std::chrono::steady_clock::time_point deadline;
+    if (!beginStop(deadline)) {
+        return false;
+    }
+    while (std::chrono::steady_clock::now() < deadline && hasSurvivors()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(STOP_POLL_MS));
+    }
+    return finishStop();
+}
+
+bool Process::beginStop(std::chrono::steady_clock::time_point& deadline) {
+    if (!setState(ProcessState::STOPPING, StateEvent::STOP)) {
+        return false;
+    }
     
-    if (killProcess(config.stopsignal)) {
-        for (int i = 0; i < config.stoptime; ++i) {
-            if (!isAlive()) {
-                setState(ProcessState::STOPPED);
-                pid = -1;
-                return true;
-            }
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-        }
-        
-        if (isAlive()) {
-            Logger::getInstance().warning("Process " + config.name + " did not stop gracefully, force killing...");
-            if (killProcess("KILL")) {
-                setState(ProcessState::STOPPED);
-                pid = -1;
-                return true;
-            }
+    if (!killProcess(config.stopsignal)) {
+        recordFailure(FailureKind::STOP, "could not signal PID " + std::to_string(pid) + ": " + strerror(errno));
+        SupervisorCounters::increment(SupervisorCounters::getInstance().stop_failures);
+        setState(ProcessState::FATAL, StateEvent::STOP_FAILED);
+        return false;
+    }
+    deadline = std::chrono::steady_clock::now() + std::chrono::seconds(config.stoptime);
+    return true;
+}
+
+bool Process::finishStop() {
+    if (!isAlive()) {
+        setState(ProcessState::STOPPED, StateEvent::STOPPED);
+        if (isGroupAlive()) {
+            Logger::getInstance().warning("Process " + config.name +
+                                          " left members of its process group running, force killing them...");
+            killProcessGroup(SIGKILL);
         }
+        clearChild();
+        return true;
     }
     
-    setState(ProcessState::FATAL);
-    return false;
+    Logger::getInstance().warning("Process " + config.name + " did not stop gracefully, force killing...");
+    if (!killProcess("KILL")) {
+        recordFailure(FailureKind::STOP, "could not signal PID " + std::to_string(pid) + ": " + strerror(errno));
+        SupervisorCounters::increment(SupervisorCounters::getInstance().stop_failures);
+        setState(ProcessState::FATAL, StateEvent::STOP_FAILED);
+        return false;
+    }
+    setState(ProcessState::STOPPED, StateEvent::STOPPED);
+    clearChild();
+    return true;
 }
 
-bool Process::restart() {
-    if (state == ProcessState::RUNNING) {
+bool Process::restart(bool allow_overlap) {
+    // Supervisor-owned sockets let the replacement accept before the old instance goes away
+    if (allow_overlap && state == ProcessState::RUNNING && hasListenSockets()) {
+        restart_count++;
+        last_restart = std::chrono::steady_clock::now();
+        return overlappedRestart();
+    }
+    
+    if (isActive()) {
         if (!stop()) {
             return false;
         }
@@ -72,8 +141,193 @@ bool Process::restart() {
     return start();
 }
 
+bool Process::isActive() const {
+    ProcessState current = state;
+    return current == ProcessState::RUNNING || (current == ProcessState::STARTING && pid > 0);
+}
+
+bool Process::markReady(std::chrono::steady_clock::time_point when) {
+    if (!transition(ProcessState::STARTING, ProcessState::RUNNING, StateEvent::READY)) {
+        return false;
+    }
+    
+    ready_latency = std::chrono::duration<double>(when - spawn_time).count();
+    ready = true;
+    last_keepalive = when.time_since_epoch().count();
+    journalChild();
+    return true;
+}
+
+void Process::touchKeepalive() {
+    last_keepalive = std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+bool Process::isKeepaliveOverdue() const {
+    if (config.notify_watchdog <= 0 || state != ProcessState::RUNNING) {
+        return false;
+    }
+    std::chrono::steady_clock::time_point last{std::chrono::steady_clock::duration(last_keepalive.load())};
+    return std::chrono::steady_clock::now() - last > std::chrono::seconds(config.notify_watchdog);
+}
+
+void Process::touchActivity() {
+    last_activity = std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+std::chrono::steady_clock::duration Process::getIdleTime() const {
+    std::chrono::steady_clock::time_point last{std::chrono::steady_clock::duration(last_activity.load())};
+    return std::chrono::steady_clock::now() - last;
+}
+
+void Process::setStatusText(const std::string& text) {
+    std::lock_guard<std::mutex> lock(status_mutex);
+    status_text = text;
+}
+
+std::string Process::getStatusText() const {
+    std::lock_guard<std::mutex> lock(status_mutex);
+    return status_text;
+}
+
+void Process::recordFailure(FailureKind kind, const std::string& detail) {
+    std::lock_guard<std::mutex> lock(status_mutex);
+    last_failure = kind;
+    last_error = detail;
+}
+
+std::string Process::getLastError() const {
+    std::lock_guard<std::mutex> lock(status_mutex);
+    return last_error;
+}
+
+const char* Process::failureName(FailureKind kind) {
+    switch (kind) {
+        case FailureKind::SPAWN: return "spawn";
+        case FailureKind::STARTUP: return "startup";
+        case FailureKind::RUNTIME: return "runtime";
+        case FailureKind::STOP: return "stop";
+        default: return "none";
+    }
+}
+
+bool Process::overlappedRestart() {
+    pid_t old_pid = pid;
+    pid_t old_group = group_id;
+    int old_pidfd = adopted_pidfd.exchange(-1);
+    auto old_start = start_time;
+    bool old_ready = ready;
+    
+    if (!setState(ProcessState::STARTING, StateEvent::RESTART)) {
+        adopted_pidfd = old_pidfd;
+        return false;
+    }
+    health_check_failed = false;
+    ready = false;
+    setStatusText("");
+    
+    spawn_time = std::chrono::steady_clock::now();
+    if (!executeCommand()) {
+        pid = old_pid;
+        group_id = old_group;
+        adopted_pidfd = old_pidfd;
+        setState(ProcessState::RUNNING, StateEvent::ROLLBACK);
+        return false;
+    }
+    start_time = spawn_time;
+    last_keepalive = spawn_time.time_since_epoch().count();
+    journalChild();
+    
+    if (!waitForStartup()) {
+        Logger::getInstance().warning("Replacement for " + name + " (PID: " + std::to_string(pid) +
+                                      ") failed to start, keeping PID " + std::to_string(old_pid));
+        kill(-group_id, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        pid = old_pid;
+        group_id = old_group;
+        adopted_pidfd = old_pidfd;
+        start_time = old_start;
+        ready = old_ready;
+        setState(ProcessState::RUNNING, StateEvent::ROLLBACK);
+        journalChild();
+        return false;
+    }
+    
+    setState(ProcessState::RUNNING, StateEvent::SPAWNED);
+    journalChild();
+    retire(old_pid, old_group, old_pidfd);
+    return true;
+}
+
+// The replacement is up once it reports READY=1, or once it has survived starttime without readiness
+bool Process::waitForStartup() {
+    int limit = config.notify_ready ? config.ready_timeout : config.starttime;
+    auto deadline = spawn_time + std::chrono::seconds(limit);
+    
+    while (true) {
+        if (config.notify_ready && state == ProcessState::RUNNING) {
+            return true;
+        }
+        
+        int status;
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            last_exit_status = WEXITSTATUS(status);
+            SupervisorCounters::increment(SupervisorCounters::getInstance().exits);
+            return false;
+        }
+        
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return !config.notify_ready;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(STOP_POLL_MS));
+    }
+}
+
+// Stops a superseded instance without touching the current state, which already belongs to its replacement
+void Process::retire(pid_t old_pid, pid_t old_group, int old_pidfd) {
+    kill(-old_group, signalNumber(config.stopsignal));
+    
+    bool exited = false;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(config.stoptime);
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (old_pidfd != -1) {
+            // Adopted from a previous supervisor: usually not our child, so only its pidfd tells
+            pollfd pfd = {old_pidfd, POLLIN, 0};
+            if (poll(&pfd, 1, 0) > 0) {
+                waitpid(old_pid, nullptr, WNOHANG);
+                exited = true;
+                break;
+            }
+        } else {
+            pid_t result = waitpid(old_pid, nullptr, WNOHANG);
+            // ECHILD: already collected by the orphan reaper
+            if (result == old_pid || (result == -1 && errno == ECHILD)) {
+                exited = true;
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(STOP_POLL_MS));
+    }
+    
+    if (!exited) {
+        Logger::getInstance().warning("Previous instance of " + name + " (PID: " + std::to_string(old_pid) +
+                                      ") did not stop gracefully, force killing...");
+        kill(-old_group, SIGKILL);
+        waitpid(old_pid, nullptr, old_pidfd != -1 ? WNOHANG : 0);
+    }
+    kill(-old_group, SIGKILL);
+    if (old_pidfd != -1) {
+        close(old_pidfd);
+    }
+    Logger::getInstance().info("Replaced " + name + " PID " + std::to_string(old_pid) + " with PID " +
+                               std::to_string(pid));
+}
+
 std::string Process::getStateString() const {
-    switch (state.load()) {
+    return stateName(state.load());
+}
+
+const char* Process::stateName(ProcessState state) {
+    switch (state) {
         case ProcessState::STOPPED: return "STOPPED";
         case ProcessState::STARTING: return "STARTING";
         case ProcessState::RUNNING: return "RUNNING";
@@ -92,31 +346,51 @@ bool Process::isAlive() {
     }
     
     int status;
-    pid_t result = waitpid(pid, &status, WNOHANG);
-    
-    if (result == pid) {
-        int exit_status = WEXITSTATUS(status);
-        last_exit_status = exit_status;
-        pid_t exited_pid = pid;
-        Logger::getInstance().logProcessStopped(config.name, exited_pid, exit_status);
-        pid = -1;
-        setState(ProcessState::EXITED);
-        return false;
-    } else if (result == 0) {
-        return true;
-    } else if (result == -1) {
-        if (errno == ECHILD) {
-            pid = -1;
-            setState(ProcessState::EXITED);
-            return false;
+    int exit_status;
+    if (adopted_pidfd != -1) {
+        // Readable once the child has exited; its status is only left to us if it is our own child
+        pollfd pfd = {adopted_pidfd, POLLIN, 0};
+        if (poll(&pfd, 1, 0) == 0) {
+            return true;
         }
-        if (kill(pid, 0) != 0) {
-            pid = -1;
-            return false;
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            exit_status = WEXITSTATUS(status);
+        } else {
+            exit_status = -1;
+            Logger::getInstance().info("Adopted process " + name + " (PID: " + std::to_string(pid) +
+                                       ") exited, exit status unknown");
         }
-        return true;
+    } else {
+        pid_t result = waitpid(pid, &status, WNOHANG);
+        if (result == 0) {
+            return true;
+        }
+        if (result == -1) {
+            if (errno == ECHILD) {
+                if (state != ProcessState::STOPPING) {
+                    setState(ProcessState::EXITED, StateEvent::EXITED);
+                }
+                clearChild();
+                return false;
+            }
+            if (kill(pid, 0) != 0) {
+                clearChild();
+                return false;
+            }
+            return true;
+        }
+        exit_status = WEXITSTATUS(status);
     }
     
+    last_exit_status = exit_status;
+    pid_t exited_pid = pid;
+    SupervisorCounters::increment(SupervisorCounters::getInstance().exits);
+    Logger::getInstance().logProcessStopped(config.name, exited_pid, exit_status);
+    // A stop in progress finishes the transition itself; the table would refuse EXITED anyway
+    if (state != ProcessState::STOPPING) {
+        setState(ProcessState::EXITED, StateEvent::EXITED);
+    }
+    clearChild();
     return false;
 }
 
@@ -135,39 +409,423 @@ bool Process::isExpectedExitCode(int exit_code) const {
 }
 
 bool Process::executeCommand() {
+    AffinityPlacement placement = CpuAffinity::resolvePlacement(config.affinity, config.process_num);
+    if (config.zygote && zygote_pool) {
+        return spawnFromZygote(placement);
+    }
+    
+    spawn_error_permanent = false;
+    int status_pipe[2];
+    if (pipe2(status_pipe, O_CLOEXEC) != 0) {
+        recordFailure(FailureKind::SPAWN, "status pipe: " + std::string(strerror(errno)));
+        SupervisorCounters::increment(SupervisorCounters::getInstance().spawn_failures);
+        return false;
+    }
+    
     pid_t child_pid = fork();
     
     if (child_pid == -1) {
         std::cerr << "Failed to fork process for " << config.name << ": " << strerror(errno) << std::endl;
+        recordFailure(FailureKind::SPAWN, "fork: " + std::string(strerror(errno)));
+        close(status_pipe[0]);
+        close(status_pipe[1]);
+        SupervisorCounters::increment(SupervisorCounters::getInstance().spawn_failures);
         return false;
     }
     
     if (child_pid == 0) {
-        setupChildProcess();
-        
-        auto tokens = parseCommand();
-        if (tokens.empty()) {
-            std::cerr << "Empty command for process " << config.name << std::endl;
-            exit(1);
+        close(status_pipe[0]);
+        // Above the LISTEN_FDS range so setupChildProcess() cannot overwrite it
+        int status_fd = fcntl(status_pipe[1], F_DUPFD_CLOEXEC, 3 + static_cast<int>(listen_fds.size()));
+        close(status_pipe[1]);
+        setupChildProcess(placement, status_fd);
+        execCommand(status_fd);
+    } else {
+        // Set from both sides so signals never race the child's own setpgid()
+        setpgid(child_pid, child_pid);
+        close(status_pipe[1]);
+        if (!collectSpawnStatus(child_pid, status_pipe[0])) {
+            return false;
         }
-        
-        std::vector<char*> args;
-        for (const auto& token : tokens) {
-            args.push_back(const_cast<char*>(token.c_str()));
+        pid = child_pid;
+        group_id = child_pid;
+        SupervisorCounters::increment(SupervisorCounters::getInstance().spawns);
+        return true;
+    }
+}
+
+void Process::execCommand(int status_fd) {
+    auto tokens = parseCommand();
+    if (tokens.empty()) {
+        std::cerr << "Empty command for process " << config.name << std::endl;
+        failChild(status_fd, SpawnStage::EXEC, EINVAL);
+    }
+    
+    std::vector<char*> args;
+    for (const auto& token : tokens) {
+        args.push_back(const_cast<char*>(token.c_str()));
+    }
+    args.push_back(nullptr);
+    
+    execvp(args[0], args.data());
+    
+    int error = errno;
+    std::cerr << "Failed to execute " << config.command << ": " << strerror(error) << std::endl;
+    failChild(status_fd, SpawnStage::EXEC, error);
+}
+
+void Process::failChild(int status_fd, SpawnStage stage, int error) {
+    if (status_fd != -1) {
+        SpawnReport report = {static_cast<int>(stage), error};
+        ssize_t written = write(status_fd, &report, sizeof(report));
+        (void)written;
+    }
+    _exit(1);
+}
+
+// Blocks until the child has exec'd (EOF, the pipe is CLOEXEC) or has reported why it could not
+bool Process::collectSpawnStatus(pid_t child, int status_fd) {
+    SpawnReport report;
+    ssize_t received;
+    do {
+        received = read(status_fd, &report, sizeof(report));
+    } while (received < 0 && errno == EINTR);
+    close(status_fd);
+    
+    if (received != static_cast<ssize_t>(sizeof(report))) {
+        return true;
+    }
+    
+    int status = 0;
+    waitpid(child, &status, 0);
+    last_exit_status = WEXITSTATUS(status);
+    spawn_error_permanent = isPermanentSpawnError(report.error);
+    recordFailure(FailureKind::SPAWN, describeStage(static_cast<SpawnStage>(report.stage)) + ": " +
+                  strerror(report.error));
+    SupervisorCounters::increment(SupervisorCounters::getInstance().exec_failures);
+    errno = report.error;
+    return false;
+}
+
+std::string Process::describeStage(SpawnStage stage) const {
+    switch (stage) {
+        case SpawnStage::CHDIR: return "chdir " + config.workingdir;
+        case SpawnStage::STDOUT_LOG: return "open " + config.stdout_logfile;
+        case SpawnStage::STDERR_LOG: return "open " + config.stderr_logfile;
+        default: {
+            auto tokens = parseCommand();
+            return "execve " + (tokens.empty() ? config.command : tokens[0]);
         }
-        args.push_back(nullptr);
+    }
+}
+
+// Errors that the next attempt would hit again; resource shortages and busy files are worth retrying
+bool Process::isPermanentSpawnError(int error) {
+    switch (error) {
+        case ENOENT:
+        case ENOTDIR:
+        case EACCES:
+        case EPERM:
+        case ENOEXEC:
+        case ELOOP:
+        case ENAMETOOLONG:
+        case EISDIR:
+        case EINVAL:
+        case EROFS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+pid_t Process::spawnSpare(int& gate_fd) {
+    int gate[2];
+    if (pipe2(gate, O_CLOEXEC) != 0) {
+        return -1;
+    }
+    
+    pid_t child_pid = fork();
+    if (child_pid == -1) {
+        close(gate[0]);
+        close(gate[1]);
+        SupervisorCounters::increment(SupervisorCounters::getInstance().spawn_failures);
+        return -1;
+    }
+    
+    if (child_pid == 0) {
+        close(gate[1]);
+        // Above the LISTEN_FDS range so setupChildProcess() cannot overwrite it
+        int count = static_cast<int>(listen_fds.size());
+        int held = fcntl(gate[0], F_DUPFD_CLOEXEC, 3 + count);
+        close(gate[0]);
         
-        execvp(args[0], args.data());
+        // Instance placement is applied by the supervisor on promotion, spares are not bound to one instance
+        setupChildProcess(AffinityPlacement());
+        
+        if (config.spare_gate_program) {
+            passDescriptor(held, 3 + count, "TASKMASTER_GATE_FD");
+        } else {
+            // This can wait indefinitely: drop every inherited descriptor, such as another spawn's
+            // status pipe, that would otherwise stay open until the spare is promoted
+            int gate_fd = 3 + count;
+            if (held != gate_fd) {
+                dup3(held, gate_fd, O_CLOEXEC);
+                close(held);
+            }
+            close_range(gate_fd + 1, ~0U, 0);
+            
+            char byte;
+            if (read(gate_fd, &byte, 1) != 1) {
+                _exit(0);  // Retired without being promoted
+            }
+            close(gate_fd);
+        }
+        execCommand();
+    }
+    
+    close(gate[0]);
+    setpgid(child_pid, child_pid);
+    gate_fd = gate[1];
+    SupervisorCounters::increment(SupervisorCounters::getInstance().spawns);
+    return child_pid;
+}
+
+bool Process::spawnFromZygote(const AffinityPlacement& placement) {
+    int gate_fd = -1;
+    std::string error;
+    spawn_error_permanent = false;
+    pid_t child_pid = zygote_pool->spawn(*this, gate_fd, error);
+    if (child_pid <= 0) {
+        // Permanent only when the template itself could not exec, see collectSpawnStatus()
+        recordFailure(FailureKind::SPAWN, "zygote: " + error);
+        SupervisorCounters::increment(SupervisorCounters::getInstance().spawn_failures);
+        return false;
+    }
+    
+    // Forked from the template, which has no placement of its own; numa_policy cannot be set from outside
+    if (!placement.cpus.empty() && !CpuAffinity::applyCpus(child_pid, placement.cpus)) {
+        Logger::getInstance().warning("Could not apply CPU placement to " + name + ": " + strerror(errno));
+    }
+    
+    pid = child_pid;
+    group_id = child_pid;
+    SupervisorCounters::increment(SupervisorCounters::getInstance().spawns);
+    ZygotePool::release(gate_fd);
+    return true;
+}
+
+pid_t Process::spawnZygote(int& control_fd) {
+    int channel[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, channel) != 0) {
+        return -1;
+    }
+    // Instances reply on the template's end; the kernel tells us which pid sent the reply
+    int enable = 1;
+    setsockopt(channel[0], SOL_SOCKET, SO_PASSCRED, &enable, sizeof(enable));
+    
+    int status_pipe[2];
+    if (pipe2(status_pipe, O_CLOEXEC) != 0) {
+        recordFailure(FailureKind::SPAWN, "status pipe: " + std::string(strerror(errno)));
+        close(channel[0]);
+        close(channel[1]);
+        return -1;
+    }
+    
+    pid_t child_pid = fork();
+    if (child_pid == -1) {
+        recordFailure(FailureKind::SPAWN, "fork: " + std::string(strerror(errno)));
+        close(channel[0]);
+        close(channel[1]);
+        close(status_pipe[0]);
+        close(status_pipe[1]);
+        SupervisorCounters::increment(SupervisorCounters::getInstance().spawn_failures);
+        return -1;
+    }
+    
+    if (child_pid == 0) {
+        close(channel[0]);
+        close(status_pipe[0]);
+        int count = static_cast<int>(listen_fds.size());
+        int held = fcntl(channel[1], F_DUPFD_CLOEXEC, 3 + count);
+        close(channel[1]);
+        int status_fd = fcntl(status_pipe[1], F_DUPFD_CLOEXEC, 3 + count + 1);
+        close(status_pipe[1]);
         
-        std::cerr << "Failed to execute " << config.command << ": " << strerror(errno) << std::endl;
-        exit(1);
+        setupChildProcess(AffinityPlacement(), status_fd);
+        passDescriptor(held, 3 + count, "TASKMASTER_ZYGOTE_FD");
+        execCommand(status_fd);
+    }
+    
+    close(channel[1]);
+    close(status_pipe[1]);
+    setpgid(child_pid, child_pid);
+    if (!collectSpawnStatus(child_pid, status_pipe[0])) {
+        close(channel[0]);
+        return -1;
+    }
+    control_fd = channel[0];
+    SupervisorCounters::increment(SupervisorCounters::getInstance().spawns);
+    return child_pid;
+}
+
+// Child side: hands a descriptor held above the LISTEN_FDS range to the exec'd program at a fixed number
+void Process::passDescriptor(int fd, int target, const char* variable) {
+    if (fd == target) {
+        fcntl(fd, F_SETFD, 0);
     } else {
-        pid = child_pid;
-        return true;
+        dup2(fd, target);
+        close(fd);
+    }
+    setenv(variable, std::to_string(target).c_str(), 1);
+}
+
+void Process::adoptSpare(pid_t child) {
+    restart_count++;
+    last_restart = std::chrono::steady_clock::now();
+    
+    setState(ProcessState::STARTING, StateEvent::START);
+    health_check_failed = false;
+    ready = false;
+    setStatusText("");
+    
+    spawn_time = std::chrono::steady_clock::now();
+    start_time = spawn_time;
+    last_keepalive = spawn_time.time_since_epoch().count();
+    last_activity = spawn_time.time_since_epoch().count();
+    pid = child;
+    group_id = child;
+    
+    if (!config.notify_ready) {
+        setState(ProcessState::RUNNING, StateEvent::SPAWNED);
+    }
+    journalChild();
+}
+
+void Process::adoptOrphan(pid_t child, pid_t group, int pidfd, ProcessState recovered_state,
+                          std::chrono::steady_clock::time_point started, int restarts, int exit_status) {
+    restart_count = restarts;
+    last_exit_status = exit_status;
+    health_check_failed = false;
+    ready = recovered_state == ProcessState::RUNNING;
+    setStatusText("");
+    
+    // Uptime and the ready_timeout carry on from the original spawn
+    spawn_time = started;
+    start_time = started;
+    auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+    last_keepalive = now;
+    last_activity = now;
+    pid = child;
+    group_id = group;
+    adopted_pidfd = pidfd;
+    
+    bool awaiting_ready = config.notify_ready && recovered_state == ProcessState::STARTING;
+    setState(awaiting_ready ? ProcessState::STARTING : ProcessState::RUNNING, StateEvent::ADOPT);
+    journalChild();
+}
+
+void Process::saveState(std::ostream& out) const {
+    auto single_line = [](std::string text) {
+        std::replace(text.begin(), text.end(), '\n', ' ');
+        return text;
+    };
+    out << "state " << static_cast<int>(state.load()) << "\n"
+        << "pid " << pid << "\n"
+        << "group " << group_id << "\n"
+        << "pidfd " << adopted_pidfd << "\n"
+        << "restarts " << restart_count << "\n"
+        << "exit " << last_exit_status << "\n"
+        << "spawn_time " << spawn_time.time_since_epoch().count() << "\n"
+        << "start_time " << start_time.time_since_epoch().count() << "\n"
+        << "last_restart " << last_restart.time_since_epoch().count() << "\n"
+        << "keepalive " << last_keepalive << "\n"
+        << "activity " << last_activity << "\n"
+        << "ready " << ready << "\n"
+        << "ready_latency " << ready_latency << "\n"
+        << "health_failed " << health_check_failed << "\n"
+        << "fingerprint " << config_fingerprint << "\n"
+        << "failure " << static_cast<int>(last_failure.load()) << "\n"
+        << "error " << single_line(getLastError()) << "\n"
+        << "status " << single_line(getStatusText()) << "\n"
+        << "state_since " << state_since << "\n";
+}
+
+// steady_clock is CLOCK_MONOTONIC, so the saved time points stay valid across execve
+void Process::restoreState(const std::map<std::string, std::string>& fields) {
+    auto field = [&fields](const std::string& key) {
+        auto it = fields.find(key);
+        return it == fields.end() ? std::string() : it->second;
+    };
+    auto number = [&field](const std::string& key, long long fallback) {
+        std::string value = field(key);
+        return value.empty() ? fallback : std::stoll(value);
+    };
+    auto time_point = [&number](const std::string& key) {
+        return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(number(key, 0)));
+    };
+    
+    restart_count = static_cast<int>(number("restarts", 0));
+    last_exit_status = static_cast<int>(number("exit", 0));
+    spawn_time = time_point("spawn_time");
+    start_time = time_point("start_time");
+    last_restart = time_point("last_restart");
+    last_keepalive = number("keepalive", 0);
+    last_activity = number("activity", 0);
+    ready = number("ready", 0) != 0;
+    ready_latency = field("ready_latency").empty() ? -1.0 : std::stod(field("ready_latency"));
+    health_check_failed = number("health_failed", 0) != 0;
+    recordFailure(static_cast<FailureKind>(number("failure", 0)), field("error"));
+    setStatusText(field("status"));
+    
+    pid_t child = static_cast<pid_t>(number("pid", -1));
+    if (child > 0) {
+        int pidfd = static_cast<int>(number("pidfd", -1));
+        if (pidfd != -1) {
+            fcntl(pidfd, F_SETFD, FD_CLOEXEC);
+        }
+        pid = child;
+        group_id = static_cast<pid_t>(number("group", child));
+        adopted_pidfd = pidfd;
+    }
+    setState(static_cast<ProcessState>(number("state", static_cast<int>(ProcessState::STOPPED))),
+             StateEvent::RESTORE);
+    state_since = number("state_since", state_since);
+    // A restored STOPPED instance makes no transition, but its restart count still changed
+    StateIndex::getInstance().refresh(*this);
+    if (child > 0) {
+        journalChild();
+    }
+}
+
+void Process::journalChild() {
+    if (!journal) {
+        return;
+    }
+    StateJournal::Entry entry;
+    entry.name = name;
+    entry.pid = pid;
+    entry.group = group_id;
+    entry.state = state;
+    entry.fingerprint = config_fingerprint;
+    entry.restart_count = restart_count;
+    entry.last_exit_status = last_exit_status;
+    journal->record(entry);
+}
+
+void Process::clearChild() {
+    pid_t previous = pid.exchange(-1);
+    int pidfd = adopted_pidfd.exchange(-1);
+    if (pidfd != -1) {
+        close(pidfd);
+    }
+    if (previous > 0) {
+        journalChild();
     }
 }
 
-void Process::setupChildProcess() {
+void Process::setupChildProcess(const AffinityPlacement& placement, int status_fd) {
+    setpgid(0, 0);
+    
     if (!config.stdout_logfile.empty()) {
         int stdout_fd;
         if (config.stdout_logfile == "/dev/null") {
@@ -175,10 +833,13 @@ void Process::setupChildProcess() {
         } else {
             stdout_fd = open(config.stdout_logfile.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
         }
-        if (stdout_fd != -1) {
-            dup2(stdout_fd, STDOUT_FILENO);
-            close(stdout_fd);
+        if (stdout_fd == -1) {
+            int error = errno;
+            std::cerr << "Failed to open stdout log " << config.stdout_logfile << ": " << strerror(error) << std::endl;
+            failChild(status_fd, SpawnStage::STDOUT_LOG, error);
         }
+        dup2(stdout_fd, STDOUT_FILENO);
+        close(stdout_fd);
     }
     
     if (!config.stderr_logfile.empty()) {
@@ -188,22 +849,56 @@ void Process::setupChildProcess() {
         } else {
             stderr_fd = open(config.stderr_logfile.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
         }
-        if (stderr_fd != -1) {
-            dup2(stderr_fd, STDERR_FILENO);
-            close(stderr_fd);
+        if (stderr_fd == -1) {
+            int error = errno;
+            std::cerr << "Failed to open stderr log " << config.stderr_logfile << ": " << strerror(error) << std::endl;
+            failChild(status_fd, SpawnStage::STDERR_LOG, error);
         }
+        dup2(stderr_fd, STDERR_FILENO);
+        close(stderr_fd);
     }
     
     if (chdir(config.workingdir.c_str()) != 0) {
+        int error = errno;
         std::cerr << "Failed to change directory to " << config.workingdir << std::endl;
-        exit(1);
+        failChild(status_fd, SpawnStage::CHDIR, error);
     }
     
     umask(config.umask);
     
+    if (!CpuAffinity::applyPlacement(config.affinity, placement)) {
+        std::cerr << "Failed to apply CPU/NUMA placement for " << config.name << ": " << strerror(errno) << std::endl;
+    }
+    
     for (const auto& [key, value] : config.environment) {
         setenv(key.c_str(), value.c_str(), 1);
     }
+    
+    if (!listen_fds.empty()) {
+        // Move the sockets above the target range first so dup2() never overwrites one still to be copied
+        int count = static_cast<int>(listen_fds.size());
+        std::vector<int> moved;
+        for (int fd : listen_fds) {
+            moved.push_back(fcntl(fd, F_DUPFD, 3 + count));
+        }
+        std::string names;
+        for (int i = 0; i < count; i++) {
+            dup2(moved[i], 3 + i);
+            close(moved[i]);
+            names += (i ? ":" : "") + config.name;
+        }
+        setenv("LISTEN_FDS", std::to_string(count).c_str(), 1);
+        setenv("LISTEN_PID", std::to_string(getpid()).c_str(), 1);
+        setenv("LISTEN_FDNAMES", names.c_str(), 1);
+    }
+    
+    if (!notify_socket.empty() && (config.notify_ready || config.notify_watchdog > 0)) {
+        setenv("NOTIFY_SOCKET", notify_socket.c_str(), 1);
+    }
+    if (config.notify_watchdog > 0) {
+        setenv("WATCHDOG_USEC", std::to_string(config.notify_watchdog * 1000000LL).c_str(), 1);
+        setenv("WATCHDOG_PID", std::to_string(getpid()).c_str(), 1);
+    }
 }
 
 std::vector<std::string> Process::parseCommand() const {
@@ -233,8 +928,41 @@ std::vector<std::string> Process::parseCommand() const {
     return tokens;
 }
 
-void Process::setState(ProcessState state) {
-    this->state = state;
+// Checked and applied in one compare-and-swap, so a change made concurrently is re-validated
+bool Process::setState(ProcessState new_state, StateEvent event) {
+    ProcessState previous = state;
+    do {
+        if (previous == new_state) {
+            return true;
+        }
+        if (!isAllowedTransition(previous, new_state, event)) {
+            SupervisorCounters::increment(SupervisorCounters::getInstance().rejected_transitions);
+            Logger::getInstance().debug("Process " + name + ": ignoring " + stateName(previous) + " -> " +
+                                        stateName(new_state) + " on " + stateEventName(event));
+            return false;
+        }
+    } while (!state.compare_exchange_weak(previous, new_state));
+    
+    recordTransition(previous, new_state);
+    return true;
+}
+
+// Only from the given state, so a READY=1 arriving while a stop is in progress cannot revive the instance
+bool Process::transition(ProcessState from, ProcessState to, StateEvent event) {
+    if (!isAllowedTransition(from, to, event) || !state.compare_exchange_strong(from, to)) {
+        return false;
+    }
+    recordTransition(from, to);
+    return true;
+}
+
+void Process::recordTransition(ProcessState from, ProcessState to) {
+    int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+    int64_t entered = state_since.exchange(now);
+    auto elapsed = std::chrono::steady_clock::duration(std::max<int64_t>(0, now - entered));
+    timings->record(from, to, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    StateIndex::getInstance().refresh(*this);
+    ProcessEvents::getInstance().publish(name, config.name, from, to, pid, last_exit_status);
 }
 
 bool Process::killProcess(const std::string& signal) {
@@ -242,29 +970,51 @@ bool Process::killProcess(const std::string& signal) {
         return false;
     }
     
-    int sig = SIGTERM;
+    int sig = signalNumber(signal);
     
-    if (signal == "TERM") {
-        sig = SIGTERM;
-    } else if (signal == "KILL") {
-        sig = SIGKILL;
+    if (kill(-pid, sig) == 0 || kill(pid, sig) == 0) {
+        return true;
+    } else {
+        std::cerr << "Failed to send signal " << signal << " to process " << pid 
+                  << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+}
+
+int Process::signalNumber(const std::string& signal) {
+    if (signal == "KILL") {
+        return SIGKILL;
     } else if (signal == "INT") {
-        sig = SIGINT;
+        return SIGINT;
     } else if (signal == "QUIT") {
-        sig = SIGQUIT;
+        return SIGQUIT;
     } else if (signal == "HUP") {
-        sig = SIGHUP;
+        return SIGHUP;
     } else if (signal == "USR1") {
-        sig = SIGUSR1;
+        return SIGUSR1;
     } else if (signal == "USR2") {
-        sig = SIGUSR2;
+        return SIGUSR2;
     }
-    
-    if (kill(pid, sig) == 0) {
-        return true;
-    } else {
-        std::cerr << "Failed to send signal " << signal << " to process " << pid 
-                  << ": " << strerror(errno) << std::endl;
+    return SIGTERM;
+}
+
+bool Process::hasSurvivors() {
+    return isAlive() || isGroupAlive();
+}
+
+bool Process::isGroupAlive() {
+    if (group_id <= 0) {
         return false;
     }
+    // Members orphaned to us as subreaper still count until their zombies are reaped
+    while (waitpid(-group_id, nullptr, WNOHANG) > 0) {
+    }
+    return kill(-group_id, 0) == 0;
+}
+
+void Process::killProcessGroup(int sig) {
+    // Leftover members of the group once the leader itself has been reaped
+    if (group_id > 0) {
+        kill(-group_id, sig);
+    }
 }
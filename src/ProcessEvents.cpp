@@ -0,0 +1,157 @@
+#include "../include/ProcessEvents.hpp"
+#include <algorithm>
+#include <sstream>
+#include <fnmatch.h>
+#include <time.h>
+
+EventSubscription::EventSubscription(const std::string& pattern, std::vector<ProcessState> types, size_t capacity,
+                                     std::function<void()> notify)
+    : pattern(pattern.empty() ? "*" : pattern), types(std::move(types)),
+      capacity(std::max<size_t>(1, capacity)), notify(std::move(notify)) {
+}
+
+bool EventSubscription::matches(const ProcessEvent& event) const {
+    if (!types.empty() && std::find(types.begin(), types.end(), event.to) == types.end()) {
+        return false;
+    }
+    return fnmatch(pattern.c_str(), event.name.c_str(), 0) == 0 ||
+           fnmatch(pattern.c_str(), event.program.c_str(), 0) == 0;
+}
+
+void EventSubscription::push(const ProcessEvent& event) {
+    bool was_empty;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (queue.size() >= capacity) {
+            if (overflow.dropped++ == 0) {
+                overflow.seq = event.seq;
+                overflow.timestamp_ns = event.timestamp_ns;
+            }
+            return;
+        }
+        
+        was_empty = queue.empty();
+        // Room again after an overflow: the marker goes where the lost events would have been
+        if (overflow.isOverflow()) {
+            queue.push_back(overflow);
+            overflow = ProcessEvent();
+        }
+        queue.push_back(event);
+    }
+    
+    if (was_empty && notify) {
+        notify();
+    }
+}
+
+size_t EventSubscription::drain(std::vector<ProcessEvent>& out, size_t max) {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    size_t taken = 0;
+    while (taken < max && !queue.empty()) {
+        out.push_back(std::move(queue.front()));
+        queue.pop_front();
+        taken++;
+    }
+    if (taken < max && queue.empty() && overflow.isOverflow()) {
+        out.push_back(overflow);
+        overflow = ProcessEvent();
+        taken++;
+    }
+    return taken;
+}
+
+ProcessEvents& ProcessEvents::getInstance() {
+    static ProcessEvents instance;
+    return instance;
+}
+
+std::shared_ptr<EventSubscription> ProcessEvents::subscribe(const std::string& pattern, std::vector<ProcessState> types,
+                                                            size_t capacity, std::function<void()> notify) {
+    auto subscription = std::make_shared<EventSubscription>(pattern, std::move(types), capacity, std::move(notify));
+    std::lock_guard<std::mutex> lock(subscribers_mutex);
+    subscribers.push_back(subscription);
+    return subscription;
+}
+
+void ProcessEvents::unsubscribe(const std::shared_ptr<EventSubscription>& subscription) {
+    std::lock_guard<std::mutex> lock(subscribers_mutex);
+    subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), subscription), subscribers.end());
+}
+
+void ProcessEvents::publish(const std::string& name, const std::string& program, ProcessState from, ProcessState to,
+                            pid_t pid, int exit_status) {
+    std::lock_guard<std::mutex> lock(subscribers_mutex);
+    // Sequence numbers are handed out under the lock so every subscriber sees the same order
+    uint64_t seq = next_seq++;
+    if (subscribers.empty()) {
+        return;
+    }
+    
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    ProcessEvent event;
+    event.seq = seq;
+    event.timestamp_ns = static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+    event.name = name;
+    event.program = program;
+    event.from = from;
+    event.to = to;
+    event.pid = pid;
+    event.exit_status = exit_status;
+    
+    for (const auto& subscriber : subscribers) {
+        if (subscriber->matches(event)) {
+            subscriber->push(event);
+        }
+    }
+}
+
+bool ProcessEvents::parseTypes(const std::string& value, std::vector<ProcessState>& types) {
+    static const ProcessState all_states[] = {
+        ProcessState::STOPPED, ProcessState::STARTING, ProcessState::RUNNING, ProcessState::BACKOFF,
+        ProcessState::STOPPING, ProcessState::EXITED, ProcessState::FATAL, ProcessState::UNKNOWN
+    };
+    
+    types.clear();
+    if (value.empty() || value == "all" || value == "*") {
+        return true;
+    }
+    
+    std::istringstream iss(value);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        std::transform(item.begin(), item.end(), item.begin(), ::toupper);
+        bool found = false;
+        for (ProcessState state : all_states) {
+            if (item == Process::stateName(state)) {
+                types.push_back(state);
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string ProcessEvents::format(const ProcessEvent& event) {
+    char timestamp[32];
+    snprintf(timestamp, sizeof(timestamp), "%llu.%09llu",
+             static_cast<unsigned long long>(event.timestamp_ns / 1000000000ULL),
+             static_cast<unsigned long long>(event.timestamp_ns % 1000000000ULL));
+    
+    std::string line;
+    if (event.isOverflow()) {
+        line = "overflow seq=" + std::to_string(event.seq) + " time=" + timestamp +
+               " dropped=" + std::to_string(event.dropped);
+    } else {
+        line = "event seq=" + std::to_string(event.seq) + " time=" + timestamp +
+               " name=" + event.name + " program=" + event.program +
+               " from=" + Process::stateName(event.from) + " to=" + Process::stateName(event.to) +
+               " pid=" + std::to_string(event.pid) + " exit=" + std::to_string(event.exit_status);
+    }
+    return line + "\n";
+}
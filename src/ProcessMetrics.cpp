@@ -6,6 +6,7 @@
 #include <cstdlib>
 #include <signal.h>
 #include <iostream>
+#include <sys/resource.h>
 
 ProcessMetrics MetricsCollector::collectMetrics(pid_t pid) {
     ProcessMetrics metrics;
@@ -26,10 +27,141 @@ ProcessMetrics MetricsCollector::collectMetrics(pid_t pid) {
     metrics.memory_peak_mb = peak_bytes / (1024 * 1024);
     
     metrics.file_descriptors = countFileDescriptors(pid);
+    metrics.fd_limit = readFileDescriptorLimit(pid);
+    metrics.process_count = 1;
     
     return metrics;
 }
 
+ProcessMetrics MetricsCollector::collectMetrics(pid_t pid, const ProcessTreeSnapshot& snapshot) {
+    ProcessMetrics metrics;
+    
+    if (pid <= 0 || !snapshot.find(pid)) {
+        return metrics;
+    }
+    
+    size_t memory_bytes = 0;
+    size_t peak_bytes = 0;
+    for (pid_t member : snapshot.subtree(pid)) {
+        const ProcStatEntry* entry = snapshot.find(member);
+        if (entry->state == 'Z') {
+            continue;
+        }
+        memory_bytes += entry->rss_bytes;
+        peak_bytes += readMemoryPeak(member);
+        metrics.cpu_ticks += entry->cpu_ticks;
+        metrics.file_descriptors += countFileDescriptors(member);
+        metrics.process_count++;
+    }
+    
+    metrics.memory_usage_mb = memory_bytes / (1024 * 1024);
+    metrics.memory_peak_mb = peak_bytes / (1024 * 1024);
+    metrics.fd_limit = readFileDescriptorLimit(pid);
+    
+    return metrics;
+}
+
+ProcessTreeSnapshot ProcessTreeSnapshot::capture() {
+    ProcessTreeSnapshot snapshot;
+    
+    DIR* dir = opendir("/proc");
+    if (!dir) {
+        return snapshot;
+    }
+    
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        char* end = nullptr;
+        long pid = std::strtol(entry->d_name, &end, 10);
+        if (pid <= 0 || *end != '\0') {
+            continue;
+        }
+        
+        ProcStatEntry stat_entry;
+        if (readStat(static_cast<pid_t>(pid), stat_entry)) {
+            snapshot.children[stat_entry.ppid].push_back(stat_entry.pid);
+            snapshot.entries[stat_entry.pid] = stat_entry;
+        }
+    }
+    closedir(dir);
+    
+    return snapshot;
+}
+
+const ProcStatEntry* ProcessTreeSnapshot::find(pid_t pid) const {
+    auto it = entries.find(pid);
+    return it != entries.end() ? &it->second : nullptr;
+}
+
+std::vector<pid_t> ProcessTreeSnapshot::subtree(pid_t root) const {
+    std::vector<pid_t> result;
+    if (!find(root)) {
+        return result;
+    }
+    
+    result.push_back(root);
+    for (size_t i = 0; i < result.size(); ++i) {
+        auto it = children.find(result[i]);
+        if (it != children.end()) {
+            result.insert(result.end(), it->second.begin(), it->second.end());
+        }
+    }
+    return result;
+}
+
+std::vector<pid_t> ProcessTreeSnapshot::zombieChildrenOf(pid_t parent) const {
+    std::vector<pid_t> result;
+    auto it = children.find(parent);
+    if (it == children.end()) {
+        return result;
+    }
+    
+    for (pid_t child : it->second) {
+        const ProcStatEntry* entry = find(child);
+        if (entry && entry->state == 'Z') {
+            result.push_back(child);
+        }
+    }
+    return result;
+}
+
+bool ProcessTreeSnapshot::readStat(pid_t pid, ProcStatEntry& entry) {
+    std::ifstream stat_file("/proc/" + std::to_string(pid) + "/stat");
+    std::string content;
+    if (!stat_file.is_open() || !std::getline(stat_file, content)) {
+        return false;
+    }
+    
+    // The command name may contain spaces and parentheses; fields restart after the last ')'
+    size_t paren = content.rfind(')');
+    if (paren == std::string::npos || paren + 2 >= content.size()) {
+        return false;
+    }
+    
+    std::istringstream iss(content.substr(paren + 2));
+    std::string field;
+    unsigned long long utime = 0, stime = 0;
+    long rss_pages = 0;
+    
+    entry.pid = pid;
+    for (int i = 3; i <= 24 && (iss >> field); ++i) {
+        switch (i) {
+            case 3:  entry.state = field[0]; break;
+            case 4:  entry.ppid = static_cast<pid_t>(std::stol(field)); break;
+            case 5:  entry.pgid = static_cast<pid_t>(std::stol(field)); break;
+            case 14: utime = std::stoull(field); break;
+            case 15: stime = std::stoull(field); break;
+            case 24: rss_pages = std::stol(field); break;
+            default: break;
+        }
+    }
+    
+    static const long page_size = sysconf(_SC_PAGESIZE);
+    entry.cpu_ticks = utime + stime;
+    entry.rss_bytes = rss_pages > 0 ? static_cast<size_t>(rss_pages) * page_size : 0;
+    return true;
+}
+
 size_t MetricsCollector::readMemoryUsage(pid_t pid) {
     std::ifstream status_file("/proc/" + std::to_string(pid) + "/status");
     if (!status_file.is_open()) {
@@ -84,6 +216,14 @@ int MetricsCollector::countFileDescriptors(pid_t pid) {
     return count;
 }
 
+size_t MetricsCollector::readFileDescriptorLimit(pid_t pid) {
+    struct rlimit limit;
+    if (prlimit(pid, RLIMIT_NOFILE, nullptr, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY) {
+        return 0;
+    }
+    return static_cast<size_t>(limit.rlim_cur);
+}
+
 std::string MetricsCollector::formatUptime(const std::chrono::steady_clock::time_point& start_time) {
     auto now = std::chrono::steady_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - start_time);
@@ -0,0 +1,128 @@
+#include "../include/SocketRegistry.hpp"
+#include "../include/Logger.hpp"
+#include <unistd.h>
+
+SocketRegistry::~SocketRegistry() {
+    closeAll();
+}
+
+bool SocketRegistry::assign(const std::string& instance, const ProcessConfig& config, std::vector<int>& fds,
+                            std::string& error) {
+    std::lock_guard<std::mutex> lock(sockets_mutex);
+    fds.clear();
+    
+    std::set<std::string> keys;
+    bool ok = true;
+    for (const auto& spec : config.listen) {
+        bool exclusive;
+        std::string key = keyFor(config, spec, exclusive);
+        
+        auto it = sockets.find(key);
+        if (it == sockets.end()) {
+            std::string bind_error;
+            int fd = SocketUtils::createListener(spec, bind_error, config.listen_backlog, exclusive, false);
+            if (fd == -1) {
+                error = bind_error;
+                ok = false;
+                continue;
+            }
+            Entry entry;
+            entry.spec = spec;
+            entry.fd = fd;
+            entry.exclusive = exclusive;
+            it = sockets.emplace(key, entry).first;
+            Logger::getInstance().info("Bound " + spec.toString() + " for " + instance +
+                                       (exclusive ? " (SO_REUSEPORT)" : ""));
+        }
+        
+        it->second.users.insert(instance);
+        keys.insert(key);
+        fds.push_back(it->second.fd);
+    }
+    
+    drop(instance, keys, false);
+    return ok;
+}
+
+void SocketRegistry::adopt(const std::string& instance, const ProcessConfig& config, std::vector<int>& fds) {
+    std::lock_guard<std::mutex> lock(sockets_mutex);
+    for (size_t i = 0; i < fds.size() && i < config.listen.size(); i++) {
+        bool exclusive;
+        std::string key = keyFor(config, config.listen[i], exclusive);
+        
+        auto it = sockets.find(key);
+        if (it == sockets.end()) {
+            Entry entry;
+            entry.spec = config.listen[i];
+            entry.fd = fds[i];
+            entry.exclusive = exclusive;
+            it = sockets.emplace(key, entry).first;
+            Logger::getInstance().info("Recovered " + entry.spec.toString() + " from " + instance);
+        } else if (it->second.fd != fds[i]) {
+            // Another copy of a socket a sibling instance already handed back
+            close(fds[i]);
+            fds[i] = it->second.fd;
+        }
+        it->second.users.insert(instance);
+    }
+}
+
+void SocketRegistry::release(const std::string& instance) {
+    std::lock_guard<std::mutex> lock(sockets_mutex);
+    drop(instance, {}, false);
+}
+
+std::vector<int> SocketRegistry::releaseExclusive(const std::string& instance) {
+    std::lock_guard<std::mutex> lock(sockets_mutex);
+    return drop(instance, {}, true);
+}
+
+void SocketRegistry::closeAll() {
+    std::lock_guard<std::mutex> lock(sockets_mutex);
+    for (auto& [key, entry] : sockets) {
+        closeEntry(entry);
+    }
+    sockets.clear();
+}
+
+std::vector<int> SocketRegistry::drop(const std::string& instance, const std::set<std::string>& keep,
+                                      bool exclusive_only) {
+    std::vector<int> closed;
+    for (auto it = sockets.begin(); it != sockets.end();) {
+        Entry& entry = it->second;
+        if (keep.count(it->first) || (exclusive_only && !entry.exclusive)) {
+            ++it;
+            continue;
+        }
+        
+        entry.users.erase(instance);
+        if (entry.users.empty()) {
+            Logger::getInstance().info("Closing " + entry.spec.toString() + " (no instance left)");
+            closed.push_back(entry.fd);
+            closeEntry(entry);
+            it = sockets.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return closed;
+}
+
+std::string SocketRegistry::keyFor(const ProcessConfig& config, const SocketSpec& spec, bool& exclusive) {
+    exclusive = config.numprocs > 1 && spec.family == SocketFamily::TCP;
+    std::string key = config.name + " " + spec.toString();
+    if (exclusive) {
+        key += "#" + std::to_string(config.process_num);
+    }
+    return key;
+}
+
+void SocketRegistry::closeEntry(Entry& entry) {
+    if (entry.fd != -1) {
+        close(entry.fd);
+        entry.fd = -1;
+    }
+    if (entry.spec.family == SocketFamily::UNIX) {
+        unlink(entry.spec.path.c_str());
+    }
+}
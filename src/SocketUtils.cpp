@@ -0,0 +1,129 @@
+#include "../include/SocketUtils.hpp"
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+std::string SocketSpec::toString() const {
+    if (family == SocketFamily::UNIX) {
+        return "unix:" + path;
+    }
+    return "tcp:" + host + ":" + std::to_string(port);
+}
+
+bool SocketUtils::parseSpec(const std::string& value, SocketSpec& spec) {
+    std::string rest = value;
+    
+    if (rest.rfind("unix:", 0) == 0 || (!rest.empty() && rest[0] == '/')) {
+        spec.family = SocketFamily::UNIX;
+        spec.path = rest.rfind("unix:", 0) == 0 ? rest.substr(5) : rest;
+        return !spec.path.empty() && spec.path.size() < sizeof(sockaddr_un::sun_path);
+    }
+    
+    if (rest.rfind("tcp:", 0) == 0) {
+        rest = rest.substr(4);
+    }
+    
+    size_t colon = rest.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    
+    spec.family = SocketFamily::TCP;
+    spec.host = rest.substr(0, colon);
+    if (spec.host.empty()) {
+        spec.host = "127.0.0.1";
+    }
+    try {
+        spec.port = std::stoi(rest.substr(colon + 1));
+    } catch (const std::exception&) {
+        return false;
+    }
+    return spec.port > 0 && spec.port < 65536;
+}
+
+int SocketUtils::createListener(const SocketSpec& spec, std::string& error, int backlog,
+                                bool reuse_port, bool non_blocking, int unix_mode) {
+    int flags = SOCK_STREAM | SOCK_CLOEXEC | (non_blocking ? SOCK_NONBLOCK : 0);
+    int fd = -1;
+    
+    if (spec.family == SocketFamily::UNIX) {
+        fd = socket(AF_UNIX, flags, 0);
+        if (fd == -1) {
+            error = strerror(errno);
+            return -1;
+        }
+        
+        sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, spec.path.c_str(), sizeof(addr.sun_path) - 1);
+        
+        // A stale socket file left by a previous run would make bind() fail
+        unlink(spec.path.c_str());
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            error = "bind " + spec.path + ": " + strerror(errno);
+            close(fd);
+            return -1;
+        }
+        if (unix_mode != -1 && chmod(spec.path.c_str(), static_cast<mode_t>(unix_mode)) != 0) {
+            error = "chmod " + spec.path + ": " + strerror(errno);
+            close(fd);
+            unlink(spec.path.c_str());
+            return -1;
+        }
+    } else {
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+        
+        addrinfo* result = nullptr;
+        int rc = getaddrinfo(spec.host.c_str(), std::to_string(spec.port).c_str(), &hints, &result);
+        if (rc != 0) {
+            error = "resolve " + spec.host + ": " + gai_strerror(rc);
+            return -1;
+        }
+        
+        fd = socket(result->ai_family, flags, 0);
+        if (fd == -1) {
+            error = strerror(errno);
+            freeaddrinfo(result);
+            return -1;
+        }
+        
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (reuse_port) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+        }
+        
+        if (bind(fd, result->ai_addr, result->ai_addrlen) != 0) {
+            error = "bind " + spec.toString() + ": " + strerror(errno);
+            close(fd);
+            freeaddrinfo(result);
+            return -1;
+        }
+        freeaddrinfo(result);
+    }
+    
+    if (listen(fd, backlog) != 0) {
+        error = "listen " + spec.toString() + ": " + strerror(errno);
+        close(fd);
+        return -1;
+    }
+    
+    return fd;
+}
+
+bool SocketUtils::setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
@@ -0,0 +1,157 @@
+#include "../include/SpawnGovernor.hpp"
+#include "../include/SupervisorCounters.hpp"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+SpawnGovernor::Ticket::Ticket(SpawnGovernor& governor, int priority)
+    : governor(governor), id(governor.enqueue(priority, Clock::now())) {
+}
+
+SpawnGovernor::Ticket::~Ticket() {
+    if (waiting) {
+        governor.cancel(id);
+    }
+}
+
+bool SpawnGovernor::Ticket::acquire(Clock::time_point now, Clock::time_point& retry_at) {
+    if (!waiting) {
+        return true;
+    }
+    waiting = !governor.tryAcquire(id, now, retry_at);
+    return !waiting;
+}
+
+void SpawnGovernor::configure(double spawn_rate, int spawn_burst, double pressure_threshold) {
+    std::lock_guard<std::mutex> lock(governor_mutex);
+    rate = std::max(0.0, spawn_rate);
+    burst = std::max(1, spawn_burst);
+    threshold = std::max(0.0, pressure_threshold);
+    tokens = burst;
+    refilled = Clock::now();
+}
+
+bool SpawnGovernor::isEnabled() const {
+    std::lock_guard<std::mutex> lock(governor_mutex);
+    return rate > 0;
+}
+
+double SpawnGovernor::getPressure() const {
+    std::lock_guard<std::mutex> lock(governor_mutex);
+    return pressure;
+}
+
+void SpawnGovernor::samplePressure() {
+    double highest = 0;
+    for (const char* path : {"/proc/pressure/cpu", "/proc/pressure/memory", "/proc/pressure/io"}) {
+        double avg10;
+        if (readPressure(path, avg10)) {
+            highest = std::max(highest, avg10);
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(governor_mutex);
+    // Tokens earned at the old rate are kept, the new rate applies from here
+    refill(Clock::now());
+    pressure = highest;
+    SupervisorCounters::getInstance().pressure_permille.store(static_cast<uint64_t>(highest * 10),
+                                                               std::memory_order_relaxed);
+}
+
+// "some avg10=1.23 avg60=... total=..." on the first line; missing without CONFIG_PSI
+bool SpawnGovernor::readPressure(const std::string& path, double& avg10) {
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line) || line.rfind("some ", 0) != 0) {
+        return false;
+    }
+    
+    std::istringstream fields(line.substr(5));
+    std::string field;
+    while (fields >> field) {
+        if (field.rfind("avg10=", 0) == 0) {
+            try {
+                avg10 = std::stod(field.substr(6));
+                return true;
+            } catch (const std::exception&) {
+                return false;
+            }
+        }
+    }
+    return false;
+}
+
+uint64_t SpawnGovernor::enqueue(int priority, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(governor_mutex);
+    uint64_t id = next_id++;
+    queue.insert({priority, id});
+    waiters[id] = {priority, now, now, false};
+    return id;
+}
+
+void SpawnGovernor::cancel(uint64_t id) {
+    std::lock_guard<std::mutex> lock(governor_mutex);
+    auto it = waiters.find(id);
+    if (it != waiters.end()) {
+        queue.erase({it->second.priority, id});
+        waiters.erase(it);
+        SupervisorCounters::getInstance().spawns_waiting.store(queue.size(), std::memory_order_relaxed);
+    }
+}
+
+bool SpawnGovernor::tryAcquire(uint64_t id, Clock::time_point now, Clock::time_point& retry_at) {
+    std::lock_guard<std::mutex> lock(governor_mutex);
+    auto it = waiters.find(id);
+    if (it == waiters.end()) {
+        return true;
+    }
+    SupervisorCounters& counters = SupervisorCounters::getInstance();
+    
+    auto head = waiters.find(queue.begin()->second);
+    bool first = head == it;
+    bool head_stalled = !first && now > head->second.due + HEAD_GRACE;
+    if (rate > 0) {
+        refill(now);
+    }
+    if (rate <= 0 || ((first || head_stalled) && tokens >= 1)) {
+        if (rate > 0) {
+            tokens -= 1;
+        }
+        if (it->second.deferred) {
+            SupervisorCounters::increment(counters.spawns_deferred);
+            SupervisorCounters::increment(counters.spawn_deferred_ns, static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(now - it->second.since).count()));
+        }
+        queue.erase({it->second.priority, id});
+        waiters.erase(it);
+        counters.spawns_waiting.store(queue.size(), std::memory_order_relaxed);
+        return true;
+    }
+    
+    // The head asks again when its token is due; the others once per token, to see if they moved up
+    it->second.deferred = true;
+    counters.spawns_waiting.store(queue.size(), std::memory_order_relaxed);
+    double current = effectiveRate();
+    double seconds = first ? (1 - tokens) / current : 1 / current;
+    auto delay = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    retry_at = now + std::max<Clock::duration>(MIN_RETRY, delay);
+    it->second.due = retry_at;
+    return false;
+}
+
+void SpawnGovernor::refill(Clock::time_point now) {
+    if (now <= refilled) {
+        return;
+    }
+    double elapsed = std::chrono::duration<double>(now - refilled).count();
+    double limit = threshold > 0 && pressure > threshold ? 1.0 : burst;
+    tokens = std::min(limit, tokens + elapsed * effectiveRate());
+    refilled = now;
+}
+
+double SpawnGovernor::effectiveRate() const {
+    if (threshold > 0 && pressure > threshold) {
+        return rate * threshold / pressure;
+    }
+    return rate;
+}
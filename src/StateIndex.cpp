@@ -0,0 +1,93 @@
+#include "../include/StateIndex.hpp"
+#include "../include/Process.hpp"
+
+namespace {
+
+int64_t steadySeconds(std::chrono::steady_clock::time_point when) {
+    return std::chrono::duration_cast<std::chrono::seconds>(when.time_since_epoch()).count();
+}
+
+}
+
+void StateIndex::attach(const std::string& name, const Process* process) {
+    std::lock_guard<std::mutex> lock(index_mutex);
+    auto it = by_name.find(name);
+    if (it != by_name.end()) {
+        remove(name, it->second);
+        by_name.erase(it);
+    }
+    
+    Member& member = by_name[name];
+    member = {process, process->getState(), process->getRestartCount(), 0};
+    by_state[static_cast<size_t>(member.state)].insert(name);
+    restart_total += member.restarts;
+    if (member.state == ProcessState::RUNNING) {
+        member.started = steadySeconds(process->getStartTime());
+        running_started_total += member.started;
+    }
+}
+
+void StateIndex::detach(const std::string& name, const Process* process) {
+    std::lock_guard<std::mutex> lock(index_mutex);
+    auto it = by_name.find(name);
+    if (it != by_name.end() && it->second.process == process) {
+        remove(name, it->second);
+        by_name.erase(it);
+    }
+}
+
+void StateIndex::refresh(const Process& process) {
+    std::lock_guard<std::mutex> lock(index_mutex);
+    auto it = by_name.find(process.getName());
+    if (it != by_name.end() && it->second.process == &process) {
+        place(it->first, it->second, process);
+    }
+}
+
+void StateIndex::place(const std::string& name, Member& member, const Process& process) {
+    ProcessState state = process.getState();
+    int restarts = process.getRestartCount();
+    restart_total += restarts - member.restarts;
+    member.restarts = restarts;
+    
+    if (member.state == ProcessState::RUNNING) {
+        running_started_total -= member.started;
+    }
+    if (state != member.state) {
+        by_state[static_cast<size_t>(member.state)].erase(name);
+        by_state[static_cast<size_t>(state)].insert(name);
+        member.state = state;
+    }
+    // Re-read even when the state is unchanged: an overlapped restart comes back to RUNNING with a new start time
+    member.started = state == ProcessState::RUNNING ? steadySeconds(process.getStartTime()) : 0;
+    running_started_total += member.started;
+}
+
+void StateIndex::remove(const std::string& name, const Member& member) {
+    by_state[static_cast<size_t>(member.state)].erase(name);
+    restart_total -= member.restarts;
+    if (member.state == ProcessState::RUNNING) {
+        running_started_total -= member.started;
+    }
+}
+
+StateIndex::Totals StateIndex::totals() const {
+    Totals totals;
+    int64_t now = steadySeconds(std::chrono::steady_clock::now());
+    
+    std::lock_guard<std::mutex> lock(index_mutex);
+    totals.instances = by_name.size();
+    for (size_t i = 0; i < StateTimings::STATES; i++) {
+        totals.by_state[i] = by_state[i].size();
+    }
+    totals.restarts = restart_total;
+    size_t running = by_state[static_cast<size_t>(ProcessState::RUNNING)].size();
+    totals.running_uptime = std::chrono::seconds(static_cast<int64_t>(running) * now - running_started_total);
+    return totals;
+}
+
+std::vector<std::string> StateIndex::members(ProcessState state) const {
+    std::lock_guard<std::mutex> lock(index_mutex);
+    const auto& names = by_state[static_cast<size_t>(state)];
+    return {names.begin(), names.end()};
+}
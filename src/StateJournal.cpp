@@ -0,0 +1,225 @@
+#include "../include/StateJournal.hpp"
+#include "../include/Logger.hpp"
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+StateJournal::~StateJournal() {
+    close();
+}
+
+bool StateJournal::open(const std::string& journal_path) {
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    path = journal_path;
+    latest.clear();
+    recovered.clear();
+    
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd != -1) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Record)) {
+            size_t size = static_cast<size_t>(st.st_size);
+            void* old = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (old != MAP_FAILED) {
+                const Header* header = static_cast<const Header*>(old);
+                if (header->magic == MAGIC && header->version == VERSION && header->record_size == sizeof(Record)) {
+                    const Record* records = static_cast<const Record*>(old) + 1;
+                    uint64_t count = std::min<uint64_t>(header->capacity, size / sizeof(Record) - 1);
+                    // Replay in order; the last record of an instance is its state when the supervisor went away
+                    for (uint64_t i = 0; i < count && records[i].committed == COMMITTED; i++) {
+                        const Record& record = records[i];
+                        Entry entry;
+                        entry.name.assign(record.name, strnlen(record.name, sizeof(record.name)));
+                        entry.pid = record.pid;
+                        entry.group = record.group;
+                        entry.state = static_cast<ProcessState>(record.state);
+                        entry.start_ticks = record.start_ticks;
+                        entry.fingerprint = record.fingerprint;
+                        entry.restart_count = record.restart_count;
+                        entry.last_exit_status = record.last_exit_status;
+                        if (entry.pid > 0) {
+                            latest[entry.name] = entry;
+                        } else {
+                            latest.erase(entry.name);
+                        }
+                    }
+                } else {
+                    Logger::getInstance().warning("Ignoring state journal " + path + " with an unknown format");
+                }
+                munmap(old, size);
+            }
+        }
+        ::close(fd);
+    }
+    
+    recovered = latest;
+    if (!compact()) {
+        latest.clear();
+        return false;
+    }
+    Logger::getInstance().info("State journal " + path + " opened, " + std::to_string(recovered.size()) +
+                               " instance(s) had a child");
+    return true;
+}
+
+void StateJournal::close() {
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    if (map) {
+        munmap(map, map_size);
+        map = nullptr;
+    }
+}
+
+void StateJournal::record(const Entry& entry) {
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    if (!map) return;
+    
+    Entry stored = entry;
+    if (stored.pid > 0 && stored.start_ticks == 0) {
+        stored.start_ticks = processStartTicks(stored.pid);
+    }
+    if (stored.pid > 0) {
+        latest[stored.name] = stored;
+    } else {
+        latest.erase(stored.name);
+    }
+    
+    // Full: start over with one record per instance that has a child, this one included
+    if (next_index >= capacity) {
+        compact();
+        return;
+    }
+    append(stored);
+}
+
+// Caller holds journal_mutex
+void StateJournal::append(const Entry& entry) {
+    Record* record = static_cast<Record*>(map) + 1 + next_index;
+    std::memset(record, 0, sizeof(Record));
+    record->pid = entry.pid;
+    record->group = entry.group;
+    record->state = static_cast<int32_t>(entry.state);
+    record->seq = next_seq++;
+    record->start_ticks = entry.start_ticks;
+    record->fingerprint = entry.fingerprint;
+    record->restart_count = entry.restart_count;
+    record->last_exit_status = entry.last_exit_status;
+    std::strncpy(record->name, entry.name.c_str(), sizeof(record->name) - 1);
+    __atomic_store_n(&record->committed, COMMITTED, __ATOMIC_RELEASE);
+    next_index++;
+}
+
+// Writes the live entries to a fresh file and renames it over the journal; caller holds journal_mutex
+bool StateJournal::compact() {
+    std::string temp_path = path + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        Logger::getInstance().error("Could not create state journal " + temp_path + ": " + strerror(errno));
+        return false;
+    }
+    
+    uint64_t records = std::max<uint64_t>(CAPACITY, 2 * latest.size());
+    size_t size = (records + 1) * sizeof(Record);
+    void* fresh = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+        fresh = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (fresh == MAP_FAILED) {
+        Logger::getInstance().error("Could not map state journal " + temp_path + ": " + strerror(errno));
+        unlink(temp_path.c_str());
+        return false;
+    }
+    
+    Header* header = static_cast<Header*>(fresh);
+    header->magic = MAGIC;
+    header->version = VERSION;
+    header->record_size = sizeof(Record);
+    header->capacity = records;
+    
+    if (map) {
+        munmap(map, map_size);
+    }
+    map = fresh;
+    map_size = size;
+    capacity = records;
+    next_index = 0;
+    for (const auto& [name, entry] : latest) {
+        append(entry);
+    }
+    
+    if (rename(temp_path.c_str(), path.c_str()) != 0) {
+        Logger::getInstance().error("Could not replace state journal " + path + ": " + strerror(errno));
+        munmap(map, map_size);
+        map = nullptr;
+        return false;
+    }
+    return true;
+}
+
+// Only what shapes the running child: a change here means an adopted child runs a stale config
+uint64_t StateJournal::fingerprint(const ProcessConfig& config) {
+    std::ostringstream text;
+    text << config.command << '\0' << config.workingdir << '\0' << config.umask << '\0'
+         << config.stdout_logfile << '\0' << config.stderr_logfile << '\0' << config.process_num << '\0'
+         << config.notify_ready << config.notify_watchdog << config.zygote << '\0'
+         << static_cast<int>(config.affinity.mode) << CpuAffinity::formatCpuList(config.affinity.cpus)
+         << static_cast<int>(config.affinity.mempolicy) << '\0';
+    for (const auto& [key, value] : config.environment) {
+        text << key << '=' << value << '\0';
+    }
+    for (const auto& spec : config.listen) {
+        text << spec.toString() << '\0';
+    }
+    
+    return hash(text.str());
+}
+
+uint64_t StateJournal::processStartTicks(pid_t pid) {
+    std::ifstream stat_file("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    if (!std::getline(stat_file, line)) {
+        return 0;
+    }
+    
+    // comm may contain spaces and parentheses; the fields after the last ')' start at field 3
+    size_t close_paren = line.rfind(')');
+    if (close_paren == std::string::npos) {
+        return 0;
+    }
+    std::istringstream fields(line.substr(close_paren + 2));
+    std::string field;
+    for (int i = 3; i <= 22 && fields >> field; i++) {
+        if (i == 22) {
+            return std::stoull(field);
+        }
+    }
+    return 0;
+}
+
+std::chrono::steady_clock::time_point StateJournal::startTimeOf(uint64_t start_ticks) {
+    timespec boot;
+    clock_gettime(CLOCK_BOOTTIME, &boot);
+    double since_boot = static_cast<double>(boot.tv_sec) + static_cast<double>(boot.tv_nsec) / 1e9;
+    double age = since_boot - static_cast<double>(start_ticks) / static_cast<double>(sysconf(_SC_CLK_TCK));
+    auto elapsed = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(std::max(0.0, age)));
+    return std::chrono::steady_clock::now() - elapsed;
+}
+
+// FNV-1a
+uint64_t StateJournal::hash(const std::string& text) {
+    uint64_t value = 0xcbf29ce484222325ULL;
+    for (unsigned char c : text) {
+        value ^= c;
+        value *= 0x100000001b3ULL;
+    }
+    return value;
+}
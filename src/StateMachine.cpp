@@ -0,0 +1,47 @@
+#include "../include/StateMachine.hpp"
+#include <algorithm>
+
+const char* stateEventName(StateEvent event) {
+    switch (event) {
+        case StateEvent::START:          return "start";
+        case StateEvent::SPAWNED:        return "spawned";
+        case StateEvent::SPAWN_FAILED:   return "spawn-failed";
+        case StateEvent::READY:          return "ready";
+        case StateEvent::RESTART:        return "restart";
+        case StateEvent::ROLLBACK:       return "rollback";
+        case StateEvent::STOP:           return "stop";
+        case StateEvent::STOPPED:        return "stopped";
+        case StateEvent::STOP_FAILED:    return "stop-failed";
+        case StateEvent::EXITED:         return "exited";
+        case StateEvent::STARTUP_FAILED: return "startup-failed";
+        case StateEvent::CHECK_FAILED:   return "check-failed";
+        case StateEvent::GIVE_UP:        return "give-up";
+        case StateEvent::SETTLE:         return "settle";
+        case StateEvent::ADOPT:          return "adopt";
+        case StateEvent::RESTORE:        return "restore";
+    }
+    return "unknown";
+}
+
+void StateTimings::Program::record(ProcessState from, ProcessState to, uint64_t elapsed_ns) {
+    Histogram& histogram = transitions[static_cast<size_t>(from)][static_cast<size_t>(to)];
+    size_t bucket = std::lower_bound(std::begin(BUCKET_BOUNDS_NS), std::end(BUCKET_BOUNDS_NS), elapsed_ns) -
+                    std::begin(BUCKET_BOUNDS_NS);
+    histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    histogram.sum_ns.fetch_add(elapsed_ns, std::memory_order_relaxed);
+    histogram.count.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::shared_ptr<StateTimings::Program> StateTimings::forProgram(const std::string& program) {
+    std::lock_guard<std::mutex> lock(timings_mutex);
+    auto& slot = by_program[program];
+    if (!slot) {
+        slot = std::make_shared<Program>();
+    }
+    return slot;
+}
+
+std::vector<std::pair<std::string, std::shared_ptr<StateTimings::Program>>> StateTimings::programs() const {
+    std::lock_guard<std::mutex> lock(timings_mutex);
+    return {by_program.begin(), by_program.end()};
+}
@@ -0,0 +1,101 @@
+#include "../include/TargetIndex.hpp"
+#include <algorithm>
+#include <unordered_set>
+#include <fnmatch.h>
+
+void TargetIndex::rebuild(const std::map<std::string, std::shared_ptr<Process>>& processes,
+                          const GroupMap& group_configs) {
+    instances.clear();
+    by_program.clear();
+    for (const auto& [name, process] : processes) {
+        instances.insert(name);
+        by_program[process->getConfig().name].push_back(name);
+    }
+    // Instances of a program in process_num order rather than name order, so web_10 follows web_9
+    for (auto& [program, names] : by_program) {
+        std::sort(names.begin(), names.end(), [&processes](const std::string& a, const std::string& b) {
+            return processes.at(a)->getConfig().process_num < processes.at(b)->getConfig().process_num;
+        });
+    }
+    groups = group_configs;
+}
+
+bool TargetIndex::isPattern(const std::string& target) {
+    return target.find_first_of("*?[") != std::string::npos;
+}
+
+bool TargetIndex::resolve(const std::vector<std::string>& targets, std::vector<std::string>& names,
+                          std::string& error) const {
+    std::unordered_set<std::string> seen(names.begin(), names.end());
+    Collector add = [&names, &seen](const std::string& name) {
+        if (seen.insert(name).second) {
+            names.push_back(name);
+        }
+    };
+    
+    for (const auto& target : targets) {
+        if (!resolveOne(target, add, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TargetIndex::resolveOne(const std::string& target, const Collector& add, std::string& error) const {
+    if (target == "all") {
+        for (const auto& [program, members] : by_program) {
+            addProgram(program, add);
+        }
+        return true;
+    }
+    
+    if (target.rfind("group:", 0) == 0) {
+        auto group = groups.find(target.substr(6));
+        if (group == groups.end()) {
+            error = "No such group: " + target.substr(6);
+            return false;
+        }
+        for (const auto& program : group->second) {
+            addProgram(program, add);
+        }
+        return true;
+    }
+    
+    if (isPattern(target)) {
+        // Only the range of names sharing the pattern's literal prefix can match
+        std::string prefix = target.substr(0, target.find_first_of("*?[\\"));
+        bool matched = false;
+        for (auto it = instances.lower_bound(prefix);
+             it != instances.end() && it->compare(0, prefix.size(), prefix) == 0; ++it) {
+            if (fnmatch(target.c_str(), it->c_str(), 0) == 0) {
+                add(*it);
+                matched = true;
+            }
+        }
+        if (!matched) {
+            error = "No processes match: " + target;
+        }
+        return matched;
+    }
+    
+    if (instances.count(target)) {
+        add(target);
+        return true;
+    }
+    if (by_program.count(target)) {
+        addProgram(target, add);
+        return true;
+    }
+    error = "Process not found: " + target;
+    return false;
+}
+
+void TargetIndex::addProgram(const std::string& program, const Collector& add) const {
+    auto it = by_program.find(program);
+    if (it == by_program.end()) {
+        return;
+    }
+    for (const auto& name : it->second) {
+        add(name);
+    }
+}
@@ -1,12 +1,26 @@
 #include "../include/TaskMaster.hpp"
 #include <cstdlib>
+#include <climits>
+#include <sys/prctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <sched.h>
+#include <latch>
 
 TaskMaster::TaskMaster(const std::string& config_file) 
-    : config_file(config_file), running(false) {
+    : config_file(config_file), running(false), shutdown_requested(false), upgrade_requested(false) {
     
     Logger::getInstance().setLogFile("taskmaster.log");
     Logger::getInstance().logTaskMasterStartup();
     
+    // Grandchildren orphaned by a managed process are reparented to us instead of init
+    if (prctl(PR_SET_CHILD_SUBREAPER, 1) != 0) {
+        Logger::getInstance().warning("Could not become child subreaper: " + std::string(strerror(errno)));
+    }
+    
     if (!config_parser.parseFile(config_file)) {
         Logger::getInstance().error("Failed to parse configuration file: " + config_file);
         throw std::runtime_error("Failed to parse configuration file: " + config_file);
@@ -16,17 +30,40 @@ TaskMaster::TaskMaster(const std::string& config_file)
     int total_processes = 0;
     for (const auto& [name, config] : configs) {
         for (int i = 0; i < config.numprocs; i++) {
-            std::string instance_name;
-            if (config.numprocs == 1) {
-                instance_name = name;
-            } else {
-                instance_name = name + "_" + std::to_string(i);
-            }
-            processes[instance_name] = std::make_unique<Process>(config);
+            std::string instance_name = createInstanceName(name, config.numprocs, i);
+            ProcessConfig instance_config = config_parser.instanceConfig(config, i);
+            processes[instance_name] = std::make_shared<Process>(instance_config, instance_name);
+            StateIndex::getInstance().attach(instance_name, processes[instance_name].get());
             total_processes++;
         }
     }
     
+    char exe[PATH_MAX];
+    ssize_t exe_length = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (exe_length > 0) {
+        binary_path.assign(exe, static_cast<size_t>(exe_length));
+    }
+    
+    // Before any socket is bound: children still running from a previous supervisor hold the listeners
+    SupervisorConfig supervisor_config = config_parser.getSupervisorConfig();
+    if (!supervisor_config.state_journal.empty() && journal.open(supervisor_config.state_journal)) {
+        Process::setStateJournal(&journal);
+    }
+    const char* handoff = getenv("TASKMASTER_UPGRADE_FD");
+    if (handoff) {
+        int handoff_fd = std::atoi(handoff);
+        unsetenv("TASKMASTER_UPGRADE_FD");
+        restoreHandoff(handoff_fd);
+    }
+    if (journal.isOpen()) {
+        readoptChildren();
+    }
+    for (const auto& [name, process] : processes) {
+        if (!process->hasListenSockets()) {
+            attachSockets(name, process);
+        }
+    }
+    
     std::cout << "TaskMaster initialized with " << configs.size() << " process configurations (" << total_processes << " total processes)." << std::endl;
     Logger::getInstance().info("TaskMaster initialized with " + std::to_string(configs.size()) + " process configurations (" + std::to_string(total_processes) + " total processes)");
 }
@@ -36,20 +73,403 @@ TaskMaster::~TaskMaster() {
     shutdown();
 }
 
-void TaskMaster::run() {
+void TaskMaster::run(bool interactive) {
     running = true;
     
-    startAutostartProcesses();
+    SupervisorConfig supervisor_config = config_parser.getSupervisorConfig();
+    bulk_workers = static_cast<size_t>(supervisor_config.bulk_workers);
+    spawn_governor.configure(supervisor_config.spawn_rate, supervisor_config.spawn_burst,
+                             supervisor_config.spawn_pressure_threshold);
+    startNotifyListener(inherited_notify_fd);
+    Process::setZygotePool(&zygote_pool);
     
-    monitor_thread = std::thread(&TaskMaster::monitorProcesses, this);
+    // After an upgrade every instance is already where the previous image left it
+    if (!resumed) {
+        startAutostartProcesses();
+    }
+    restartStaleChildren();
     
-    std::cout << "TaskMaster is running. Type 'help' for commands." << std::endl;
+    startServices();
     
-    processCommands();
+    // Before the sampler and the coordinator, which route events to the shards
+    size_t shard_count = supervisor_config.monitor_shards > 0 ? static_cast<size_t>(supervisor_config.monitor_shards)
+                                                              : std::max(1u, std::thread::hardware_concurrency());
+    EventReactor::Backend backend = EventReactor::parseBackend(supervisor_config.event_backend);
+    for (size_t i = 0; i < shard_count; i++) {
+        auto shard = std::make_unique<MonitorShard>();
+        shard->index = i;
+        // Without a reactor the shard falls back to polling its members every cycle
+        if (shard->reactor.open(backend)) {
+            shard->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (shard->wake_fd == -1 || !shard->reactor.watch(shard->wake_fd, WAKE_TOKEN)) {
+                Logger::getInstance().error("Could not set up wakeups for monitor shard " + std::to_string(i) + ": " +
+                                            strerror(errno));
+                shard->reactor.close();
+            }
+        }
+        shards.push_back(std::move(shard));
+    }
+    Logger::getInstance().info("Supervising with " + std::to_string(shard_count) + " monitor shard(s), " +
+                               (shards.front()->reactor.isOpen() ? shards.front()->reactor.backendName() : "polling") +
+                               " event loop");
+    startMonitoring();
     
+    if (interactive) {
+        std::cout << "TaskMaster is running. Type 'help' for commands." << std::endl;
+    } else {
+        std::cout << "TaskMaster is running in daemon mode." << std::endl;
+    }
+    while (true) {
+        if (interactive) {
+            processCommands();
+        } else {
+            // A signal handler cannot notify run_cv, so the flags are also polled
+            std::unique_lock<std::mutex> lock(run_mutex);
+            run_cv.wait_for(lock, std::chrono::milliseconds(SIGNAL_POLL_MS),
+                            [this] { return shutdown_requested.load() || upgrade_requested.load(); });
+            if (!shutdown_requested && !upgrade_requested) {
+                continue;
+            }
+        }
+        if (!upgrade_requested || shutdown_requested) {
+            break;
+        }
+        // Only returns when the upgrade was abandoned and supervision resumed
+        performUpgrade();
+        upgrade_requested = false;
+    }
+    if (shutdown_signal) {
+        Logger::getInstance().info("Received signal " + std::to_string(shutdown_signal.load()) +
+                                   ". Shutting down TaskMaster...");
+    }
     shutdown();
 }
 
+// Must be listening before the first fork so children inherit NOTIFY_SOCKET. With a journal the
+// name is tied to it rather than to our pid, so re-adopted children can still reach us
+void TaskMaster::startNotifyListener(int inherited_fd) {
+    SupervisorConfig supervisor_config = config_parser.getSupervisorConfig();
+    std::string notify_name;
+    if (journal.isOpen()) {
+        std::ostringstream hex;
+        hex << std::hex << StateJournal::hash(supervisor_config.state_journal);
+        notify_name = "taskmaster-notify-" + hex.str();
+    }
+    if (notify_listener.start([this](pid_t sender, const std::map<std::string, std::string>& fields) {
+            handleNotify(sender, fields);
+        }, notify_name, inherited_fd)) {
+        Process::setNotifySocket(notify_listener.getPath());
+    }
+}
+
+void TaskMaster::startServices() {
+    SupervisorConfig supervisor_config = config_parser.getSupervisorConfig();
+    if (!supervisor_config.metrics_listen.empty()) {
+        SocketSpec spec;
+        if (SocketUtils::parseSpec(supervisor_config.metrics_listen, spec)) {
+            metrics_server.start(spec);
+        } else {
+            Logger::getInstance().error("Invalid metrics_listen address: " + supervisor_config.metrics_listen);
+        }
+    }
+    
+    if (!supervisor_config.control_socket.empty()) {
+        SocketSpec spec;
+        if (!SocketUtils::parseSpec(supervisor_config.control_socket, spec)) {
+            Logger::getInstance().error("Invalid control_socket address: " + supervisor_config.control_socket);
+        } else if (spec.family != SocketFamily::UNIX) {
+            // Commands are not authenticated: access is left to the socket file's permissions
+            Logger::getInstance().error("control_socket must be a unix socket, not " + spec.toString() +
+                                        "; control socket disabled");
+        } else {
+            control_server = std::make_unique<ControlServer>(
+                [this](const std::string& command, std::ostream& out) { return executeCommand(command, out); },
+                [this](ControlProtocol::Opcode op, const std::string& name) { return executeBatchItem(op, name); },
+                static_cast<size_t>(std::max(1, supervisor_config.control_workers)),
+                static_cast<size_t>(std::max(1, supervisor_config.control_batch_workers)));
+            control_server->setEventQueueSize(static_cast<size_t>(std::max(1, supervisor_config.event_queue_size)));
+            if (!control_server->start(spec)) {
+                control_server.reset();
+            }
+        }
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(processes_mutex);
+        health_checker.setTargets(processes);
+        updateActivationTargets();
+    }
+    health_checker.start();
+    activation_watcher.start([this](const std::vector<std::string>& names) { handleActivation(names); });
+}
+
+void TaskMaster::startMonitoring() {
+    for (auto& shard : shards) {
+        shard->thread = std::thread(&TaskMaster::monitorShard, this, std::ref(*shard));
+    }
+    monitor_thread = std::thread(&TaskMaster::monitorProcesses, this);
+    sampler_thread = std::thread(&TaskMaster::sampleMetrics, this);
+}
+
+void TaskMaster::requestShutdown() {
+    {
+        std::lock_guard<std::mutex> lock(run_mutex);
+        shutdown_requested = true;
+    }
+    run_cv.notify_all();
+}
+
+void TaskMaster::requestShutdownFromSignal(int signum) {
+    shutdown_signal = signum;
+    shutdown_requested = true;
+}
+
+void TaskMaster::requestUpgrade(const std::string& binary) {
+    {
+        std::lock_guard<std::mutex> lock(run_mutex);
+        upgrade_binary = binary;
+        upgrade_requested = true;
+    }
+    run_cv.notify_all();
+}
+
+void TaskMaster::performUpgrade() {
+    Logger::getInstance().info("Upgrading: re-executing " + upgrade_binary);
+    
+    // Before anything is stopped, so a failure here costs nothing
+    int memfd = memfd_create("taskmaster-upgrade", MFD_CLOEXEC);
+    if (memfd == -1) {
+        Logger::getInstance().error("Upgrade abandoned, could not create the hand-over: " +
+                                    std::string(strerror(errno)));
+        return;
+    }
+    
+    // Nothing may touch the process table while it is written out
+    if (control_server) {
+        control_server->stop();
+    }
+    running = false;
+    cv.notify_all();
+    sampler_cv.notify_all();
+    if (monitor_thread.joinable()) {
+        monitor_thread.join();
+    }
+    if (sampler_thread.joinable()) {
+        sampler_thread.join();
+    }
+    stopShards();
+    metrics_server.stop();
+    health_checker.stop();
+    activation_watcher.stop();
+    int notify_fd = notify_listener.release();
+    
+    std::ostringstream state;
+    std::vector<int> inherited;
+    if (notify_fd != -1) {
+        state << "notify " << notify_fd << "\n";
+        inherited.push_back(notify_fd);
+    }
+    {
+        std::lock_guard<std::mutex> lock(processes_mutex);
+        for (const auto& [name, process] : processes) {
+            state << "instance " << name << "\n";
+            process->saveState(state);
+            const auto& fds = process->getListenFds();
+            const auto& specs = process->getConfig().listen;
+            for (size_t i = 0; i < fds.size() && fds.size() == specs.size(); i++) {
+                state << "listen " << fds[i] << " " << specs[i].toString() << "\n";
+                inherited.push_back(fds[i]);
+            }
+            state << "end\n";
+            int pidfd = process->getAdoptedPidfd();
+            if (pidfd != -1) {
+                inherited.push_back(pidfd);
+            }
+        }
+    }
+    
+    // A truncated table would leave every instance missing from it unsupervised by the new image
+    std::string data = state.str();
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t result = write(memfd, data.data() + written, data.size() - written);
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            break;
+        }
+        written += static_cast<size_t>(result);
+    }
+    if (written < data.size() || lseek(memfd, 0, SEEK_SET) != 0) {
+        Logger::getInstance().error("Upgrade abandoned, could not write the hand-over: " +
+                                    std::string(strerror(errno)));
+        close(memfd);
+        resumeSupervision(notify_fd);
+        return;
+    }
+    
+    // Spares and templates are cheap to recreate and their gates would not survive the exec
+    {
+        std::lock_guard<std::mutex> spares_lock(spares_mutex);
+        for (const auto& [program, pool] : warm_spares) {
+            for (const auto& spare : pool) {
+                retireSpare(spare);
+            }
+        }
+        warm_spares.clear();
+    }
+    Process::setZygotePool(nullptr);
+    zygote_pool.closeAll();
+    
+    // Only the hand-over survives: everything else is closed by the exec
+    setenv("TASKMASTER_UPGRADE_FD", std::to_string(memfd).c_str(), 1);
+    close_range(3, ~0U, CLOSE_RANGE_CLOEXEC);
+    inherited.push_back(memfd);
+    for (int fd : inherited) {
+        fcntl(fd, F_SETFD, 0);
+    }
+    
+    std::vector<std::string> arguments = currentArguments();
+    std::vector<char*> argv;
+    for (auto& argument : arguments) {
+        argv.push_back(argument.data());
+    }
+    argv.push_back(nullptr);
+    
+    execv(upgrade_binary.c_str(), argv.data());
+    Logger::getInstance().error("Could not execute " + upgrade_binary + ": " + strerror(errno) +
+                                ", re-executing the running image instead");
+    execv("/proc/self/exe", argv.data());
+    Logger::getInstance().error("Upgrade abandoned, could not re-execute TaskMaster: " + std::string(strerror(errno)));
+    
+    // Still the same image with the same table: take back what was handed over and carry on
+    unsetenv("TASKMASTER_UPGRADE_FD");
+    for (int fd : inherited) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    close(memfd);
+    Process::setZygotePool(&zygote_pool);
+    resumeSupervision(notify_fd);
+}
+
+// Restarts what performUpgrade stopped, for an upgrade that could not go ahead
+void TaskMaster::resumeSupervision(int notify_fd) {
+    running = true;
+    startNotifyListener(notify_fd);
+    startServices();
+    startMonitoring();
+    Logger::getInstance().warning("Supervision resumed by the running image");
+}
+
+void TaskMaster::restoreHandoff(int fd) {
+    std::string data;
+    char buffer[4096];
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        data.append(buffer, static_cast<size_t>(length));
+    }
+    close(fd);
+    
+    std::istringstream lines(data);
+    std::string line;
+    std::string name;
+    std::map<std::string, std::string> fields;
+    std::vector<std::pair<int, std::string>> sockets;
+    std::set<int> handed_over;
+    std::set<int> kept;
+    size_t instances = 0;
+    while (std::getline(lines, line)) {
+        size_t space = line.find(' ');
+        std::string key = line.substr(0, space);
+        std::string value = space == std::string::npos ? "" : line.substr(space + 1);
+        
+        if (key == "notify") {
+            inherited_notify_fd = std::stoi(value);
+        } else if (key == "instance") {
+            name = value;
+            fields.clear();
+            sockets.clear();
+        } else if (key == "listen") {
+            size_t split = value.find(' ');
+            int socket_fd = std::stoi(value.substr(0, split));
+            fcntl(socket_fd, F_SETFD, FD_CLOEXEC);
+            sockets.emplace_back(socket_fd, split == std::string::npos ? "" : value.substr(split + 1));
+            handed_over.insert(socket_fd);
+        } else if (key == "end") {
+            applyHandoff(name, fields, sockets, kept);
+            instances++;
+        } else {
+            fields[key] = value;
+        }
+    }
+    
+    // Sockets of instances that are gone or now listen elsewhere
+    for (int socket_fd : handed_over) {
+        if (!kept.count(socket_fd)) {
+            close(socket_fd);
+        }
+    }
+    resumed = true;
+    Logger::getInstance().info("Resumed supervision of " + std::to_string(instances) + " instance(s) after upgrade");
+}
+
+void TaskMaster::applyHandoff(const std::string& name, const std::map<std::string, std::string>& fields,
+                              const std::vector<std::pair<int, std::string>>& sockets, std::set<int>& kept) {
+    auto field = [&fields](const std::string& key) {
+        auto it = fields.find(key);
+        return it == fields.end() ? std::string() : it->second;
+    };
+    pid_t pid = field("pid").empty() ? -1 : std::stoi(field("pid"));
+    
+    auto it = processes.find(name);
+    if (it == processes.end()) {
+        if (pid > 0) {
+            Logger::getInstance().warning("Stopping PID " + std::to_string(pid) + " of " + name +
+                                          ", which is no longer configured");
+            kill(-std::stoi(field("group")), SIGTERM);
+        }
+        if (!field("pidfd").empty() && std::stoi(field("pidfd")) != -1) {
+            close(std::stoi(field("pidfd")));
+        }
+        return;
+    }
+    
+    std::shared_ptr<Process> process = it->second;
+    process->restoreState(fields);
+    
+    // The sockets the new config asks for, in its order, if the previous image had them all
+    const ProcessConfig& config = process->getConfig();
+    std::vector<int> fds;
+    for (const auto& spec : config.listen) {
+        auto found = std::find_if(sockets.begin(), sockets.end(),
+                                  [&spec](const std::pair<int, std::string>& socket) { return socket.second == spec.toString(); });
+        if (found == sockets.end()) {
+            break;
+        }
+        fds.push_back(found->first);
+    }
+    if (!fds.empty() && fds.size() == config.listen.size()) {
+        kept.insert(fds.begin(), fds.end());
+        socket_registry.adopt(name, config, fds);
+        process->setListenFds(fds);
+    }
+    
+    if (pid > 0 && field("fingerprint") != std::to_string(process->getConfigFingerprint())) {
+        stale_children.push_back(name);
+    }
+}
+
+std::vector<std::string> TaskMaster::currentArguments() {
+    std::ifstream cmdline("/proc/self/cmdline");
+    std::vector<std::string> arguments;
+    std::string argument;
+    while (std::getline(cmdline, argument, '\0')) {
+        arguments.push_back(argument);
+    }
+    return arguments;
+}
+
 void TaskMaster::startAutostartProcesses() {
     std::lock_guard<std::mutex> lock(processes_mutex);
     for (const auto& [name, process] : processes) {
@@ -61,10 +481,179 @@ void TaskMaster::startAutostartProcesses() {
     }
 }
 
+// Takes back the children a previous supervisor left running, as recorded in the state journal
+void TaskMaster::readoptChildren() {
+    auto began = std::chrono::steady_clock::now();
+    size_t adopted = 0;
+    size_t journaled = 0;
+    
+    for (const auto& [name, entry] : journal.getRecovered()) {
+        auto configured = processes.find(name);
+        if (configured != processes.end() && configured->second->getPid() > 0) {
+            continue;  // Handed over by the image we were upgraded from
+        }
+        journaled++;
+        StateJournal::Entry gone;
+        gone.name = name;
+        
+        // The start time tells the journaled child from an unrelated process that reused its pid
+        int pidfd = static_cast<int>(syscall(SYS_pidfd_open, entry.pid, 0));
+        if (pidfd == -1 || StateJournal::processStartTicks(entry.pid) != entry.start_ticks) {
+            if (pidfd != -1) {
+                close(pidfd);
+            }
+            Logger::getInstance().info("Journaled child of " + name + " (PID: " + std::to_string(entry.pid) +
+                                       ") is gone");
+            journal.record(gone);
+            continue;
+        }
+        
+        auto it = processes.find(name);
+        if (it == processes.end()) {
+            Logger::getInstance().warning("Stopping PID " + std::to_string(entry.pid) + " left by " + name +
+                                          ", which is no longer configured");
+            kill(-entry.group, SIGTERM);
+            close(pidfd);
+            journal.record(gone);
+            continue;
+        }
+        
+        std::shared_ptr<Process> process = it->second;
+        const ProcessConfig& config = process->getConfig();
+        bool stale = entry.fingerprint != process->getConfigFingerprint();
+        if (!config.listen.empty()) {
+            std::vector<int> fds;
+            if (recoverListenSockets(pidfd, config.listen.size(), fds)) {
+                socket_registry.adopt(name, config, fds);
+                process->setListenFds(fds);
+            } else {
+                Logger::getInstance().warning("Could not recover the listen sockets of " + name + " from PID " +
+                                              std::to_string(entry.pid) + ", replacing it");
+                stale = true;
+            }
+        }
+        
+        process->adoptOrphan(entry.pid, entry.group, pidfd, entry.state, StateJournal::startTimeOf(entry.start_ticks),
+                             entry.restart_count, entry.last_exit_status);
+        SupervisorCounters::increment(SupervisorCounters::getInstance().readopted);
+        Logger::getInstance().info("Re-adopted " + name + " (PID: " + std::to_string(entry.pid) + ")");
+        if (stale) {
+            stale_children.push_back(name);
+        }
+        adopted++;
+    }
+    
+    if (journaled > 0) {
+        std::ostringstream elapsed;
+        elapsed << std::fixed << std::setprecision(1)
+                << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - began).count();
+        Logger::getInstance().info("Re-adopted " + std::to_string(adopted) + " of " + std::to_string(journaled) +
+                                   " journaled children in " +
+                                   elapsed.str() + " ms");
+    }
+}
+
+// The child got the listeners as fds 3.. (LISTEN_FDS); copies of them are the very same sockets
+bool TaskMaster::recoverListenSockets(int pidfd, size_t count, std::vector<int>& fds) {
+    for (size_t i = 0; i < count; i++) {
+        int fd = static_cast<int>(syscall(SYS_pidfd_getfd, pidfd, 3 + static_cast<int>(i), 0));
+        int listening = 0;
+        socklen_t length = sizeof(listening);
+        if (fd == -1 || getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &length) != 0 || !listening) {
+            if (fd != -1) {
+                close(fd);
+            }
+            for (int recovered : fds) {
+                close(recovered);
+            }
+            fds.clear();
+            return false;
+        }
+        fds.push_back(fd);
+    }
+    return true;
+}
+
+void TaskMaster::restartStaleChildren() {
+    for (const auto& name : stale_children) {
+        std::shared_ptr<Process> process = findProcess(name);
+        if (!process) continue;
+        
+        Logger::getInstance().info("Restarting re-adopted " + name + ": its configuration changed since it was started");
+        std::lock_guard<std::mutex> operation(process->getOperationMutex());
+        attachSockets(name, process);
+        process->restart();
+    }
+    stale_children.clear();
+}
+
+void TaskMaster::attachSockets(const std::string& name, const std::shared_ptr<Process>& process) {
+    std::vector<int> fds;
+    std::string error;
+    if (!socket_registry.assign(name, process->getConfig(), fds, error)) {
+        Logger::getInstance().error("Could not bind listen socket for " + name + ": " + error);
+    }
+    process->setListenFds(fds);
+}
+
+// Caller holds processes_mutex
+void TaskMaster::updateActivationTargets() {
+    std::map<int, std::vector<std::string>> targets;
+    for (const auto& [name, process] : processes) {
+        if (process->getConfig().autostart != AutoStart::ON_DEMAND) continue;
+        for (int fd : process->getListenFds()) {
+            targets[fd].push_back(name);
+        }
+    }
+    activation_watcher.setTargets(targets);
+}
+
+void TaskMaster::handleActivation(const std::vector<std::string>& names) {
+    for (const auto& name : names) {
+        std::shared_ptr<Process> process = findProcess(name);
+        if (!process) continue;
+        
+        process->touchActivity();
+        ProcessState state = process->getState();
+        // FATAL stays down until started by hand, BACKOFF is already being retried by the monitor
+        if (process->isActive() || (state != ProcessState::STOPPED && state != ProcessState::EXITED)) {
+            continue;
+        }
+        
+        Logger::getInstance().info("Connection pending on " + name + " listen socket, starting it on demand");
+        SupervisorCounters::increment(SupervisorCounters::getInstance().activations);
+        startProgram(name);
+    }
+}
+
+void TaskMaster::stopIdleProcesses(MonitorShard& shard) {
+    for (const auto& [name, process] : shard.members) {
+        const auto& config = process->getConfig();
+        if (config.autostart != AutoStart::ON_DEMAND || config.idle_timeout <= 0 ||
+            process->getState() != ProcessState::RUNNING ||
+            process->getIdleTime() < std::chrono::seconds(config.idle_timeout) || shard.lifecycles.has(name)) {
+            continue;
+        }
+        shard.lifecycles.spawn(name, stopLifecycle(name, process, shard, AfterStop::IDLE));
+    }
+}
+
 void TaskMaster::processCommands() {
     std::string command;
-    while (running) {
-        std::cout << "taskmaster> ";
+    bool prompt = true;
+    while (running && !shutdown_requested && !upgrade_requested) {
+        if (prompt) {
+            std::cout << "taskmaster> " << std::flush;
+            prompt = false;
+        }
+        
+        // Wake up periodically so a shutdown requested over the control socket is noticed
+        pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
+        
+        prompt = true;
         if (!std::getline(std::cin, command)) {
             break;
         }
@@ -72,7 +661,7 @@ void TaskMaster::processCommands() {
         command = trimString(command);
         if (command.empty()) continue;
         
-        if (!executeCommand(command)) {
+        if (!executeCommand(command, std::cout)) {
             break;
         }
     }
@@ -86,123 +675,233 @@ std::string TaskMaster::trimString(const std::string& str) {
     return str.substr(first, (last - first + 1));
 }
 
-bool TaskMaster::executeCommand(const std::string& command) {
+bool TaskMaster::executeCommand(const std::string& command, std::ostream& out) {
     std::istringstream iss(command);
     std::string cmd;
     iss >> cmd;
     
     if (cmd == "status") {
-        return handleStatusCommand(iss);
+        return handleStatusCommand(iss, out);
     } else if (cmd == "start") {
-        return handleStartCommand(iss);
+        return handleStartCommand(iss, out);
     } else if (cmd == "stop") {
-        return handleStopCommand(iss);
+        return handleStopCommand(iss, out);
     } else if (cmd == "restart") {
-        return handleRestartCommand(iss);
+        return handleRestartCommand(iss, out);
     } else if (cmd == "reload") {
-        return handleReloadCommand();
+        return handleReloadCommand(out);
     } else if (cmd == "stats") {
-        return handleStatsCommand();
+        return handleStatsCommand(out);
     } else if (cmd == "logs") {
-        return handleLogsCommand(iss);
+        return handleLogsCommand(iss, out);
     } else if (cmd == "clear") {
-        return handleClearCommand();
+        return handleClearCommand(out);
     } else if (cmd == "quit" || cmd == "exit") {
         return false;
+    } else if (cmd == "upgrade") {
+        return handleUpgradeCommand(iss, out);
+    } else if (cmd == "detach") {
+        if (!journal.isOpen()) {
+            out << "detach needs state_journal, or the next TaskMaster could not re-adopt the processes" << std::endl;
+            return true;
+        }
+        out << "Exiting TaskMaster, processes are left running" << std::endl;
+        detach_requested = true;
+        requestShutdown();
+        return false;
+    } else if (cmd == "shutdown") {
+        out << "Shutting down TaskMaster" << std::endl;
+        requestShutdown();
+        return false;
+    } else if (cmd == "subscribe") {
+        out << "subscribe is only available on the control socket (taskmasterctl subscribe)" << std::endl;
+        return true;
     } else if (cmd == "help") {
-        return handleHelpCommand();
+        return handleHelpCommand(out);
     } else {
-        std::cout << "Unknown command: " << cmd << ". Type 'help' for available commands." << std::endl;
+        out << "Unknown command: " << cmd << ". Type 'help' for available commands." << std::endl;
+        return true;
+    }
+}
+
+bool TaskMaster::handleUpgradeCommand(std::istringstream& iss, std::ostream& out) {
+    std::string binary;
+    if (!(iss >> binary)) {
+        binary = binary_path;
+    }
+    // The path comes from a control client: only what the config names may be executed as the supervisor
+    const auto& allowed = config_parser.getSupervisorConfig().upgrade_binaries;
+    if (binary != binary_path && std::find(allowed.begin(), allowed.end(), binary) == allowed.end()) {
+        out << "Cannot upgrade to " << binary << ": not the running binary and not listed in upgrade_binaries"
+            << std::endl;
+        return true;
+    }
+    if (binary.empty() || access(binary.c_str(), X_OK) != 0) {
+        out << "Cannot upgrade to " << (binary.empty() ? "<unknown binary>" : binary) << ": "
+            << strerror(binary.empty() ? ENOENT : errno) << std::endl;
         return true;
     }
+    out << "Upgrading TaskMaster to " << binary << std::endl;
+    requestUpgrade(binary);
+    return false;
 }
 
-bool TaskMaster::handleStatusCommand(std::istringstream& iss) {
+bool TaskMaster::handleStatusCommand(std::istringstream& iss, std::ostream& out) {
     std::string arg;
     bool detailed = false;
     std::string filter;
+    std::string states;
     
     // Parse arguments
     while (iss >> arg) {
         if (arg == "--detailed") {
             detailed = true;
+        } else if (arg == "--state") {
+            iss >> states;
         } else {
             filter = arg;
         }
     }
     
-    if (detailed) {
-        printDetailedStatus(filter);
+    if (!states.empty()) {
+        std::vector<ProcessState> types;
+        if (!ProcessEvents::parseTypes(states, types) || types.empty()) {
+            out << "Usage: status [--detailed] --state <state[,state...]> (e.g. fatal,backoff)" << std::endl;
+        } else {
+            printStatusByState(types, detailed, out);
+        }
+    } else if (detailed) {
+        printDetailedStatus(filter, out);
     } else {
-        std::cout << getStatus(filter) << std::endl;
+        out << getStatus(filter) << std::endl;
     }
     return true;
 }
 
-bool TaskMaster::handleStartCommand(std::istringstream& iss) {
-    std::string name;
-    iss >> name;
-    if (name.empty()) {
-        std::cout << "Usage: start <program_name>" << std::endl;
-    } else if (startProgram(name)) {
-        std::cout << "Started " << name << std::endl;
+bool TaskMaster::handleStartCommand(std::istringstream& iss, std::ostream& out) {
+    std::vector<std::string> targets = readTargets(iss);
+    if (targets.empty()) {
+        out << "Usage: start <name|glob|group:name|all>..." << std::endl;
     } else {
-        std::cout << "Failed to start " << name << std::endl;
+        runOnTargets(ControlProtocol::Opcode::START, targets, out);
     }
     return true;
 }
 
-bool TaskMaster::handleStopCommand(std::istringstream& iss) {
-    std::string name;
-    iss >> name;
-    if (name.empty()) {
-        std::cout << "Usage: stop <program_name>" << std::endl;
-    } else if (stopProgram(name)) {
-        std::cout << "Stopped " << name << std::endl;
+bool TaskMaster::handleStopCommand(std::istringstream& iss, std::ostream& out) {
+    std::vector<std::string> targets = readTargets(iss);
+    if (targets.empty()) {
+        out << "Usage: stop <name|glob|group:name|all>..." << std::endl;
     } else {
-        std::cout << "Failed to stop " << name << std::endl;
+        runOnTargets(ControlProtocol::Opcode::STOP, targets, out);
     }
     return true;
 }
 
-bool TaskMaster::handleRestartCommand(std::istringstream& iss) {
-    std::string name;
-    iss >> name;
-    if (name.empty()) {
-        std::cout << "Usage: restart <program_name>" << std::endl;
-    } else if (restartProgram(name)) {
-        std::cout << "Restarted " << name << std::endl;
+bool TaskMaster::handleRestartCommand(std::istringstream& iss, std::ostream& out) {
+    std::vector<std::string> targets = readTargets(iss);
+    if (!targets.empty() && targets[0] == "--rolling") {
+        if (targets.size() != 2) {
+            out << "Usage: restart --rolling <program>" << std::endl;
+        } else {
+            rollingRestart(targets[1], out);
+        }
+        return true;
+    }
+    
+    if (targets.empty()) {
+        out << "Usage: restart [--rolling] <name|glob|group:name|all>..." << std::endl;
     } else {
-        std::cout << "Failed to restart " << name << std::endl;
+        runOnTargets(ControlProtocol::Opcode::RESTART, targets, out);
     }
     return true;
 }
 
-bool TaskMaster::handleReloadCommand() {
+std::vector<std::string> TaskMaster::readTargets(std::istringstream& iss) {
+    std::vector<std::string> targets;
+    std::string target;
+    while (iss >> target) {
+        targets.push_back(target);
+    }
+    return targets;
+}
+
+bool TaskMaster::resolveTargets(const std::vector<std::string>& targets, std::vector<std::string>& names,
+                                std::string& error) {
+    std::lock_guard<std::mutex> lock(processes_mutex);
+    if (targets_generation != processes_generation) {
+        target_index.rebuild(processes, config_parser.getGroupConfigs());
+        targets_generation = processes_generation;
+    }
+    return target_index.resolve(targets, names, error);
+}
+
+// Several instances are handled concurrently on the bulk pool, so stopping a whole program takes about
+// one stoptime rather than one per instance. Results are reported in the order the targets name them.
+void TaskMaster::runOnTargets(ControlProtocol::Opcode op, const std::vector<std::string>& targets, std::ostream& out) {
+    std::vector<std::string> names;
+    std::string error;
+    if (!resolveTargets(targets, names, error)) {
+        out << error << std::endl;
+        return;
+    }
+    
+    std::vector<ControlProtocol::ItemResult> results(names.size());
+    if (names.size() == 1) {
+        results[0] = executeBatchItem(op, names[0]);
+    } else {
+        WorkerPool& pool = bulkPool();
+        std::latch done(static_cast<std::ptrdiff_t>(names.size()));
+        for (size_t i = 0; i < names.size(); i++) {
+            auto job = [this, op, &names, &results, &done, i] {
+                results[i] = executeBatchItem(op, names[i]);
+                done.count_down();
+            };
+            if (!pool.submit(job)) {
+                job();
+            }
+        }
+        done.wait();
+    }
+    
+    for (const auto& result : results) {
+        out << result.message << std::endl;
+    }
+}
+
+WorkerPool& TaskMaster::bulkPool() {
+    std::lock_guard<std::mutex> lock(bulk_mutex);
+    if (!bulk_pool) {
+        bulk_pool = std::make_unique<WorkerPool>(bulk_workers);
+    }
+    return *bulk_pool;
+}
+
+bool TaskMaster::handleReloadCommand(std::ostream& out) {
     if (reloadConfig()) {
-        std::cout << "Configuration reloaded" << std::endl;
+        out << "Configuration reloaded" << std::endl;
         Logger::getInstance().logConfigReloaded();
     } else {
-        std::cout << "Failed to reload configuration" << std::endl;
+        out << "Failed to reload configuration" << std::endl;
         Logger::getInstance().error("Failed to reload configuration");
     }
     return true;
 }
 
-bool TaskMaster::handleStatsCommand() {
-    printProcessStats();
+bool TaskMaster::handleStatsCommand(std::ostream& out) {
+    printProcessStats(out);
     return true;
 }
 
-bool TaskMaster::handleLogsCommand(std::istringstream& iss) {
+bool TaskMaster::handleLogsCommand(std::istringstream& iss, std::ostream& out) {
     std::string process_name;
     std::string lines_str;
     int lines = 10;  // default
     
     iss >> process_name;
     if (process_name.empty()) {
-        std::cout << "Usage: logs <process_name> [lines]" << std::endl;
-        std::cout << "Example: logs nginx 20" << std::endl;
+        out << "Usage: logs <process_name> [lines]" << std::endl;
+        out << "Example: logs nginx 20" << std::endl;
         return true;
     }
     
@@ -216,27 +915,38 @@ bool TaskMaster::handleLogsCommand(std::istringstream& iss) {
         }
     }
     
-    showProcessLogs(process_name, lines);
+    showProcessLogs(process_name, lines, out);
     return true;
 }
 
-bool TaskMaster::handleHelpCommand() {
-    std::cout << "Available commands:" << std::endl;
-    std::cout << "  status [name]           - Show status of all processes or specific process" << std::endl;
-    std::cout << "  status --detailed       - Show detailed status with CPU, memory, and metrics" << std::endl;
-    std::cout << "  status --detailed <name> - Show detailed status for specific process" << std::endl;
-    std::cout << "  stats                   - Show process statistics and system health" << std::endl;
-    std::cout << "  logs <name> [lines]     - Show process logs (default: 10 lines)" << std::endl;
-    std::cout << "  start <name>            - Start a process" << std::endl;
-    std::cout << "  stop <name>             - Stop a process" << std::endl;
-    std::cout << "  restart <name>          - Restart a process" << std::endl;
-    std::cout << "  reload                  - Reload configuration" << std::endl;
-    std::cout << "  clear                   - Clear the terminal screen" << std::endl;
-    std::cout << "  quit/exit               - Exit TaskMaster" << std::endl;
+bool TaskMaster::handleHelpCommand(std::ostream& out) {
+    out << "Available commands:" << std::endl;
+    out << "  status [name]           - Show status of all processes or specific process" << std::endl;
+    out << "  status --detailed       - Show detailed status with CPU, memory, and metrics" << std::endl;
+    out << "  status --detailed <name> - Show detailed status for specific process" << std::endl;
+    out << "  status --state <states> - Show only processes in the given states, e.g. status --state fatal,backoff" << std::endl;
+    out << "  stats                   - Show process statistics and system health" << std::endl;
+    out << "  logs <name> [lines]     - Show process logs (default: 10 lines)" << std::endl;
+    out << "  start <target>...       - Start processes; a target is a name, a program, a glob (web_*), group:<name> or all" << std::endl;
+    out << "  stop <target>...        - Stop processes, concurrently when there are several" << std::endl;
+    out << "  restart <target>...     - Restart processes, concurrently when there are several" << std::endl;
+    out << "  restart --rolling <program> - Restart every instance of a program in batches bounded by max_unavailable/max_surge" << std::endl;
+    out << "  reload                  - Reload configuration" << std::endl;
+    out << "  clear                   - Clear the terminal screen" << std::endl;
+    out << "  subscribe [glob] [types] - Stream state changes (control socket only), e.g. subscribe 'web*' exited,fatal" << std::endl;
+    out << "  quit/exit               - Exit TaskMaster (closes the connection on the control socket)" << std::endl;
+    out << "  upgrade [binary]        - Re-execute TaskMaster (or binary) without stopping any process" << std::endl;
+    out << "  shutdown                - Stop all processes and exit TaskMaster" << std::endl;
+    out << "  detach                  - Exit TaskMaster and leave processes running for the next one to re-adopt" << std::endl;
     return true;
 }
 
-bool TaskMaster::handleClearCommand() {
+bool TaskMaster::handleClearCommand(std::ostream& out) {
+    if (&out != &std::cout) {
+        // Remote clients get the escape sequence instead of clearing the supervisor's terminal
+        out << "\033[2J\033[H";
+        return true;
+    }
     int result = system("clear");
     (void)result; // Explicitly ignore the return value
     return true;
@@ -245,67 +955,361 @@ bool TaskMaster::handleClearCommand() {
 void TaskMaster::shutdown() {
     if (!running) return;
     
+    if (control_server) {
+        control_server->stop();
+    }
+    {
+        std::lock_guard<std::mutex> lock(bulk_mutex);
+        if (bulk_pool) {
+            bulk_pool->shutdown();
+        }
+    }
+    
     running = false;
     cv.notify_all();
+    sampler_cv.notify_all();
     
     if (monitor_thread.joinable()) {
         monitor_thread.join();
     }
+    if (sampler_thread.joinable()) {
+        sampler_thread.join();
+    }
+    stopShards();
+    metrics_server.stop();
+    health_checker.stop();
+    activation_watcher.stop();
+    notify_listener.stop();
     
+    // Children stay journaled: the next supervisor re-adopts them as after a crash
+    bool detach = detach_requested || config_parser.getSupervisorConfig().detach_on_exit;
+    if (detach && !journal.isOpen()) {
+        Logger::getInstance().warning("exit_action=detach needs state_journal, stopping every process instead");
+        detach = false;
+    }
     std::lock_guard<std::mutex> lock(processes_mutex);
+    if (detach) {
+        Logger::getInstance().info("Exiting without stopping processes, they are left to the next supervisor");
+    }
     for (const auto& [name, process] : processes) {
-        if (process->getState() == ProcessState::RUNNING) {
+        if (detach) {
+            process->detachChild();
+        } else if (process->isActive()) {
             pid_t pid = process->getPid();
             if (process->stop()) {
                 Logger::getInstance().logProcessStopped(name, pid, 0);
             }
         }
     }
+    {
+        std::lock_guard<std::mutex> spares_lock(spares_mutex);
+        for (const auto& [program, pool] : warm_spares) {
+            for (const auto& spare : pool) {
+                retireSpare(spare);
+            }
+        }
+        warm_spares.clear();
+    }
+    Process::setZygotePool(nullptr);
+    zygote_pool.closeAll();
+    socket_registry.closeAll();
+    Process::setStateJournal(nullptr);
+    journal.close();
 }
 
-bool TaskMaster::startProgram(const std::string& name) {
+std::shared_ptr<Process> TaskMaster::findProcess(const std::string& name) {
     std::lock_guard<std::mutex> lock(processes_mutex);
     auto it = processes.find(name);
     if (it == processes.end()) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+// Lifecycle operations only hold the instance's own lock, so commands on different instances run in parallel
+bool TaskMaster::startProgram(const std::string& name) {
+    std::shared_ptr<Process> process = findProcess(name);
+    if (!process) {
         return false;
     }
-    bool success = it->second->start();
-    if (success) {
-        Logger::getInstance().logProcessStarted(name, it->second->getPid());
+    bool success;
+    {
+        std::lock_guard<std::mutex> operation(process->getOperationMutex());
+        attachSockets(name, process);
+        success = process->start();
+        if (success) {
+            Logger::getInstance().logProcessStarted(name, process->getPid());
+        }
+    }
+    // Per-instance sockets are rebound after an explicit stop and must be watched again
+    if (process->getConfig().autostart == AutoStart::ON_DEMAND) {
+        std::lock_guard<std::mutex> lock(processes_mutex);
+        updateActivationTargets();
     }
     return success;
 }
 
 bool TaskMaster::stopProgram(const std::string& name) {
-    std::lock_guard<std::mutex> lock(processes_mutex);
-    auto it = processes.find(name);
-    if (it == processes.end()) {
+    std::shared_ptr<Process> process = findProcess(name);
+    if (!process) {
         return false;
     }
-    pid_t pid = it->second->getPid();
-    bool success = it->second->stop();
-    if (success) {
-        Logger::getInstance().logProcessStopped(name, pid, 0);
+    bool success;
+    {
+        std::lock_guard<std::mutex> operation(process->getOperationMutex());
+        pid_t pid = process->getPid();
+        success = process->stop();
+        if (success) {
+            Logger::getInstance().logProcessStopped(name, pid, 0);
+            // A stopped instance's own SO_REUSEPORT socket would keep taking connections nobody accepts
+            std::vector<int> closed = socket_registry.releaseExclusive(name);
+            std::vector<int> remaining;
+            for (int fd : process->getListenFds()) {
+                if (std::find(closed.begin(), closed.end(), fd) == closed.end()) {
+                    remaining.push_back(fd);
+                }
+            }
+            process->setListenFds(remaining);
+        }
+    }
+    if (process->getConfig().autostart == AutoStart::ON_DEMAND) {
+        std::lock_guard<std::mutex> lock(processes_mutex);
+        updateActivationTargets();
     }
     return success;
 }
 
 bool TaskMaster::restartProgram(const std::string& name) {
-    std::lock_guard<std::mutex> lock(processes_mutex);
-    auto it = processes.find(name);
-    if (it == processes.end()) {
+    std::shared_ptr<Process> process = findProcess(name);
+    if (!process) {
         return false;
     }
+    std::lock_guard<std::mutex> operation(process->getOperationMutex());
     
     Logger::getInstance().info("Restarting process " + name);
     
-    bool success = it->second->restart();
+    bool success = process->restart();
     if (success) {
-        Logger::getInstance().logProcessStarted(name, it->second->getPid());
+        Logger::getInstance().logProcessStarted(name, process->getPid());
+    }
+    return success;
+}
+
+bool TaskMaster::rollingRestart(const std::string& program, std::ostream& out) {
+    std::vector<std::pair<int, std::string>> instances;
+    std::vector<std::string> skipped;
+    {
+        std::lock_guard<std::mutex> lock(processes_mutex);
+        for (const auto& [name, process] : processes) {
+            if (process->getConfig().name != program) continue;
+            if (process->isActive()) {
+                instances.push_back({process->getConfig().process_num, name});
+            } else {
+                skipped.push_back(name);
+            }
+        }
+    }
+    
+    if (instances.empty()) {
+        out << (skipped.empty() ? "Program not found: " : "No running instances of ") << program << std::endl;
+        return false;
+    }
+    std::sort(instances.begin(), instances.end());
+    
+    std::vector<RolloutItem> items;
+    for (const auto& [num, name] : instances) {
+        items.push_back({name, std::nullopt});
     }
+    for (const auto& name : skipped) {
+        out << "Skipping " << name << " (not running)" << std::endl;
+    }
+    
+    bool success = runRollout(program, items, out);
+    out << std::flush;
     return success;
 }
 
+// Replaces instances batch by batch. A batch holds up to max_surge overlapped replacements (listen= programs only,
+// capacity never drops) plus up to max_unavailable stop-then-start ones, and must be serving before the next begins.
+bool TaskMaster::runRollout(const std::string& program, const std::vector<RolloutItem>& items, std::ostream& out) {
+    ProcessConfig policy;
+    {
+        std::lock_guard<std::mutex> lock(processes_mutex);
+        auto configs = config_parser.getProcessConfigs();
+        auto it = configs.find(program);
+        if (it != configs.end()) {
+            policy = it->second;
+        }
+    }
+    
+    size_t surge = policy.listen.empty() ? 0 : static_cast<size_t>(policy.max_surge);
+    size_t unavailable = static_cast<size_t>(policy.max_unavailable);
+    if (surge + unavailable == 0) {
+        unavailable = 1;
+    }
+    
+    Logger::getInstance().info("Rolling update of " + program + ": " + std::to_string(items.size()) +
+                               " instances, max_surge=" + std::to_string(surge) +
+                               ", max_unavailable=" + std::to_string(unavailable));
+    
+    size_t done = 0;
+    int batch_number = 0;
+    while (done < items.size()) {
+        size_t count = std::min(surge + unavailable, items.size() - done);
+        std::vector<char> results(count, 0);
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < count; i++) {
+            workers.emplace_back([this, &items, &results, done, i, surge] {
+                results[i] = replaceInstance(items[done + i], i < surge);
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        
+        batch_number++;
+        std::vector<std::string> failed;
+        out << "Batch " << batch_number << ":";
+        for (size_t i = 0; i < count; i++) {
+            out << " " << items[done + i].name << (results[i] ? "" : " (FAILED)");
+            if (!results[i]) {
+                failed.push_back(items[done + i].name);
+            }
+        }
+        out << std::endl;
+        done += count;
+        
+        if (!failed.empty()) {
+            out << "Rolling update of " << program << " halted after " << done << "/" << items.size()
+                << " instances: replacement did not become ready" << std::endl;
+            return false;
+        }
+    }
+    
+    out << "Rolling update of " << program << " completed (" << items.size() << " instances)" << std::endl;
+    return true;
+}
+
+bool TaskMaster::replaceInstance(const RolloutItem& item, bool overlap) {
+    std::shared_ptr<Process> old_process = findProcess(item.name);
+    if (!old_process) {
+        return false;
+    }
+    
+    if (!item.config) {
+        {
+            std::lock_guard<std::mutex> operation(old_process->getOperationMutex());
+            Logger::getInstance().info("Rolling restart of " + item.name);
+            if (!old_process->restart(overlap)) {
+                return false;
+            }
+            Logger::getInstance().logProcessStarted(item.name, old_process->getPid());
+        }
+        return waitUntilServing(item.name, old_process);
+    }
+    
+    auto fresh = std::make_shared<Process>(*item.config, item.name);
+    auto install = [this, &item](const std::shared_ptr<Process>& process) {
+        std::lock_guard<std::mutex> lock(processes_mutex);
+        processes[item.name] = process;
+        StateIndex::getInstance().attach(item.name, process.get());
+        health_checker.setTargets(processes);
+        updateActivationTargets();
+        processes_generation++;
+    };
+    
+    if (!overlap) {
+        std::lock_guard<std::mutex> operation(old_process->getOperationMutex());
+        old_process->stop();
+    }
+    
+    attachSockets(item.name, fresh);
+    install(fresh);
+    {
+        std::lock_guard<std::mutex> operation(fresh->getOperationMutex());
+        if (fresh->start()) {
+            Logger::getInstance().logProcessStarted(item.name, fresh->getPid());
+        }
+    }
+    
+    bool serving = waitUntilServing(item.name, fresh);
+    if (overlap) {
+        if (!serving) {
+            // The previous instance never stopped serving; put it back
+            {
+                std::lock_guard<std::mutex> operation(fresh->getOperationMutex());
+                fresh->stop();
+            }
+            install(old_process);
+            return false;
+        }
+        std::lock_guard<std::mutex> operation(old_process->getOperationMutex());
+        old_process->stop();
+    }
+    return serving;
+}
+
+// Serving means RUNNING past starttime (or READY=1) and, with a health check, a passing probe for the new PID
+bool TaskMaster::waitUntilServing(const std::string& name, const std::shared_ptr<Process>& process) {
+    const ProcessConfig& config = process->getConfig();
+    pid_t pid = process->getPid();
+    int settle = config.notify_ready ? config.ready_timeout : config.starttime;
+    if (config.healthcheck.enabled()) {
+        settle += config.healthcheck.threshold * (config.healthcheck.timeout + 1);
+    }
+    auto deadline = process->getSpawnTime() + std::chrono::seconds(settle + 1);
+    auto next_probe = std::chrono::steady_clock::now();
+    
+    while (std::chrono::steady_clock::now() < deadline) {
+        ProcessState state = process->getState();
+        if ((state != ProcessState::RUNNING && state != ProcessState::STARTING) || process->getPid() != pid) {
+            return false;
+        }
+        
+        bool settled = config.notify_ready ||
+                       std::chrono::steady_clock::now() - process->getStartTime() >= std::chrono::seconds(config.starttime);
+        if (state == ProcessState::RUNNING && settled) {
+            if (!config.healthcheck.enabled()) {
+                return true;
+            }
+            if (health_checker.isPassing(name, pid)) {
+                return true;
+            }
+            // Probe once a second instead of every healthcheck_interval while the rollout waits
+            if (std::chrono::steady_clock::now() >= next_probe) {
+                health_checker.expedite(name);
+                next_probe = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(ROLLOUT_POLL_MS));
+    }
+    return false;
+}
+
+ControlProtocol::ItemResult TaskMaster::executeBatchItem(ControlProtocol::Opcode op, const std::string& name) {
+    using ItemStatus = ControlProtocol::ItemStatus;
+    
+    if (!findProcess(name)) {
+        return {ItemStatus::NOT_FOUND, "Process not found: " + name};
+    }
+    
+    switch (op) {
+        case ControlProtocol::Opcode::START:
+            if (startProgram(name)) return {ItemStatus::OK, "Started " + name};
+            return {ItemStatus::FAILED, "Failed to start " + name};
+        case ControlProtocol::Opcode::STOP:
+            if (stopProgram(name)) return {ItemStatus::OK, "Stopped " + name};
+            return {ItemStatus::FAILED, "Failed to stop " + name};
+        case ControlProtocol::Opcode::RESTART:
+            if (restartProgram(name)) return {ItemStatus::OK, "Restarted " + name};
+            return {ItemStatus::FAILED, "Failed to restart " + name};
+        case ControlProtocol::Opcode::STATUS:
+            return {ItemStatus::OK, getStatus(name)};
+        default:
+            return {ItemStatus::FAILED, "Unsupported operation"};
+    }
+}
+
 std::string TaskMaster::getStatus(const std::string& name) {
     std::lock_guard<std::mutex> lock(processes_mutex);
     std::string result;
@@ -319,6 +1323,11 @@ std::string TaskMaster::getStatus(const std::string& name) {
                 result += " (PID: " + std::to_string(process->getPid()) + 
                          ", Uptime: " + std::to_string(process->getUptime().count()) + "s)";
             }
+            std::string status_text = process->getStatusText();
+            if (!status_text.empty() && process->isActive()) {
+                result += " - " + status_text;
+            }
+            result += describeFailure(process);
             result += "\n";
         }
     } else {
@@ -329,6 +1338,11 @@ std::string TaskMaster::getStatus(const std::string& name) {
                 result += " (PID: " + std::to_string(it->second->getPid()) + 
                          ", Uptime: " + std::to_string(it->second->getUptime().count()) + "s)";
             }
+            std::string status_text = it->second->getStatusText();
+            if (!status_text.empty() && it->second->isActive()) {
+                result += " - " + status_text;
+            }
+            result += describeFailure(it->second);
         } else {
             result = "Process not found: " + name;
         }
@@ -337,18 +1351,51 @@ std::string TaskMaster::getStatus(const std::string& name) {
     return result;
 }
 
+// Why an instance that is down got there, for the one-line status views
+std::string TaskMaster::describeFailure(const std::shared_ptr<Process>& process) {
+    ProcessState state = process->getState();
+    if (process->getLastFailure() == FailureKind::NONE ||
+        (state != ProcessState::FATAL && state != ProcessState::BACKOFF && state != ProcessState::EXITED)) {
+        return "";
+    }
+    return std::string(" - ") + Process::failureName(process->getLastFailure()) + " error: " + process->getLastError();
+}
+
 bool TaskMaster::reloadConfig() {
-    if (!config_parser.parseFile(config_file)) {
-        return false;
+    std::map<std::string, std::vector<RolloutItem>> rollouts;
+    {
+        std::lock_guard<std::mutex> lock(processes_mutex);
+        
+        if (!config_parser.parseFile(config_file)) {
+            return false;
+        }
+        
+        auto new_configs = config_parser.getProcessConfigs();
+        
+        removeObsoleteProcesses(new_configs);
+        
+        updateProcessConfigurations(new_configs);
+        
+        health_checker.setTargets(processes);
+        updateActivationTargets();
+        processes_generation++;
+        rollouts.swap(pending_rollouts);
     }
     
-    std::lock_guard<std::mutex> lock(processes_mutex);
-    
-    auto new_configs = config_parser.getProcessConfigs();
-    
-    removeObsoleteProcesses(new_configs);
-    
-    updateProcessConfigurations(new_configs);
+    // Rollouts wait on readiness and health checks, which need the process table unlocked
+    for (const auto& [program, items] : rollouts) {
+        std::ostringstream report;
+        bool success = runRollout(program, items, report);
+        std::istringstream lines(report.str());
+        std::string line;
+        while (std::getline(lines, line)) {
+            if (success) {
+                Logger::getInstance().info(line);
+            } else {
+                Logger::getInstance().error(line);
+            }
+        }
+    }
     
     return true;
 }
@@ -360,10 +1407,13 @@ void TaskMaster::removeObsoleteProcesses(const std::map<std::string, ProcessConf
         if (new_configs.find(process_name) == new_configs.end()) {
             Logger::getInstance().info("Removing process " + it->first + " (no longer in configuration)");
             
-            if (it->second->getState() == ProcessState::RUNNING) {
+            std::lock_guard<std::mutex> operation(it->second->getOperationMutex());
+            if (it->second->isActive()) {
                 it->second->stop();
             }
+            socket_registry.release(it->first);
             
+            StateIndex::getInstance().detach(it->first, it->second.get());
             it = processes.erase(it);
         } else {
             ++it;
@@ -375,12 +1425,13 @@ void TaskMaster::updateProcessConfigurations(const std::map<std::string, Process
     for (const auto& [name, new_config] : new_configs) {
         for (int i = 0; i < new_config.numprocs; i++) {
             std::string instance_name = createInstanceName(name, new_config.numprocs, i);
+            ProcessConfig instance_config = config_parser.instanceConfig(new_config, i);
             
             auto it = processes.find(instance_name);
             if (it == processes.end()) {
-                addNewProcess(instance_name, new_config);
+                addNewProcess(instance_name, instance_config);
             } else {
-                updateExistingProcess(instance_name, new_config, it->second);
+                updateExistingProcess(instance_name, instance_config, it->second);
             }
         }
     }
@@ -389,7 +1440,9 @@ void TaskMaster::updateProcessConfigurations(const std::map<std::string, Process
 void TaskMaster::addNewProcess(const std::string& instance_name, const ProcessConfig& config) {
     Logger::getInstance().info("Adding new process " + instance_name + " from configuration");
     
-    processes[instance_name] = std::make_unique<Process>(config);
+    processes[instance_name] = std::make_shared<Process>(config, instance_name);
+    StateIndex::getInstance().attach(instance_name, processes[instance_name].get());
+    attachSockets(instance_name, processes[instance_name]);
     
     if (config.autostart == AutoStart::TRUE) {
         if (processes[instance_name]->start()) {
@@ -399,15 +1452,25 @@ void TaskMaster::addNewProcess(const std::string& instance_name, const ProcessCo
 }
 
 void TaskMaster::updateExistingProcess(const std::string& instance_name, const ProcessConfig& new_config, 
-                                     std::unique_ptr<Process>& process) {
+                                     std::shared_ptr<Process>& process) {
     if (hasConfigurationChanged(process->getConfig(), new_config)) {
+        if (new_config.rolling_reload && process->isActive()) {
+            Logger::getInstance().info("Configuration changed for process " + instance_name + ", queued for rolling update");
+            pending_rollouts[new_config.name].push_back({instance_name, new_config});
+            return;
+        }
         Logger::getInstance().info("Configuration changed for process " + instance_name + ", restarting");
         
-        if (process->getState() == ProcessState::RUNNING) {
-            process->stop();
+        {
+            std::lock_guard<std::mutex> operation(process->getOperationMutex());
+            if (process->isActive()) {
+                process->stop();
+            }
         }
         
-        processes[instance_name] = std::make_unique<Process>(new_config);
+        processes[instance_name] = std::make_shared<Process>(new_config, instance_name);
+        StateIndex::getInstance().attach(instance_name, processes[instance_name].get());
+        attachSockets(instance_name, processes[instance_name]);
         
         if (new_config.autostart == AutoStart::TRUE) {
             if (processes[instance_name]->start()) {
@@ -430,7 +1493,19 @@ bool TaskMaster::hasConfigurationChanged(const ProcessConfig& old_config, const
            old_config.stderr_logfile != new_config.stderr_logfile ||
            old_config.workingdir != new_config.workingdir ||
            old_config.environment != new_config.environment ||
-           old_config.umask != new_config.umask;
+           old_config.umask != new_config.umask ||
+           old_config.process_num != new_config.process_num ||
+           old_config.affinity != new_config.affinity ||
+           old_config.watchdog != new_config.watchdog ||
+           old_config.watchdog_cooldown != new_config.watchdog_cooldown ||
+           old_config.healthcheck != new_config.healthcheck ||
+           old_config.notify_ready != new_config.notify_ready ||
+           old_config.ready_timeout != new_config.ready_timeout ||
+           old_config.notify_watchdog != new_config.notify_watchdog ||
+           old_config.listen != new_config.listen ||
+           old_config.listen_backlog != new_config.listen_backlog ||
+           old_config.idle_timeout != new_config.idle_timeout ||
+           old_config.zygote != new_config.zygote;
 }
 
 std::string TaskMaster::createInstanceName(const std::string& base_name, int numprocs, int instance_index) {
@@ -459,67 +1534,661 @@ void TaskMaster::monitorProcesses() {
         
         if (!running) break;
         
-        checkProcessHealth();
-        restartFailedProcesses();
+        // Process-wide chores only; everything per instance is done by its shard
+        SupervisorCounters::increment(SupervisorCounters::getInstance().monitor_cycles);
+        handleFailedHealthChecks();
+        maintainWarmSpares();
+        maintainZygotes();
+        reapOrphans();
+    }
+}
+
+void TaskMaster::monitorShard(MonitorShard& shard) {
+    auto next_cycle = std::chrono::steady_clock::now() + std::chrono::milliseconds(MONITOR_INTERVAL_MS);
+    std::vector<uint64_t> ready;
+    while (running) {
+        refreshShard(shard);
+        watchExits(shard);
+        auto wake_at = std::min(next_cycle, shard.lifecycles.nextDue().value_or(next_cycle));
+        
+        std::deque<ShardMessage> messages;
+        ready.clear();
+        if (shard.reactor.isOpen()) {
+            shard.reactor.wait(wake_at, ready);
+            std::lock_guard<std::mutex> lock(shard.inbox_mutex);
+            messages.swap(shard.inbox);
+        } else {
+            std::unique_lock<std::mutex> lock(shard.inbox_mutex);
+            shard.inbox_cv.wait_until(lock, wake_at, [this, &shard] { return !running || !shard.inbox.empty(); });
+            messages.swap(shard.inbox);
+        }
+        if (!running) break;
+        
+        refreshShard(shard);
+        for (const auto& message : messages) {
+            handleShardMessage(shard, message);
+        }
+        for (uint64_t token : ready) {
+            handleExitEvent(shard, token);
+        }
+        
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_cycle) {
+            checkProcessHealth(shard);
+            restartFailedProcesses(shard);
+            stopIdleProcesses(shard);
+            next_cycle = now + std::chrono::milliseconds(MONITOR_INTERVAL_MS);
+        }
+        shard.lifecycles.runDue();
+    }
+    
+    // Stops already signalled run to their deadline; pending restarts see running is false and end
+    while (shard.lifecycles.size() > 0) {
+        auto due = shard.lifecycles.nextDue();
+        if (!due) {
+            break;
+        }
+        std::this_thread::sleep_until(*due);
+        shard.lifecycles.runDue();
     }
 }
 
-void TaskMaster::checkProcessHealth() {
+// The process table is only locked when its membership changed since the shard last looked
+void TaskMaster::refreshShard(MonitorShard& shard) {
+    if (shard.generation == processes_generation) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(processes_mutex);
+    shard.generation = processes_generation;
+    shard.members.clear();
     for (const auto& [name, process] : processes) {
-        if (process->getState() == ProcessState::RUNNING) {
-            pid_t current_pid = process->getPid();
-            
-            if (!process->isAlive()) {
-                int exit_code = process->getLastExitStatus();
-                
-                auto uptime = process->getUptime();
-                int starttime_seconds = process->getConfig().starttime;
+        if (shardOf(name) == shard.index) {
+            shard.members.emplace(name, process);
+        }
+    }
+}
+
+void TaskMaster::handleShardMessage(MonitorShard& shard, const ShardMessage& message) {
+    auto it = shard.members.find(message.name);
+    if (it == shard.members.end() || it->second->getState() != ProcessState::RUNNING) {
+        return;
+    }
+    AfterStop after = message.kind == ShardMessage::Kind::UNHEALTHY ? AfterStop::EXIT : AfterStop::RESTART;
+    shard.lifecycles.spawn(message.name, stopLifecycle(message.name, it->second, shard, after));
+}
+
+void TaskMaster::routeToShard(ShardMessage::Kind kind, const std::string& name) {
+    if (shards.empty()) {
+        return;
+    }
+    MonitorShard& shard = *shards[shardOf(name)];
+    {
+        std::lock_guard<std::mutex> lock(shard.inbox_mutex);
+        shard.inbox.push_back({kind, name});
+    }
+    shard.inbox_cv.notify_one();
+    if (shard.wake_fd != -1) {
+        uint64_t one = 1;
+        ssize_t written = write(shard.wake_fd, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+// Keeps one armed pidfd per member child; a pidfd turns readable once its child has exited
+void TaskMaster::watchExits(MonitorShard& shard) {
+    if (!shard.reactor.isOpen()) {
+        return;
+    }
+    
+    for (auto it = shard.exit_watches.begin(); it != shard.exit_watches.end();) {
+        auto member = shard.members.find(it->first);
+        if (member == shard.members.end() || member->second->getPid() != it->second.pid) {
+            dropExitWatch(shard, it++);
+        } else {
+            ++it;
+        }
+    }
+    
+    for (const auto& [name, process] : shard.members) {
+        pid_t pid = process->getPid();
+        if (pid <= 0 || shard.exit_watches.count(name)) {
+            continue;
+        }
+        int pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+        if (pidfd == -1) {
+            // Out of descriptors or already reaped; the periodic cycle still covers it
+            continue;
+        }
+        uint64_t token = shard.next_token++;
+        if (!shard.reactor.watch(pidfd, token)) {
+            close(pidfd);
+            continue;
+        }
+        shard.exit_watches[name] = {pid, pidfd, token};
+        shard.exit_tokens[token] = name;
+    }
+}
+
+void TaskMaster::dropExitWatch(MonitorShard& shard, std::map<std::string, MonitorShard::ExitWatch>::iterator it) {
+    shard.reactor.unwatch(it->second.token);
+    close(it->second.pidfd);
+    shard.exit_tokens.erase(it->second.token);
+    shard.exit_watches.erase(it);
+}
+
+// The watch stays in place, disarmed, until the instance's pid changes, so a child that cannot be
+// reaped yet (its instance busy with a command) does not fire again on every wait
+void TaskMaster::handleExitEvent(MonitorShard& shard, uint64_t token) {
+    if (token == WAKE_TOKEN) {
+        uint64_t count;
+        ssize_t drained = read(shard.wake_fd, &count, sizeof(count));
+        (void)drained;
+        shard.reactor.watch(shard.wake_fd, WAKE_TOKEN);
+        return;
+    }
+    
+    auto name = shard.exit_tokens.find(token);
+    if (name == shard.exit_tokens.end()) {
+        return;
+    }
+    auto member = shard.members.find(name->second);
+    if (member == shard.members.end()) {
+        return;
+    }
+    if (shard.lifecycles.has(member->first)) {
+        shard.lifecycles.wake(member->first);
+        return;
+    }
+    checkInstance(shard, member->first, member->second);
+    restartIfFailed(shard, member->first, member->second);
+}
+
+TaskMaster::MonitorShard::~MonitorShard() {
+    for (const auto& [name, watch] : exit_watches) {
+        close(watch.pidfd);
+    }
+    reactor.close();
+    if (wake_fd != -1) {
+        close(wake_fd);
+    }
+}
+
+size_t TaskMaster::shardOf(const std::string& name) const {
+    return std::hash<std::string>{}(name) % shards.size();
+}
+
+// Caller has already cleared running; the shards stay in place so late routing finds an inbox
+void TaskMaster::stopShards() {
+    for (auto& shard : shards) {
+        {
+            std::lock_guard<std::mutex> lock(shard->inbox_mutex);
+        }
+        shard->inbox_cv.notify_all();
+        if (shard->wake_fd != -1) {
+            uint64_t one = 1;
+            ssize_t written = write(shard->wake_fd, &one, sizeof(one));
+            (void)written;
+        }
+        if (shard->thread.joinable()) {
+            shard->thread.join();
+        }
+    }
+}
+
+void TaskMaster::sampleMetrics() {
+    struct Target {
+        std::string name;
+        pid_t pid;
+        std::vector<WatchdogRule> rules;
+        int cooldown;
+        size_t sample_index;
+    };
+    
+    MetricsCollector collector;
+    const double ticks_per_second = static_cast<double>(sysconf(_SC_CLK_TCK));
+    auto last_sample = std::chrono::steady_clock::now();
+    
+    while (running) {
+        {
+            std::unique_lock<std::mutex> lock(metrics_mutex);
+            sampler_cv.wait_for(lock, std::chrono::milliseconds(SAMPLE_INTERVAL_MS),
+                                [this] { return !running; });
+        }
+        if (!running) break;
+        
+        spawn_governor.samplePressure();
+        
+        auto sample_started = std::chrono::steady_clock::now();
+        std::vector<Target> targets;
+        auto samples = std::make_shared<ProcessSampleSet>();
+        {
+            std::lock_guard<std::mutex> lock(processes_mutex);
+            samples->reserve(processes.size());
+            for (const auto& [name, process] : processes) {
+                ProcessSample sample;
+                sample.name = name;
+                sample.program = process->getConfig().name;
+                sample.state = process->getStateString();
+                sample.restarts = process->getRestartCount();
+                sample.last_exit_status = process->getLastExitStatus();
+                sample.ready_latency_seconds = process->getReadyLatency();
                 
-                if (uptime.count() < starttime_seconds) {
-                    Logger::getInstance().error("Process " + name + " (PID: " + std::to_string(current_pid) + 
-                        ") died during startup period (uptime: " + std::to_string(uptime.count()) + 
-                        "s < starttime: " + std::to_string(starttime_seconds) + "s)");
-                    process->setState(ProcessState::BACKOFF);
-                } else {
-                    if (process->isExpectedExitCode(exit_code) || 
-                        process->getConfig().autorestart == AutoRestart::FALSE ||
-                        (process->getConfig().autorestart == AutoRestart::TRUE && process->getConfig().autorestart_exit_codes.empty())) {
-                        Logger::getInstance().info("Process " + name + " (PID: " + std::to_string(current_pid) + ") exited with expected status " + std::to_string(exit_code));
-                    } else {
-                        Logger::getInstance().logProcessDiedUnexpectedly(name, current_pid);
-                    }
-                    process->setState(ProcessState::EXITED);
+                if (process->getState() == ProcessState::RUNNING && process->getPid() > 0) {
+                    const auto& config = process->getConfig();
+                    sample.pid = process->getPid();
+                    sample.uptime_seconds = std::chrono::duration<double>(
+                        sample_started - process->getStartTime()).count();
+                    targets.push_back({name, sample.pid, config.watchdog, config.watchdog_cooldown,
+                                       samples->size()});
                 }
+                samples->push_back(std::move(sample));
             }
         }
+        
+        // One /proc scan serves every instance in this sample
+        ProcessTreeSnapshot snapshot = ProcessTreeSnapshot::capture();
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - last_sample).count();
+        last_sample = now;
+        
+        std::map<std::string, ProcessMetrics> fresh;
+        std::vector<WatchdogEvent> events;
+        for (const auto& target : targets) {
+            ProcessMetrics metrics = collector.collectMetrics(target.pid, snapshot);
+            metrics.pid = target.pid;
+            
+            auto previous = sampled_metrics.find(target.name);
+            if (previous != sampled_metrics.end() && previous->second.pid == target.pid &&
+                metrics.cpu_ticks >= previous->second.cpu_ticks && elapsed > 0) {
+                metrics.cpu_percent = 100.0 * (metrics.cpu_ticks - previous->second.cpu_ticks) /
+                                      (elapsed * ticks_per_second);
+            }
+            
+            if (!target.rules.empty()) {
+                auto fired = watchdog.evaluate(target.name, metrics, target.rules, target.cooldown);
+                events.insert(events.end(), fired.begin(), fired.end());
+            }
+            
+            ProcessSample& sample = (*samples)[target.sample_index];
+            sample.rss_bytes = metrics.memory_usage_mb * 1024 * 1024;
+            sample.cpu_seconds = metrics.cpu_ticks / ticks_per_second;
+            sample.cpu_percent = metrics.cpu_percent;
+            sample.file_descriptors = metrics.file_descriptors;
+            sample.fd_limit = metrics.fd_limit;
+            sample.tree_processes = metrics.process_count;
+            
+            fresh[target.name] = metrics;
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(metrics_mutex);
+            sampled_metrics.swap(fresh);
+        }
+        metrics_server.publish(samples);
+        
+        SupervisorCounters& counters = SupervisorCounters::getInstance();
+        SupervisorCounters::increment(counters.samples);
+        counters.last_sample_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - sample_started).count(), std::memory_order_relaxed);
+        
+        std::set<std::string> running_names;
+        for (const auto& target : targets) {
+            running_names.insert(target.name);
+        }
+        watchdog.retain(running_names);
+        
+        for (const auto& event : events) {
+            handleWatchdogEvent(event);
+        }
     }
 }
 
-void TaskMaster::restartFailedProcesses() {
-    for (const auto& [name, process] : processes) {
-        const auto& config = process->getConfig();
-        ProcessState state = process->getState();
+void TaskMaster::handleWatchdogEvent(const WatchdogEvent& event) {
+    SupervisorCounters::increment(SupervisorCounters::getInstance().watchdog_actions);
+    
+    switch (event.rule.action) {
+        case WatchdogAction::WARN:
+            Logger::getInstance().warning("Process " + event.instance_name + ": " + event.reason);
+            break;
         
-        if (state != ProcessState::EXITED && state != ProcessState::BACKOFF) {
-            continue;
+        case WatchdogAction::SIGNAL: {
+            Logger::getInstance().warning("Process " + event.instance_name + ": " + event.reason +
+                                          ", sending SIG" + event.rule.signal);
+            std::lock_guard<std::mutex> lock(processes_mutex);
+            auto it = processes.find(event.instance_name);
+            if (it != processes.end()) {
+                it->second->sendSignal(event.rule.signal);
+            }
+            break;
         }
         
-        if (!shouldRestartProcess(name, process)) {
-            handleProcessNotRestarting(name, process);
-            continue;
+        case WatchdogAction::RESTART: {
+            Logger::getInstance().warning("Process " + event.instance_name + ": " + event.reason +
+                                          ", scheduling graceful restart");
+            // The restart itself waits up to stoptime, so it runs on the instance's shard
+            routeToShard(ShardMessage::Kind::WATCHDOG_RESTART, event.instance_name);
+            break;
         }
-        
-        if (process->getRestartCount() >= config.startretries) {
-            Logger::getInstance().error("Process " + name + " has exceeded maximum restart attempts and is in FATAL state");
-            process->setState(ProcessState::FATAL);
-            continue;
+    }
+}
+
+void TaskMaster::reapOrphans() {
+    ProcessTreeSnapshot snapshot = ProcessTreeSnapshot::capture();
+    
+    for (pid_t zombie : snapshot.zombieChildrenOf(getpid())) {
+        bool managed = false;
+        for (const auto& [name, process] : processes) {
+            if (process->getPid() == zombie) {
+                managed = true;
+                break;
+            }
         }
+        // Managed leaders are reaped by isAlive() so their exit status is kept, probes by the health checker
+        if (!managed && !isSpare(zombie) && !zygote_pool.owns(zombie) &&
+            !health_checker.ownsChild(zombie) && waitpid(zombie, nullptr, WNOHANG) == zombie) {
+            Logger::getInstance().debug("Reaped orphaned descendant PID " + std::to_string(zombie));
+        }
+    }
+}
+
+void TaskMaster::checkProcessHealth(MonitorShard& shard) {
+    for (const auto& [name, process] : shard.members) {
+        checkInstance(shard, name, process);
+    }
+}
+
+void TaskMaster::checkInstance(MonitorShard& shard, const std::string& name, const std::shared_ptr<Process>& process) {
+    // Instances with a command or lifecycle in flight are left to it
+    if (shard.lifecycles.has(name)) {
+        return;
+    }
+    std::unique_lock<std::mutex> operation(process->getOperationMutex(), std::try_to_lock);
+    if (!operation.owns_lock()) {
+        return;
+    }
+    
+    if (process->getState() == ProcessState::STARTING) {
+        checkStartingProcess(shard, name, process, operation);
+    } else if (process->getState() == ProcessState::RUNNING) {
+        pid_t current_pid = process->getPid();
         
-        attemptProcessRestart(name, process);
+        if (!process->isAlive()) {
+            int exit_code = process->getLastExitStatus();
+            
+            auto uptime = process->getUptime();
+            int starttime_seconds = process->getConfig().starttime;
+            
+            // READY=1 already proved the startup succeeded, starttime only applies without it
+            if (!process->getConfig().notify_ready && uptime.count() < starttime_seconds) {
+                Logger::getInstance().error("Process " + name + " (PID: " + std::to_string(current_pid) + 
+                    ") died during startup period (uptime: " + std::to_string(uptime.count()) + 
+                    "s < starttime: " + std::to_string(starttime_seconds) + "s)");
+                process->recordFailure(FailureKind::STARTUP, "exited with status " + std::to_string(exit_code) +
+                                       " within starttime (" + std::to_string(starttime_seconds) + "s)");
+                SupervisorCounters::increment(SupervisorCounters::getInstance().startup_failures);
+                process->setState(ProcessState::BACKOFF, StateEvent::STARTUP_FAILED);
+            } else {
+                if (process->isExpectedExitCode(exit_code) || 
+                    process->getConfig().autorestart == AutoRestart::FALSE ||
+                    (process->getConfig().autorestart == AutoRestart::TRUE && process->getConfig().autorestart_exit_codes.empty())) {
+                    Logger::getInstance().info("Process " + name + " (PID: " + std::to_string(current_pid) + ") exited with expected status " + std::to_string(exit_code));
+                } else {
+                    Logger::getInstance().logProcessDiedUnexpectedly(name, current_pid);
+                    process->recordFailure(FailureKind::RUNTIME, "exited unexpectedly with status " +
+                                           std::to_string(exit_code));
+                }
+                process->setState(ProcessState::EXITED, StateEvent::EXITED);
+            }
+        } else if (process->isKeepaliveOverdue()) {
+            // The lifecycle takes the operation mutex itself
+            operation.unlock();
+            shard.lifecycles.spawn(name, stopLifecycle(name, process, shard, AfterStop::UNRESPONSIVE));
+        }
+    }
+}
+
+// Instances waiting for READY=1: a death or a missed ready_timeout counts as a failed startup
+void TaskMaster::checkStartingProcess(MonitorShard& shard, const std::string& name,
+                                      const std::shared_ptr<Process>& process, std::unique_lock<std::mutex>& operation) {
+    pid_t current_pid = process->getPid();
+    if (current_pid <= 0) {
+        return;
+    }
+    
+    if (!process->isAlive()) {
+        Logger::getInstance().error("Process " + name + " (PID: " + std::to_string(current_pid) +
+            ") exited with status " + std::to_string(process->getLastExitStatus()) + " before reporting readiness");
+        process->recordFailure(FailureKind::STARTUP, "exited with status " +
+                               std::to_string(process->getLastExitStatus()) + " before READY=1");
+        SupervisorCounters::increment(SupervisorCounters::getInstance().startup_failures);
+        process->setState(ProcessState::BACKOFF, StateEvent::STARTUP_FAILED);
+        return;
+    }
+    
+    int ready_timeout = process->getConfig().ready_timeout;
+    if (std::chrono::steady_clock::now() - process->getSpawnTime() > std::chrono::seconds(ready_timeout)) {
+        operation.unlock();
+        shard.lifecycles.spawn(name, stopLifecycle(name, process, shard, AfterStop::STARTUP_FAILED));
+    }
+}
+
+void TaskMaster::handleNotify(pid_t sender, const std::map<std::string, std::string>& fields) {
+    auto received = std::chrono::steady_clock::now();
+    
+    // Helpers such as systemd-notify run inside the instance's process group rather than as its leader
+    pid_t group = getpgid(sender);
+    std::string name;
+    std::shared_ptr<Process> process;
+    {
+        std::lock_guard<std::mutex> lock(processes_mutex);
+        for (const auto& [instance_name, candidate] : processes) {
+            if (candidate->getPid() == sender ||
+                (group > 0 && candidate->getProcessGroup() == group && candidate->isActive())) {
+                name = instance_name;
+                process = candidate;
+                break;
+            }
+        }
+    }
+    if (!process) {
+        Logger::getInstance().debug("Ignoring notification from unmanaged PID " + std::to_string(sender));
+        return;
+    }
+    
+    auto status = fields.find("STATUS");
+    if (status != fields.end()) {
+        process->setStatusText(status->second);
+    }
+    
+    auto ready = fields.find("READY");
+    if (ready != fields.end() && ready->second == "1" && process->markReady(received)) {
+        SupervisorCounters::increment(SupervisorCounters::getInstance().ready_notifications);
+        char latency[32];
+        snprintf(latency, sizeof(latency), "%.3f", process->getReadyLatency());
+        Logger::getInstance().info("Process " + name + " (PID: " + std::to_string(process->getPid()) +
+                                   ") is ready after " + latency + "s");
+    }
+    
+    auto keepalive = fields.find("WATCHDOG");
+    if (keepalive != fields.end() && keepalive->second == "1") {
+        process->touchKeepalive();
+    }
+}
+
+// Instances past their health check failure threshold are stopped and handed to the restart logic below
+void TaskMaster::handleFailedHealthChecks() {
+    for (const auto& name : health_checker.takeUnhealthy()) {
+        routeToShard(ShardMessage::Kind::UNHEALTHY, name);
+    }
+}
+
+void TaskMaster::restartFailedProcesses(MonitorShard& shard) {
+    for (const auto& [name, process] : shard.members) {
+        restartIfFailed(shard, name, process);
+    }
+}
+
+void TaskMaster::restartIfFailed(MonitorShard& shard, const std::string& name, const std::shared_ptr<Process>& process) {
+    if (shard.lifecycles.has(name)) {
+        return;
+    }
+    std::unique_lock<std::mutex> operation(process->getOperationMutex(), std::try_to_lock);
+    if (!operation.owns_lock()) {
+        return;
+    }
+    
+    const auto& config = process->getConfig();
+    ProcessState state = process->getState();
+    
+    if (state != ProcessState::EXITED && state != ProcessState::BACKOFF) {
+        return;
+    }
+    
+    if (!shouldRestartProcess(name, process)) {
+        handleProcessNotRestarting(name, process);
+        return;
+    }
+    
+    if (process->getRestartCount() >= config.startretries) {
+        Logger::getInstance().error("Process " + name + " has exceeded maximum restart attempts and is in FATAL state" +
+                                    " (last " + Process::failureName(process->getLastFailure()) + " error: " +
+                                    process->getLastError() + ")");
+        process->setState(ProcessState::FATAL, StateEvent::GIVE_UP);
+        return;
+    }
+    
+    attemptProcessRestart(name, process, shard);
+}
+
+// The delay before an automatic restart. A manual start or stop during the delay, or the instance
+// leaving the shard, cancels it
+LifecycleTask TaskMaster::restartLifecycle(std::string name, std::shared_ptr<Process> process, MonitorShard& shard) {
+    co_await shard.lifecycles.sleepFor(std::chrono::milliseconds(RESTART_DELAY_MS));
+    
+    // Removed, replaced, stopped or started by a command meanwhile; a token is not spent on those
+    auto still_exited = [&]() {
+        auto member = shard.members.find(name);
+        ProcessState state = process->getState();
+        return running && member != shard.members.end() && member->second == process &&
+               (state == ProcessState::EXITED || state == ProcessState::BACKOFF);
+    };
+    if (!still_exited()) {
+        co_return;
+    }
+    
+    // Queued behind restarts of a lower priority value, and for a token from the spawn governor
+    SpawnGovernor::Ticket ticket(spawn_governor, process->getConfig().priority);
+    SpawnGovernor::Clock::time_point retry_at;
+    while (!ticket.acquire(shard.lifecycles.now(), retry_at)) {
+        co_await shard.lifecycles.sleepUntil(retry_at);
+        if (!still_exited()) {
+            co_return;
+        }
+    }
+    
+    std::unique_lock<std::mutex> operation(process->getOperationMutex(), std::defer_lock);
+    while (running && !operation.try_lock()) {
+        co_await shard.lifecycles.sleepFor(std::chrono::milliseconds(ROLLOUT_POLL_MS));
+    }
+    if (!still_exited()) {
+        co_return;
+    }
+    if (process->restart()) {
+        Logger::getInstance().logProcessStarted(name, process->getPid());
+    }
+}
+
+// Stops a running instance, or one whose startup timed out, without blocking the shard: the operation
+// mutex is held across the stoptime wait, so commands for this instance queue behind it as they did
+// behind a blocking stop()
+LifecycleTask TaskMaster::stopLifecycle(std::string name, std::shared_ptr<Process> process, MonitorShard& shard,
+                                        AfterStop after) {
+    std::unique_lock<std::mutex> operation(process->getOperationMutex(), std::defer_lock);
+    while (!operation.try_lock()) {
+        if (!running) {
+            co_return;
+        }
+        co_await shard.lifecycles.sleepFor(std::chrono::milliseconds(ROLLOUT_POLL_MS));
+    }
+    // Only a startup that timed out is stopped before it reached RUNNING
+    ProcessState expected = after == AfterStop::STARTUP_FAILED ? ProcessState::STARTING : ProcessState::RUNNING;
+    if (process->getState() != expected || process->getPid() <= 0) {
+        co_return;
+    }
+    
+    pid_t pid = process->getPid();
+    if (after == AfterStop::EXIT) {
+        Logger::getInstance().error("Process " + name + " (PID: " + std::to_string(pid) + ") is unhealthy, stopping it");
+        process->recordFailure(FailureKind::RUNTIME, "failed its health check");
+        process->markHealthCheckFailed();
+    } else if (after == AfterStop::UNRESPONSIVE) {
+        int notify_watchdog = process->getConfig().notify_watchdog;
+        Logger::getInstance().error("Process " + name + " (PID: " + std::to_string(pid) +
+            ") sent no WATCHDOG=1 within " + std::to_string(notify_watchdog) + "s, stopping it");
+        SupervisorCounters::increment(SupervisorCounters::getInstance().keepalive_timeouts);
+        process->recordFailure(FailureKind::RUNTIME, "no WATCHDOG=1 within " + std::to_string(notify_watchdog) + "s");
+        process->markHealthCheckFailed();
+    } else if (after == AfterStop::STARTUP_FAILED) {
+        int ready_timeout = process->getConfig().ready_timeout;
+        Logger::getInstance().error("Process " + name + " (PID: " + std::to_string(pid) +
+            ") did not report readiness within " + std::to_string(ready_timeout) + "s, stopping it");
+        SupervisorCounters::increment(SupervisorCounters::getInstance().ready_timeouts);
+        SupervisorCounters::increment(SupervisorCounters::getInstance().startup_failures);
+        process->recordFailure(FailureKind::STARTUP, "no READY=1 within " + std::to_string(ready_timeout) + "s");
+    } else if (after == AfterStop::IDLE) {
+        Logger::getInstance().info("Process " + name + " idle (no connection for " +
+                                   std::to_string(process->getConfig().idle_timeout) +
+                                   "s), stopping it until the next one");
+        SupervisorCounters::increment(SupervisorCounters::getInstance().idle_stops);
+    } else {
+        Logger::getInstance().info("Watchdog restarting process " + name);
+        // The handover to a replacement waits on readiness, which is left to restart()
+        if (process->hasListenSockets()) {
+            // The old child keeps serving while the replacement waits for the spawn governor
+            SpawnGovernor::Ticket ticket(spawn_governor, process->getConfig().priority);
+            SpawnGovernor::Clock::time_point retry_at;
+            while (running && !ticket.acquire(shard.lifecycles.now(), retry_at)) {
+                co_await shard.lifecycles.sleepUntil(retry_at);
+            }
+            if (running && process->restart()) {
+                Logger::getInstance().logProcessStarted(name, process->getPid());
+            }
+            co_return;
+        }
+    }
+    
+    std::chrono::steady_clock::time_point deadline;
+    bool stopped = false;
+    if (process->beginStop(deadline)) {
+        while (shard.lifecycles.now() < deadline && process->hasSurvivors()) {
+            co_await shard.lifecycles.sleepFor(std::chrono::milliseconds(Process::STOP_POLL_MS));
+        }
+        stopped = process->finishStop();
+    }
+    
+    if (after == AfterStop::EXIT || after == AfterStop::UNRESPONSIVE) {
+        process->setState(ProcessState::EXITED, StateEvent::CHECK_FAILED);
+    } else if (after == AfterStop::STARTUP_FAILED) {
+        process->setState(ProcessState::BACKOFF, StateEvent::STARTUP_FAILED);
+    } else if (after == AfterStop::IDLE) {
+        if (stopped) {
+            Logger::getInstance().logProcessStopped(name, pid, 0);
+        }
+    } else if (stopped && running) {
+        // Watchdog restarts tend to come in herds too; commands for the instance keep queueing meanwhile
+        SpawnGovernor::Ticket ticket(spawn_governor, process->getConfig().priority);
+        SpawnGovernor::Clock::time_point retry_at;
+        while (running && !ticket.acquire(shard.lifecycles.now(), retry_at)) {
+            co_await shard.lifecycles.sleepUntil(retry_at);
+        }
+        if (running && process->restart()) {
+            Logger::getInstance().logProcessStarted(name, process->getPid());
+        }
     }
 }
 
-bool TaskMaster::shouldRestartProcess(const std::string& name, const std::unique_ptr<Process>& process) {
+bool TaskMaster::shouldRestartProcess(const std::string& name, const std::shared_ptr<Process>& process) {
     const auto& config = process->getConfig();
     int last_exit_code = process->getLastExitStatus();
     
@@ -528,6 +2197,10 @@ bool TaskMaster::shouldRestartProcess(const std::string& name, const std::unique
         return true;
     }
     
+    if (process->hasFailedHealthCheck()) {
+        return config.autorestart != AutoRestart::FALSE;
+    }
+    
     switch (config.autorestart) {
         case AutoRestart::TRUE:
             return config.autorestart_exit_codes.empty() || 
@@ -542,7 +2215,7 @@ bool TaskMaster::shouldRestartProcess(const std::string& name, const std::unique
     }
 }
 
-void TaskMaster::handleProcessNotRestarting(const std::string& name, const std::unique_ptr<Process>& process) {
+void TaskMaster::handleProcessNotRestarting(const std::string& name, const std::shared_ptr<Process>& process) {
     const auto& config = process->getConfig();
     int last_exit_code = process->getLastExitStatus();
     
@@ -553,10 +2226,11 @@ void TaskMaster::handleProcessNotRestarting(const std::string& name, const std::
         Logger::getInstance().info("Process " + name + " exited with expected exit code " + 
                                  std::to_string(last_exit_code) + ", not restarting");
     }
-    process->setState(ProcessState::STOPPED);
+    process->setState(ProcessState::STOPPED, StateEvent::SETTLE);
 }
 
-void TaskMaster::attemptProcessRestart(const std::string& name, const std::unique_ptr<Process>& process) {
+void TaskMaster::attemptProcessRestart(const std::string& name, const std::shared_ptr<Process>& process,
+                                       MonitorShard& shard) {
     const auto& config = process->getConfig();
     int next_attempt = process->getRestartCount() + 1;
     int last_exit_code = process->getLastExitStatus();
@@ -572,20 +2246,147 @@ void TaskMaster::attemptProcessRestart(const std::string& name, const std::uniqu
                                  std::to_string(config.startretries) + ")");
     }
     
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-    if (process->restart()) {
-        Logger::getInstance().logProcessStarted(name, process->getPid());
+    SupervisorCounters::increment(SupervisorCounters::getInstance().auto_restarts);
+    if (promoteSpare(name, process)) {
+        return;
+    }
+    
+    shard.lifecycles.spawn(name, restartLifecycle(name, process, shard));
+}
+
+// Keeps warm_spares standby children per program while any instance of it is running; caller holds processes_mutex
+void TaskMaster::maintainWarmSpares() {
+    std::map<std::string, std::shared_ptr<Process>> templates;
+    for (const auto& [name, process] : processes) {
+        const auto& config = process->getConfig();
+        if (config.warm_spares > 0 && process->isActive() && !templates.count(config.name)) {
+            templates[config.name] = process;
+        }
+    }
+    
+    // Shards promote spares without processes_mutex
+    std::lock_guard<std::mutex> spares_lock(spares_mutex);
+    for (auto& [program, pool] : warm_spares) {
+        auto found = templates.find(program);
+        for (auto it = pool.begin(); it != pool.end();) {
+            bool exited = waitpid(it->pid, nullptr, WNOHANG) == it->pid;
+            bool stale = found == templates.end() || !spareMatches(*it, found->second->getConfig()) ||
+                         it->config.warm_spares != found->second->getConfig().warm_spares;
+            if (exited || stale) {
+                if (exited) {
+                    Logger::getInstance().warning("Warm spare PID " + std::to_string(it->pid) + " of " + program + " exited");
+                    close(it->gate_fd);
+                } else {
+                    retireSpare(*it);
+                }
+                it = pool.erase(it);
+            } else {
+                ++it;
+            }
+        }
     }
+    
+    for (const auto& [program, process] : templates) {
+        auto& pool = warm_spares[program];
+        while (pool.size() < static_cast<size_t>(process->getConfig().warm_spares)) {
+            int gate_fd = -1;
+            pid_t pid = process->spawnSpare(gate_fd);
+            if (pid <= 0) {
+                Logger::getInstance().error("Could not spawn warm spare for " + program + ": " + strerror(errno));
+                break;
+            }
+            Logger::getInstance().debug("Spawned warm spare PID " + std::to_string(pid) + " for " + program);
+            pool.push_back({pid, gate_fd, process->getConfig()});
+        }
+    }
+}
+
+// Templates live as long as their program is configured in zygote mode; caller holds processes_mutex
+void TaskMaster::maintainZygotes() {
+    std::set<std::string> programs;
+    for (const auto& [name, process] : processes) {
+        if (process->getConfig().zygote) {
+            programs.insert(process->getConfig().name);
+        }
+    }
+    zygote_pool.retireStale(programs);
+}
+
+bool TaskMaster::promoteSpare(const std::string& name, const std::shared_ptr<Process>& process) {
+    std::lock_guard<std::mutex> spares_lock(spares_mutex);
+    auto found = warm_spares.find(process->getConfig().name);
+    if (found == warm_spares.end()) {
+        return false;
+    }
+    
+    auto& pool = found->second;
+    while (!pool.empty()) {
+        WarmSpare spare = pool.front();
+        pool.pop_front();
+        
+        if (waitpid(spare.pid, nullptr, WNOHANG) == spare.pid || !spareMatches(spare, process->getConfig())) {
+            close(spare.gate_fd);
+            kill(-spare.pid, SIGKILL);
+            continue;
+        }
+        
+        // The instance's own CPU placement, which the spare could not know when it was forked
+        const auto& config = process->getConfig();
+        AffinityPlacement placement = CpuAffinity::resolvePlacement(config.affinity, config.process_num);
+        if (!placement.cpus.empty()) {
+            CpuAffinity::applyCpus(spare.pid, placement.cpus);
+        }
+        
+        // The pid is known before the gate opens so an immediate READY=1 finds its instance
+        process->adoptSpare(spare.pid);
+        char go = 1;
+        ssize_t written = write(spare.gate_fd, &go, 1);
+        (void)written;
+        close(spare.gate_fd);
+        
+        SupervisorCounters::increment(SupervisorCounters::getInstance().spare_promotions);
+        Logger::getInstance().info("Promoted warm spare PID " + std::to_string(spare.pid) + " to " + name);
+        Logger::getInstance().logProcessStarted(name, spare.pid);
+        return true;
+    }
+    return false;
+}
+
+void TaskMaster::retireSpare(const WarmSpare& spare) {
+    close(spare.gate_fd);
+    kill(-spare.pid, SIGKILL);
+    waitpid(spare.pid, nullptr, 0);
+}
+
+// Spares are forked from whichever instance was running, so the instance number does not count
+bool TaskMaster::spareMatches(const WarmSpare& spare, const ProcessConfig& config) {
+    ProcessConfig spare_config = spare.config;
+    spare_config.process_num = config.process_num;
+    return !hasConfigurationChanged(spare_config, config);
 }
 
-void TaskMaster::printDetailedStatus(const std::string& filter) {
+bool TaskMaster::isSpare(pid_t pid) const {
+    std::lock_guard<std::mutex> spares_lock(spares_mutex);
+    for (const auto& [program, pool] : warm_spares) {
+        for (const auto& spare : pool) {
+            if (spare.pid == pid) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void TaskMaster::printDetailedStatus(const std::string& filter, std::ostream& out) {
     Logger::getInstance().logDetailedStatusRequest();
     
-    std::cout << "\nProcess Status (Detailed):\n";
-    std::cout << "==========================================\n";
+    out << "\nProcess Status (Detailed):\n";
+    out << "==========================================\n";
     
     std::lock_guard<std::mutex> lock(processes_mutex);
     
+    ProcessTreeSnapshot snapshot = ProcessTreeSnapshot::capture();
+    
     bool found_any = false;
     for (const auto& [name, process] : processes) {
         // Apply filter if provided
@@ -593,83 +2394,161 @@ void TaskMaster::printDetailedStatus(const std::string& filter) {
             continue;
         }
         
-        printProcessDetails(name, process);
-        std::cout << "\n";
+        printProcessDetails(name, process, snapshot, out);
+        out << "\n";
         found_any = true;
     }
     
     if (!filter.empty() && !found_any) {
-        std::cout << "No processes found matching: " << filter << "\n";
+        out << "No processes found matching: " << filter << "\n";
     }
 }
 
-void TaskMaster::printProcessDetails(const std::string& name, const std::unique_ptr<Process>& process) {
+// Only the members of the requested states are visited, taken from the state index
+void TaskMaster::printStatusByState(const std::vector<ProcessState>& states, bool detailed, std::ostream& out) {
+    std::lock_guard<std::mutex> lock(processes_mutex);
+    
+    std::optional<ProcessTreeSnapshot> snapshot;
+    if (detailed) {
+        snapshot = ProcessTreeSnapshot::capture();
+    }
+    
+    size_t found = 0;
+    for (ProcessState state : states) {
+        for (const std::string& name : StateIndex::getInstance().members(state)) {
+            auto it = processes.find(name);
+            if (it == processes.end()) {
+                continue;
+            }
+            if (detailed) {
+                printProcessDetails(name, it->second, *snapshot, out);
+                out << "\n";
+            } else {
+                out << name << ": " << it->second->getStateString();
+                if (it->second->getState() == ProcessState::RUNNING) {
+                    out << " (PID: " << it->second->getPid() << ", Uptime: " << it->second->getUptime().count() << "s)";
+                }
+                out << describeFailure(it->second) << "\n";
+            }
+            found++;
+        }
+    }
+    
+    if (found == 0) {
+        out << "No processes in the requested state\n";
+    }
+}
+
+void TaskMaster::printProcessDetails(const std::string& name, const std::shared_ptr<Process>& process,
+                                     const ProcessTreeSnapshot& snapshot, std::ostream& out) {
     std::string status_color = getStatusColor(process->getState());
-    std::cout << status_color << name << ": " << process->getStateString() << "\033[0m";
+    out << status_color << name << ": " << process->getStateString() << "\033[0m";
     
     if (process->getState() == ProcessState::RUNNING) {
         pid_t pid = process->getPid();
         MetricsCollector collector;
-        ProcessMetrics metrics = collector.collectMetrics(pid);
+        ProcessMetrics metrics = collector.collectMetrics(pid, snapshot);
         std::string uptime = collector.formatUptime(process->getStartTime());
         
-        std::cout << " (PID: " << pid << ", Uptime: " << uptime << ")\n";
+        out << " (PID: " << pid << ", Uptime: " << uptime << ")\n";
         
         // Memory info
-        std::cout << "  ├─ Memory: " 
+        out << "  ├─ Memory: " 
                   << collector.formatBytes(metrics.memory_usage_mb * 1024 * 1024);
         
         if (metrics.memory_peak_mb > 0) {
-            std::cout << " (peak: " << collector.formatBytes(metrics.memory_peak_mb * 1024 * 1024) << ")";
+            out << " (peak: " << collector.formatBytes(metrics.memory_peak_mb * 1024 * 1024) << ")";
+        }
+        out << "\n";
+        
+        // CPU usage comes from the background sampler, which needs two samples for a rate
+        double cpu_percent = 0;
+        {
+            std::lock_guard<std::mutex> metrics_lock(metrics_mutex);
+            auto sampled = sampled_metrics.find(name);
+            if (sampled != sampled_metrics.end() && sampled->second.pid == pid) {
+                cpu_percent = sampled->second.cpu_percent;
+            }
         }
-        std::cout << "\n";
         
         // File descriptors and restart count
-        std::cout << "  ├─ FDs: " << metrics.file_descriptors << "/1024";
-        std::cout << " | Restarts: " << process->getRestartCount() << "\n";
+        out << "  ├─ FDs: " << metrics.file_descriptors << "/";
+        if (metrics.fd_limit > 0) {
+            out << metrics.fd_limit;
+        } else {
+            out << "unlimited";
+        }
+        out << " | Restarts: " << process->getRestartCount() << "\n";
         
-        // Health check status
-        std::cout << "  └─ Last Health Check: \033[32mOK\033[0m (active)\n";
+        // Aggregated over the whole process group subtree, not just the direct child
+        out << "  ├─ Tree: " << metrics.process_count << " process"
+                  << (metrics.process_count == 1 ? "" : "es")
+                  << " | CPU: " << std::fixed << std::setprecision(1) << cpu_percent << "%"
+                  << " (" << metrics.cpu_ticks / sysconf(_SC_CLK_TCK) << "s total)\n";
         
+        // Actual placement as seen by the kernel, not the configured policy
+        int node = CpuAffinity::currentNode(pid);
+        out << "  ├─ CPU Mask: " << CpuAffinity::describeCpuMask(pid)
+                  << " | Node: " << (node >= 0 ? std::to_string(node) : "unknown") << "\n";
+        
+        if (process->isReady()) {
+            out << "  ├─ Ready: " << std::fixed << std::setprecision(3) << process->getReadyLatency()
+                << "s after fork";
+            std::string status_text = process->getStatusText();
+            if (!status_text.empty()) {
+                out << " | Status: " << status_text;
+            }
+            out << "\n";
+        }
+        
+        // Result of the last probe run by the health checker
+        std::string health = health_checker.describe(name);
+        if (health.empty()) {
+            out << "  └─ Health Check: not configured\n";
+        } else {
+            const char* color = health.rfind("OK", 0) == 0 ? "\033[32m" :
+                                health.rfind("FAILING", 0) == 0 ? "\033[31m" : "\033[33m";
+            out << "  └─ Health Check: " << color << health << "\033[0m\n";
+        }
+    
+    } else if (process->getState() == ProcessState::STARTING && process->getPid() > 0) {
+        auto waiting = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now() - process->getSpawnTime());
+        out << " (PID: " << process->getPid() << ", waiting " << waiting.count() << "s/"
+            << process->getConfig().ready_timeout << "s for READY=1)\n";
+        std::string status_text = process->getStatusText();
+        if (!status_text.empty()) {
+            out << "  └─ Status: " << status_text << "\n";
+        }
     } else if (process->getState() == ProcessState::FATAL) {
-        std::cout << " (Last exit: " << process->getLastExitStatus() 
+        out << " (Last exit: " << process->getLastExitStatus() 
                   << ", Restarts: " << process->getRestartCount() << ")\n";
-        std::cout << "  └─ Process failed to start or crashed\n";
+        if (process->getLastFailure() != FailureKind::NONE) {
+            out << "  └─ " << Process::failureName(process->getLastFailure()) << " error: "
+                << process->getLastError() << "\n";
+        } else {
+            out << "  └─ Process failed to start or crashed\n";
+        }
     } else {
-        std::cout << "\n";
+        out << "\n";
     }
 }
 
-void TaskMaster::printProcessStats() {
-    std::lock_guard<std::mutex> lock(processes_mutex);
+void TaskMaster::printProcessStats(std::ostream& out) {
+    // Maintained by the transitions themselves, so this does not depend on the size of the fleet
+    StateIndex::Totals totals = StateIndex::getInstance().totals();
+    auto count = [&totals](ProcessState state) {
+        return static_cast<int>(totals.by_state[static_cast<size_t>(state)]);
+    };
     
-    int total = 0;
-    int running = 0, stopped = 0, starting = 0, stopping = 0, failed = 0, exited = 0, backoff = 0;
-    int total_restarts = 0;
-    std::chrono::seconds total_uptime(0);
-    int running_count = 0;
-    
-    for (const auto& [name, process] : processes) {
-        total++;
-        ProcessState state = process->getState();
-        
-        switch (state) {
-            case ProcessState::RUNNING:
-                running++;
-                total_uptime += process->getUptime();
-                running_count++;
-                break;
-            case ProcessState::STOPPED:    stopped++; break;
-            case ProcessState::STARTING:   starting++; break;
-            case ProcessState::STOPPING:   stopping++; break;
-            case ProcessState::FATAL:      failed++; break;
-            case ProcessState::EXITED:     exited++; break;
-            case ProcessState::BACKOFF:    backoff++; break;
-            default: break;
-        }
-        
-        total_restarts += process->getRestartCount();
-    }
+    int total = static_cast<int>(totals.instances);
+    int running = count(ProcessState::RUNNING), stopped = count(ProcessState::STOPPED);
+    int starting = count(ProcessState::STARTING), stopping = count(ProcessState::STOPPING);
+    int failed = count(ProcessState::FATAL), exited = count(ProcessState::EXITED);
+    int backoff = count(ProcessState::BACKOFF);
+    uint64_t total_restarts = totals.restarts;
+    std::chrono::seconds total_uptime = totals.running_uptime;
+    int running_count = running;
     
     // Calculate average uptime
     std::string avg_uptime = "0s";
@@ -690,81 +2569,116 @@ void TaskMaster::printProcessStats() {
         avg_uptime = ss.str();
     }
     
-    std::cout << "\n\033[1mProcess Statistics:\033[0m\n";
-    std::cout << "==========================================\n";
-    std::cout << "Total Processes:     " << total << "\n";
-    std::cout << "\033[32mRunning:\033[0m             " << running;
-    if (starting > 0) std::cout << " (+" << starting << " starting)";
-    std::cout << "\n";
-    std::cout << "\033[33mStopped:\033[0m             " << stopped;
-    if (stopping > 0) std::cout << " (+" << stopping << " stopping)";
-    std::cout << "\n";
+    out << "\n\033[1mProcess Statistics:\033[0m\n";
+    out << "==========================================\n";
+    out << "Total Processes:     " << total << "\n";
+    out << "\033[32mRunning:\033[0m             " << running;
+    if (starting > 0) out << " (+" << starting << " starting)";
+    out << "\n";
+    out << "\033[33mStopped:\033[0m             " << stopped;
+    if (stopping > 0) out << " (+" << stopping << " stopping)";
+    out << "\n";
     if (failed > 0) {
-        std::cout << "\033[31mFailed:\033[0m              " << failed << "\n";
+        out << "\033[31mFailed:\033[0m              " << failed << "\n";
     }
     if (exited > 0) {
-        std::cout << "\033[36mExited:\033[0m              " << exited << "\n";
+        out << "\033[36mExited:\033[0m              " << exited << "\n";
     }
     if (backoff > 0) {
-        std::cout << "\033[35mBackoff:\033[0m             " << backoff << "\n";
+        out << "\033[35mBackoff:\033[0m             " << backoff << "\n";
+    }
+    out << "Total Restarts:      " << total_restarts << "\n";
+    size_t spares = 0;
+    {
+        std::lock_guard<std::mutex> spares_lock(spares_mutex);
+        for (const auto& [program, pool] : warm_spares) {
+            spares += pool.size();
+        }
+    }
+    if (spares > 0) {
+        out << "Warm Spares:         " << spares << "\n";
+    }
+    size_t zygotes = zygote_pool.count();
+    if (zygotes > 0) {
+        out << "Zygote Templates:    " << zygotes << "\n";
+    }
+    if (shards.size() > 1) {
+        out << "Monitor Shards:      " << shards.size() << "\n";
+    }
+    if (spawn_governor.isEnabled()) {
+        SupervisorCounters& counters = SupervisorCounters::getInstance();
+        uint64_t deferred = counters.spawns_deferred.load(std::memory_order_relaxed);
+        uint64_t waiting = counters.spawns_waiting.load(std::memory_order_relaxed);
+        double deferred_seconds = counters.spawn_deferred_ns.load(std::memory_order_relaxed) / 1e9;
+        out << "Deferred Spawns:     " << deferred << " (" << std::fixed << std::setprecision(1)
+            << deferred_seconds << "s total";
+        if (deferred > 0) {
+            out << ", " << deferred_seconds / deferred << "s avg";
+        }
+        out << ")";
+        if (waiting > 0) {
+            out << " +" << waiting << " waiting";
+        }
+        out << "\n";
+        out << "Host Pressure:       " << std::fixed << std::setprecision(1) << spawn_governor.getPressure()
+            << "% (PSI avg10)\n";
     }
-    std::cout << "Total Restarts:      " << total_restarts << "\n";
-    std::cout << "Average Uptime:      " << avg_uptime << "\n";
+    out << "Average Uptime:      " << avg_uptime << "\n";
     
     // Health indicator
     double health_score = (running_count > 0) ? (double(running) / total) * 100.0 : 0.0;
-    std::cout << "System Health:       ";
+    out << "System Health:       ";
     if (health_score >= 80.0) {
-        std::cout << "\033[32m" << std::fixed << std::setprecision(1) << health_score << "% (EXCELLENT)\033[0m\n";
+        out << "\033[32m" << std::fixed << std::setprecision(1) << health_score << "% (EXCELLENT)\033[0m\n";
     } else if (health_score >= 60.0) {
-        std::cout << "\033[33m" << std::fixed << std::setprecision(1) << health_score << "% (GOOD)\033[0m\n";
+        out << "\033[33m" << std::fixed << std::setprecision(1) << health_score << "% (GOOD)\033[0m\n";
     } else if (health_score >= 40.0) {
-        std::cout << "\033[33m" << std::fixed << std::setprecision(1) << health_score << "% (WARNING)\033[0m\n";
+        out << "\033[33m" << std::fixed << std::setprecision(1) << health_score << "% (WARNING)\033[0m\n";
     } else {
-        std::cout << "\033[31m" << std::fixed << std::setprecision(1) << health_score << "% (CRITICAL)\033[0m\n";
+        out << "\033[31m" << std::fixed << std::setprecision(1) << health_score << "% (CRITICAL)\033[0m\n";
     }
 }
 
-void TaskMaster::showProcessLogs(const std::string& process_name, int lines) {
+void TaskMaster::showProcessLogs(const std::string& process_name, int lines, std::ostream& out) {
     std::lock_guard<std::mutex> lock(processes_mutex);
     
     // Find the process
     auto it = processes.find(process_name);
     if (it == processes.end()) {
-        std::cout << "Process not found: " << process_name << std::endl;
+        out << "Process not found: " << process_name << std::endl;
         return;
     }
     
     const auto& process = it->second;
     const auto& config = process->getConfig();
     
-    std::cout << "\n\033[1mLogs for " << process_name << " (last " << lines << " lines):\033[0m\n";
-    std::cout << "=========================================\n";
+    out << "\n\033[1mLogs for " << process_name << " (last " << lines << " lines):\033[0m\n";
+    out << "=========================================\n";
     
     // Show stdout logs
     if (!config.stdout_logfile.empty() && config.stdout_logfile != "/dev/null") {
-        std::cout << "\033[32m[STDOUT]\033[0m " << config.stdout_logfile << ":\n";
-        showLogFile(config.stdout_logfile, lines);
+        out << "\033[32m[STDOUT]\033[0m " << config.stdout_logfile << ":\n";
+        showLogFile(config.stdout_logfile, lines, out);
     }
     
     // Show stderr logs
     if (!config.stderr_logfile.empty() && config.stderr_logfile != "/dev/null") {
-        std::cout << "\n\033[31m[STDERR]\033[0m " << config.stderr_logfile << ":\n";
-        showLogFile(config.stderr_logfile, lines);
+        out << "\n\033[31m[STDERR]\033[0m " << config.stderr_logfile << ":\n";
+        showLogFile(config.stderr_logfile, lines, out);
     }
     
     // If no log files configured
     if ((config.stdout_logfile.empty() || config.stdout_logfile == "/dev/null") &&
         (config.stderr_logfile.empty() || config.stderr_logfile == "/dev/null")) {
-        std::cout << "\033[33mNo log files configured for this process.\033[0m\n";
-        std::cout << "Output goes to console or /dev/null.\n";
+        out << "\033[33mNo log files configured for this process.\033[0m\n";
+        out << "Output goes to console or /dev/null.\n";
     }
 }
 
-void TaskMaster::showLogFile(const std::string& log_file, int lines) {
+void TaskMaster::showLogFile(const std::string& log_file, int lines, std::ostream& out) {
     std::ifstream file(log_file);
     if (!file.is_open()) {
-        std::cout << "\033[31mError: Could not open log file: " << log_file << "\033[0m\n";
+        out << "\033[31mError: Could not open log file: " << log_file << "\033[0m\n";
         return;
     }
     
@@ -777,7 +2691,7 @@ void TaskMaster::showLogFile(const std::string& log_file, int lines) {
     file.close();
     
     if (all_lines.empty()) {
-        std::cout << "\033[33m(Log file is empty)\033[0m\n";
+        out << "\033[33m(Log file is empty)\033[0m\n";
         return;
     }
     
@@ -786,11 +2700,11 @@ void TaskMaster::showLogFile(const std::string& log_file, int lines) {
     int line_number = start_line + 1;
     
     for (size_t i = start_line; i < all_lines.size(); ++i) {
-        std::cout << std::setw(4) << line_number++ << " | " << all_lines[i] << "\n";
+        out << std::setw(4) << line_number++ << " | " << all_lines[i] << "\n";
     }
     
     if (start_line > 0) {
-        std::cout << "\033[33m... (showing last " << lines << " of " 
+        out << "\033[33m... (showing last " << lines << " of " 
                   << all_lines.size() << " total lines)\033[0m\n";
     }
 }
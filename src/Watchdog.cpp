@@ -0,0 +1,218 @@
+#include "../include/Watchdog.hpp"
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+std::vector<WatchdogRule> Watchdog::parseRules(const std::string& value) {
+    std::vector<WatchdogRule> rules;
+    std::istringstream iss(value);
+    std::string token;
+    
+    while (std::getline(iss, token, ';')) {
+        token.erase(0, token.find_first_not_of(" \t"));
+        token.erase(token.find_last_not_of(" \t") + 1);
+        
+        if (!token.empty()) {
+            rules.push_back(parseRule(token));
+        }
+    }
+    
+    return rules;
+}
+
+// Grammar: <metric> '>' <threshold> [for <duration>] -> warn | restart | signal <SIG>
+WatchdogRule Watchdog::parseRule(const std::string& text) {
+    WatchdogRule rule;
+    rule.text = text;
+    
+    size_t arrow = text.find("->");
+    if (arrow == std::string::npos) {
+        throw std::invalid_argument("missing '-> action' in watchdog rule '" + text + "'");
+    }
+    
+    std::string condition = text.substr(0, arrow);
+    std::istringstream action_stream(text.substr(arrow + 2));
+    std::string action;
+    action_stream >> action;
+    std::transform(action.begin(), action.end(), action.begin(), ::tolower);
+    
+    if (action == "warn") {
+        rule.action = WatchdogAction::WARN;
+    } else if (action == "restart") {
+        rule.action = WatchdogAction::RESTART;
+    } else if (action == "signal") {
+        rule.action = WatchdogAction::SIGNAL;
+        action_stream >> rule.signal;
+        if (rule.signal.empty()) {
+            throw std::invalid_argument("missing signal name in watchdog rule '" + text + "'");
+        }
+    } else {
+        throw std::invalid_argument("unknown watchdog action '" + action + "'");
+    }
+    
+    // Accept both "max_rss=2G" and "rss>2G" spellings
+    std::string normalized = condition;
+    std::replace(normalized.begin(), normalized.end(), '=', '>');
+    size_t gt = normalized.find('>');
+    if (gt == std::string::npos) {
+        throw std::invalid_argument("missing '>' in watchdog rule '" + text + "'");
+    }
+    
+    std::string metric = normalized.substr(0, gt);
+    metric.erase(0, metric.find_first_not_of(" \t"));
+    metric.erase(metric.find_last_not_of(" \t") + 1);
+    std::transform(metric.begin(), metric.end(), metric.begin(), ::tolower);
+    if (metric.rfind("max_", 0) == 0) {
+        metric = metric.substr(4);
+    }
+    
+    std::istringstream rest(normalized.substr(gt + 1));
+    std::string threshold, word;
+    rest >> threshold;
+    
+    if (metric == "rss" || metric == "memory") {
+        rule.metric = WatchdogMetric::RSS;
+        rule.threshold = parseSize(threshold);
+    } else if (metric == "cpu") {
+        rule.metric = WatchdogMetric::CPU;
+        if (!threshold.empty() && threshold.back() == '%') threshold.pop_back();
+        rule.threshold = std::stod(threshold);
+    } else if (metric == "fds") {
+        rule.metric = WatchdogMetric::FDS;
+        if (!threshold.empty() && threshold.back() == '%') {
+            threshold.pop_back();
+            rule.percent_of_limit = true;
+        }
+        rule.threshold = std::stod(threshold);
+    } else {
+        throw std::invalid_argument("unknown watchdog metric '" + metric + "'");
+    }
+    
+    while (rest >> word) {
+        if (word == "for") {
+            std::string duration;
+            rest >> duration;
+            rule.duration = parseDuration(duration);
+        } else if (word != "of" && word != "limit") {
+            throw std::invalid_argument("unexpected '" + word + "' in watchdog rule '" + text + "'");
+        }
+    }
+    
+    return rule;
+}
+
+double Watchdog::parseSize(const std::string& value) {
+    if (value.empty()) {
+        throw std::invalid_argument("empty size");
+    }
+    
+    double multiplier = 1;
+    std::string number = value;
+    switch (::toupper(number.back())) {
+        case 'K': multiplier = 1024.0; break;
+        case 'M': multiplier = 1024.0 * 1024; break;
+        case 'G': multiplier = 1024.0 * 1024 * 1024; break;
+        default: break;
+    }
+    if (multiplier > 1) {
+        number.pop_back();
+    }
+    return std::stod(number) * multiplier;
+}
+
+int Watchdog::parseDuration(const std::string& value) {
+    if (value.empty()) {
+        throw std::invalid_argument("empty duration");
+    }
+    
+    int multiplier = 1;
+    std::string number = value;
+    switch (::tolower(number.back())) {
+        case 's': multiplier = 1; number.pop_back(); break;
+        case 'm': multiplier = 60; number.pop_back(); break;
+        case 'h': multiplier = 3600; number.pop_back(); break;
+        default: break;
+    }
+    return std::stoi(number) * multiplier;
+}
+
+bool Watchdog::isBreached(const WatchdogRule& rule, const ProcessMetrics& metrics, double& observed) {
+    switch (rule.metric) {
+        case WatchdogMetric::RSS:
+            observed = static_cast<double>(metrics.memory_usage_mb) * 1024 * 1024;
+            return observed > rule.threshold;
+        case WatchdogMetric::CPU:
+            observed = metrics.cpu_percent;
+            return observed > rule.threshold;
+        case WatchdogMetric::FDS:
+            if (rule.percent_of_limit) {
+                if (metrics.fd_limit == 0) return false;
+                observed = 100.0 * metrics.file_descriptors / metrics.fd_limit;
+            } else {
+                observed = metrics.file_descriptors;
+            }
+            return observed > rule.threshold;
+    }
+    return false;
+}
+
+std::vector<WatchdogEvent> Watchdog::evaluate(const std::string& instance_name, const ProcessMetrics& metrics,
+                                              const std::vector<WatchdogRule>& rules, int cooldown) {
+    std::vector<WatchdogEvent> events;
+    InstanceState& state = states[instance_name];
+    auto now = std::chrono::steady_clock::now();
+    if (state.pid != metrics.pid) {
+        state.pid = metrics.pid;
+        state.breach_since.clear();
+    }
+    state.cooldown = cooldown;
+    
+    for (size_t i = 0; i < rules.size(); ++i) {
+        const WatchdogRule& rule = rules[i];
+        double observed = 0;
+        
+        if (!isBreached(rule, metrics, observed)) {
+            state.breach_since.erase(i);
+            continue;
+        }
+        
+        auto since = state.breach_since.emplace(i, now).first->second;
+        if (now - since < std::chrono::seconds(rule.duration)) {
+            continue;
+        }
+        
+        // One cooldown per instance so a leaking service is not restarted in a loop
+        if (state.acted && now - state.last_action < std::chrono::seconds(cooldown)) {
+            continue;
+        }
+        
+        std::stringstream reason;
+        reason << "watchdog rule '" << rule.text << "' breached (observed "
+               << static_cast<long long>(observed) << ")";
+        events.push_back({instance_name, rule, reason.str()});
+        
+        state.acted = true;
+        state.last_action = now;
+        state.breach_since.erase(i);
+    }
+    
+    return events;
+}
+
+void Watchdog::retain(const std::set<std::string>& running) {
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = states.begin(); it != states.end();) {
+        InstanceState& state = it->second;
+        if (running.count(it->first)) {
+            ++it;
+            continue;
+        }
+        state.breach_since.clear();
+        // Kept while cooling down so a restart does not reset the wait before the next action
+        if (state.acted && now - state.last_action < std::chrono::seconds(state.cooldown)) {
+            ++it;
+        } else {
+            it = states.erase(it);
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#include "../include/WorkerPool.hpp"
+#include "../include/Logger.hpp"
+
+WorkerPool::WorkerPool(size_t threads) {
+    if (threads == 0) {
+        threads = 1;
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    shutdown();
+}
+
+bool WorkerPool::submit(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        if (stopping) return false;
+        jobs.push_back(std::move(job));
+    }
+    jobs_cv.notify_one();
+    return true;
+}
+
+void WorkerPool::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        if (stopping) return;
+        stopping = true;
+    }
+    jobs_cv.notify_all();
+    
+    for (auto& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void WorkerPool::workerLoop() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(jobs_mutex);
+            jobs_cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+            // Queued jobs still run on shutdown so callers waiting on them are released
+            if (jobs.empty()) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        
+        try {
+            job();
+        } catch (const std::exception& e) {
+            Logger::getInstance().error(std::string("Worker job failed: ") + e.what());
+        }
+    }
+}
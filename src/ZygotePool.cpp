@@ -0,0 +1,295 @@
+#include "../include/ZygotePool.hpp"
+#include "../include/Logger.hpp"
+#include <cstring>
+#include <algorithm>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+ZygotePool::~ZygotePool() {
+    closeAll();
+}
+
+pid_t ZygotePool::spawn(Process& process, int& gate_fd, std::string& error) {
+    const ProcessConfig& config = process.getConfig();
+    std::shared_ptr<Template> entry;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        auto& slot = templates[config.name];
+        if (!slot) {
+            slot = std::make_shared<Template>();
+        }
+        entry = slot;
+    }
+    
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    if (entry->pid > 0 && (waitpid(entry->pid, nullptr, WNOHANG) == entry->pid || !sameTemplate(entry->config, config))) {
+        stopTemplate(*entry);
+    }
+    
+    if (entry->pid <= 0) {
+        int control_fd = -1;
+        pid_t pid = process.spawnZygote(control_fd);
+        if (pid <= 0) {
+            error = "could not start template: " + process.getLastError();
+            return -1;
+        }
+        entry->pid = pid;
+        entry->control_fd = control_fd;
+        entry->config = config;
+        Logger::getInstance().info("Started zygote PID " + std::to_string(pid) + " for " + config.name);
+    }
+    
+    return request(*entry, process, gate_fd, error);
+}
+
+void ZygotePool::release(int gate_fd) {
+    char go = 1;
+    ssize_t written = write(gate_fd, &go, 1);
+    (void)written;
+    close(gate_fd);
+}
+
+pid_t ZygotePool::request(Template& entry, const Process& process, int& gate_fd, std::string& error) {
+    // NUL-separated KEY=VALUE pairs the instance applies to its environment after the fork
+    std::string payload;
+    for (const auto& [key, value] : process.getConfig().environment) {
+        payload += key + "=" + value + '\0';
+    }
+    payload += "TASKMASTER_INSTANCE=" + process.getName();
+    
+    int gate[2];
+    if (pipe2(gate, O_CLOEXEC) != 0) {
+        error = "could not create gate: " + std::string(strerror(errno));
+        return -1;
+    }
+    
+    iovec iov = {const_cast<char*>(payload.data()), payload.size()};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &gate[0], sizeof(int));
+    
+    ssize_t sent = sendmsg(entry.control_fd, &msg, MSG_NOSIGNAL);
+    close(gate[0]);
+    if (sent < 0) {
+        error = "template PID " + std::to_string(entry.pid) + " is not accepting requests: " + strerror(errno);
+        close(gate[1]);
+        stopTemplate(entry);
+        return -1;
+    }
+    
+    // The first request also waits for the template's own initialisation
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(entry.config.ready_timeout);
+    pid_t child = awaitReply(entry, deadline, error);
+    if (child < 0) {
+        close(gate[1]);
+        stopTemplate(entry);
+        return -1;
+    }
+    // The intermediate fork exits right after forking, so reparenting is quick unless the template is broken
+    deadline = std::min(deadline, std::chrono::steady_clock::now() + std::chrono::milliseconds(ADOPT_TIMEOUT_MS));
+    if (child == 0 || !adopt(child, deadline, error)) {
+        close(gate[1]);
+        if (child > 0) {
+            kill(child, SIGKILL);
+        }
+        return -1;
+    }
+    
+    gate_fd = gate[1];
+    return child;
+}
+
+// Returns the instance's pid, 0 when the template reported an error itself, -1 when it is unusable
+pid_t ZygotePool::awaitReply(Template& entry, std::chrono::steady_clock::time_point deadline, std::string& error) {
+    char buffer[MAX_REPLY];
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(ucred)) + CMSG_SPACE(4 * sizeof(int))];
+    
+    while (true) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) {
+            error = "no reply from template PID " + std::to_string(entry.pid) + " within " +
+                    std::to_string(entry.config.ready_timeout) + "s";
+            return -1;
+        }
+        
+        pollfd pfd = {entry.control_fd, POLLIN, 0};
+        if (poll(&pfd, 1, static_cast<int>(remaining.count())) <= 0) {
+            continue;
+        }
+        
+        iovec iov = {buffer, sizeof(buffer)};
+        msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        
+        ssize_t received = recvmsg(entry.control_fd, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+        if (received == 0) {
+            error = "template PID " + std::to_string(entry.pid) + " exited";
+            return -1;
+        }
+        if (received < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                continue;
+            }
+            error = "template channel failed: " + std::string(strerror(errno));
+            return -1;
+        }
+        
+        pid_t sender = -1;
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                int* fds = reinterpret_cast<int*>(CMSG_DATA(cmsg));
+                size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for (size_t i = 0; i < count; i++) {
+                    close(fds[i]);
+                }
+            } else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_CREDENTIALS) {
+                ucred credentials;
+                std::memcpy(&credentials, CMSG_DATA(cmsg), sizeof(credentials));
+                sender = credentials.pid;
+            }
+        }
+        
+        if (sender <= 0) {
+            continue;
+        }
+        if (sender == entry.pid) {
+            std::string text(buffer, static_cast<size_t>(received));
+            if (text.compare(0, 6, "ERROR=") == 0) {
+                text.erase(0, 6);
+            }
+            error = "template: " + text;
+            return 0;
+        }
+        // Only the kernel-supplied credentials count, whatever the instance wrote
+        return sender;
+    }
+}
+
+bool ZygotePool::adopt(pid_t child, std::chrono::steady_clock::time_point deadline, std::string& error) {
+    // The instance becomes our child once the template's intermediate fork has exited
+    while (true) {
+        siginfo_t info;
+        std::memset(&info, 0, sizeof(info));
+        if (waitid(P_PID, static_cast<id_t>(child), &info, WEXITED | WNOHANG | WNOWAIT) == 0) {
+            break;
+        }
+        if (errno != ECHILD && errno != EINTR) {
+            error = "could not wait for PID " + std::to_string(child) + ": " + strerror(errno);
+            return false;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            error = "PID " + std::to_string(child) + " was never reparented to the supervisor (not double-forked?)";
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(ADOPT_POLL_MS));
+    }
+    
+    // Out of the template's group, so stopping one instance never signals the template or its siblings
+    setpgid(child, child);
+    if (getpgid(child) != child) {
+        error = "PID " + std::to_string(child) + " could not be given its own process group";
+        return false;
+    }
+    return true;
+}
+
+void ZygotePool::retireStale(const std::set<std::string>& programs) {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    for (auto it = templates.begin(); it != templates.end();) {
+        std::shared_ptr<Template> entry = it->second;
+        std::unique_lock<std::mutex> busy(entry->mutex, std::try_to_lock);
+        if (!busy.owns_lock()) {
+            ++it;
+            continue;
+        }
+        
+        if (entry->pid > 0 && waitpid(entry->pid, nullptr, WNOHANG) == entry->pid) {
+            Logger::getInstance().warning("Zygote PID " + std::to_string(entry->pid) + " of " + it->first + " exited");
+            close(entry->control_fd);
+            entry->control_fd = -1;
+            entry->pid = -1;
+        }
+        
+        if (!programs.count(it->first)) {
+            stopTemplate(*entry);
+            busy.unlock();
+            it = templates.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool ZygotePool::owns(pid_t pid) const {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    for (const auto& [program, entry] : templates) {
+        if (entry->pid == pid) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t ZygotePool::count() const {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    size_t alive = 0;
+    for (const auto& [program, entry] : templates) {
+        if (entry->pid > 0) {
+            alive++;
+        }
+    }
+    return alive;
+}
+
+void ZygotePool::closeAll() {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    for (auto& [program, entry] : templates) {
+        std::lock_guard<std::mutex> busy(entry->mutex);
+        stopTemplate(*entry);
+    }
+    templates.clear();
+}
+
+void ZygotePool::stopTemplate(Template& entry) {
+    if (entry.control_fd != -1) {
+        close(entry.control_fd);
+        entry.control_fd = -1;
+    }
+    pid_t pid = entry.pid.exchange(-1);
+    if (pid > 0) {
+        kill(-pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        Logger::getInstance().info("Stopped zygote PID " + std::to_string(pid) + " of " + entry.config.name);
+    }
+}
+
+// Fields baked into the template when it was started; the environment is resent with every request
+// but the template's own initialisation may have read it too
+bool ZygotePool::sameTemplate(const ProcessConfig& a, const ProcessConfig& b) {
+    return a.command == b.command &&
+           a.workingdir == b.workingdir &&
+           a.umask == b.umask &&
+           a.environment == b.environment &&
+           a.stdout_logfile == b.stdout_logfile &&
+           a.stderr_logfile == b.stderr_logfile &&
+           a.listen == b.listen &&
+           a.listen_backlog == b.listen_backlog &&
+           a.notify_ready == b.notify_ready &&
+           a.notify_watchdog == b.notify_watchdog &&
+           a.ready_timeout == b.ready_timeout;
+}
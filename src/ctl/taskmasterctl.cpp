@@ -0,0 +1,344 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../../include/ControlProtocol.hpp"
+
+namespace {
+
+const char* DEFAULT_SOCKET = "/tmp/taskmaster.sock";
+const size_t BATCH_FRAME_BYTES = 1024 * 1024;
+
+int connectSocket(const std::string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Pulls complete "<STATUS> <length>\n<body>" responses out of the receive buffer
+bool takeResponse(std::string& buffer, std::string& status, std::string& body) {
+    size_t newline = buffer.find('\n');
+    if (newline == std::string::npos) {
+        return false;
+    }
+    
+    std::string header = buffer.substr(0, newline);
+    size_t space = header.find(' ');
+    if (space == std::string::npos) {
+        return false;
+    }
+    
+    size_t length = std::strtoul(header.c_str() + space + 1, nullptr, 10);
+    if (buffer.size() < newline + 1 + length) {
+        return false;
+    }
+    
+    status = header.substr(0, space);
+    body = buffer.substr(newline + 1, length);
+    buffer.erase(0, newline + 1 + length);
+    return true;
+}
+
+// Writes every request while reading responses, so large batches never deadlock on full buffers.
+// `consume` takes complete responses out of the buffer and returns false once nothing more is expected.
+bool exchange(int fd, const std::string& requests, const std::function<bool(std::string&)>& consume) {
+    std::string received;
+    size_t sent = 0;
+    bool write_closed = false;
+    char chunk[65536];
+    
+    while (true) {
+        pollfd pfd = {fd, POLLIN, 0};
+        if (sent < requests.size()) {
+            pfd.events |= POLLOUT;
+        } else if (!write_closed) {
+            shutdown(fd, SHUT_WR);
+            write_closed = true;
+        }
+        
+        if (poll(&pfd, 1, -1) == -1) {
+            if (errno == EINTR) continue;
+            std::cerr << "taskmasterctl: poll: " << strerror(errno) << std::endl;
+            return false;
+        }
+        
+        if (pfd.revents & POLLOUT) {
+            ssize_t n = send(fd, requests.data() + sent, requests.size() - sent, MSG_NOSIGNAL);
+            if (n > 0) sent += static_cast<size_t>(n);
+        }
+        
+        if (pfd.revents & (POLLIN | POLLHUP)) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                return false;
+            }
+            received.append(chunk, static_cast<size_t>(n));
+            if (!consume(received)) {
+                return true;
+            }
+        }
+    }
+}
+
+int runPipelined(int fd, const std::string& requests, size_t expected) {
+    if (expected == 0) {
+        return 0;
+    }
+    
+    size_t answered = 0;
+    bool done = exchange(fd, requests, [&](std::string& received) {
+        std::string status, body;
+        while (takeResponse(received, status, body)) {
+            std::cout << body;
+            answered++;
+            if (status == "BYE") {
+                answered = expected;
+            }
+        }
+        std::cout.flush();
+        return answered < expected;
+    });
+    
+    if (!done && answered < expected) {
+        std::cerr << "taskmasterctl: connection closed after " << answered << "/" << expected << " responses" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int runInteractive(int fd) {
+    std::string line;
+    std::string received;
+    char chunk[65536];
+    
+    while (true) {
+        std::cout << "taskmaster> " << std::flush;
+        if (!std::getline(std::cin, line)) {
+            break;
+        }
+        
+        line += "\n";
+        if (send(fd, line.data(), line.size(), MSG_NOSIGNAL) < 0) {
+            std::cerr << "taskmasterctl: send: " << strerror(errno) << std::endl;
+            return 1;
+        }
+        
+        std::string status, body;
+        while (!takeResponse(received, status, body)) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                std::cerr << "taskmasterctl: connection closed by taskmaster" << std::endl;
+                return 1;
+            }
+            received.append(chunk, static_cast<size_t>(n));
+        }
+        
+        std::cout << body << std::flush;
+        if (status == "BYE") {
+            break;
+        }
+    }
+    return 0;
+}
+
+// Sends the names as binary batch frames and prints every item result in the order given
+int runBatch(int fd, const std::string& operation, const std::vector<std::string>& names) {
+    using Opcode = ControlProtocol::Opcode;
+    static const std::map<std::string, Opcode> operations = {
+        {"start", Opcode::START}, {"stop", Opcode::STOP},
+        {"restart", Opcode::RESTART}, {"status", Opcode::STATUS}
+    };
+    
+    auto op = operations.find(operation);
+    if (op == operations.end()) {
+        std::cerr << "taskmasterctl: batch operation must be start, stop, restart or status" << std::endl;
+        return 1;
+    }
+    
+    if (names.empty()) {
+        return 0;
+    }
+    
+    std::vector<std::vector<std::string>> chunks;
+    size_t chunk_bytes = 0;
+    for (const auto& name : names) {
+        if (chunks.empty() || chunks.back().size() >= ControlProtocol::MAX_BATCH ||
+            chunk_bytes + name.size() + 2 > BATCH_FRAME_BYTES) {
+            chunks.emplace_back();
+            chunk_bytes = 0;
+        }
+        chunks.back().push_back(name);
+        chunk_bytes += name.size() + 2;
+    }
+    
+    std::string requests;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        requests += ControlProtocol::encodeFrame(static_cast<uint32_t>(i), op->second,
+                                                 ControlProtocol::encodeNames(chunks[i]));
+    }
+    
+    std::map<uint32_t, std::vector<ControlProtocol::ItemResult>> replies;
+    bool protocol_error = false;
+    bool done = exchange(fd, requests, [&](std::string& received) {
+        ControlProtocol::Frame frame;
+        while (ControlProtocol::takeFrame(received, frame) == 1) {
+            std::vector<ControlProtocol::ItemResult> results;
+            if (frame.opcode != op->second || !ControlProtocol::decodeResults(frame.payload, results)) {
+                std::cerr << "taskmasterctl: request " << frame.request_id << " rejected: " << frame.payload << std::endl;
+                protocol_error = true;
+            }
+            replies[frame.request_id] = std::move(results);
+        }
+        return replies.size() < chunks.size();
+    });
+    
+    if (!done) {
+        std::cerr << "taskmasterctl: connection closed after " << replies.size() << "/" << chunks.size() << " batches" << std::endl;
+        return 1;
+    }
+    
+    int failures = 0;
+    for (const auto& [request_id, results] : replies) {
+        for (const auto& result : results) {
+            if (result.status == ControlProtocol::ItemStatus::OK) {
+                std::cout << result.message << std::endl;
+            } else {
+                std::cerr << result.message << std::endl;
+                failures++;
+            }
+        }
+    }
+    return (failures > 0 || protocol_error) ? 1 : 0;
+}
+
+// Prints the acknowledgement and then every EVENT frame until the supervisor goes away
+int runSubscribe(int fd, const std::string& command) {
+    std::string request = command + "\n";
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) < 0) {
+        std::cerr << "taskmasterctl: send: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    
+    std::string received;
+    char chunk[65536];
+    while (true) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            return 0;
+        }
+        received.append(chunk, static_cast<size_t>(n));
+        
+        std::string status, body;
+        while (takeResponse(received, status, body)) {
+            if (status == "EVENT") {
+                std::cout << body;
+            } else {
+                std::cerr << body;
+            }
+        }
+        std::cout.flush();
+    }
+}
+
+void printUsage() {
+    std::cerr << "Usage: taskmasterctl [-s socket] [command [args...]]" << std::endl;
+    std::cerr << "       taskmasterctl [-s socket] --batch <start|stop|restart|status> [names...]" << std::endl;
+    std::cerr << "  Without a command, reads commands from stdin (pipelined when stdin is not a terminal)." << std::endl;
+    std::cerr << "  With --batch and no names, reads one name per line from stdin." << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::string socket_path = getenv("TASKMASTER_SOCKET") ? getenv("TASKMASTER_SOCKET") : DEFAULT_SOCKET;
+    std::vector<std::string> words;
+    bool batch = false;
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "-s" || arg == "--socket") && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (arg == "-b" || arg == "--batch") {
+            batch = true;
+        } else if (arg == "-h" || arg == "--help") {
+            printUsage();
+            return 0;
+        } else {
+            words.push_back(arg);
+        }
+    }
+    
+    if (socket_path.rfind("unix:", 0) == 0) {
+        socket_path = socket_path.substr(5);
+    }
+    
+    int fd = connectSocket(socket_path);
+    if (fd == -1) {
+        std::cerr << "taskmasterctl: cannot connect to " << socket_path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    
+    int result;
+    if (batch) {
+        if (words.empty()) {
+            printUsage();
+            close(fd);
+            return 1;
+        }
+        std::string operation = words.front();
+        words.erase(words.begin());
+        if (words.empty()) {
+            std::string line;
+            while (std::getline(std::cin, line)) {
+                if (!line.empty()) words.push_back(line);
+            }
+        }
+        result = runBatch(fd, operation, words);
+    } else if (!words.empty()) {
+        std::string command;
+        for (const auto& word : words) {
+            if (!command.empty()) command += " ";
+            command += word;
+        }
+        if (words.front() == "subscribe") {
+            result = runSubscribe(fd, command);
+        } else {
+            result = runPipelined(fd, command + "\n", 1);
+        }
+    } else if (isatty(STDIN_FILENO)) {
+        result = runInteractive(fd);
+    } else {
+        std::string requests;
+        std::string line;
+        size_t count = 0;
+        while (std::getline(std::cin, line)) {
+            requests += line + "\n";
+            count++;
+        }
+        result = runPipelined(fd, requests, count);
+    }
+    
+    close(fd);
+    return result;
+}
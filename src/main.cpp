@@ -1,24 +1,35 @@
 #include <iostream>
 #include <memory>
 #include <signal.h>
+#include <unistd.h>
 #include "../include/TaskMaster.hpp"
 #include "../include/Logger.hpp"
 
 std::unique_ptr<TaskMaster> g_taskmaster;
 
+volatile sig_atomic_t g_signal = 0;
+
+// Shutting down takes locks and joins threads, which a handler interrupting any of them must not do:
+// the run loop notices the request and shuts down from the main thread
 void signalHandler(int signum) {
-    if (g_taskmaster) {
-        Logger::getInstance().info("Received signal " + std::to_string(signum) + ". Shutting down TaskMaster...");
-        g_taskmaster->shutdown();
+    g_signal = signum;
+    if (!g_taskmaster) {
+        _exit(signum);
     }
-    exit(signum);
+    g_taskmaster->requestShutdownFromSignal(signum);
 }
 
 int main(int argc, char* argv[]) {
     std::string config_file = "taskmaster.conf";
+    bool interactive = true;
     
-    if (argc > 1) {
-        config_file = argv[1];
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-d" || arg == "--daemon") {
+            interactive = false;
+        } else {
+            config_file = arg;
+        }
     }
     
     signal(SIGINT, signalHandler);
@@ -28,12 +39,12 @@ int main(int argc, char* argv[]) {
         g_taskmaster = std::make_unique<TaskMaster>(config_file);
         
         std::cout << "TaskMaster starting..." << std::endl;
-        g_taskmaster->run();
+        g_taskmaster->run(interactive);
         
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
     
-    return 0;
+    return g_signal;
 }